@@ -8,14 +8,26 @@
  * Changes:
  * Initial version, Matthew L. Curry
  * Dec 16, 2014, Rodrigo Sardinas; revised to use new dynamic api.
+ * Added a column for the Jerasure Cauchy backend.
+ * Added the RAID-6 comparison.
+ * Added the table footprint report.
+ * Added the fixed-shape codec comparison.
+ * The fixed-shape codecs are compared against simd as well.
+ * Added the run-time compiled kernel comparison.
+ * Added the GF(2^16) wide stripe test.
+ * The scaling test reports per-node throughput on NUMA machines.
+ * Added the asynchronous submission test.
+ * The asynchronous test reports ring occupancy and wakeups.
  */
 
 #include <gibraltar.h>
+#include <gibraltar.hpp>
 #include <iostream>
 #include <cstdlib>
 #include <sys/time.h>
 #include <cstring>
 #include <cstdio>
+#include <unistd.h>
 using namespace std;
 
 #ifndef min_test
@@ -41,19 +53,513 @@ etime(void)
 		var = (var + etime()) / iters;				\
 	} while(0)
 
+/* Strong scaling of the parallel backend: one fixed-size stripe
+ * encoded and recovered with an increasing number of threads.
+ */
+void
+scaling_test(int n, int m, int iters)
+{
+	int nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+	double base_chk = 0, base_rec = 0;
+
+	printf("%% Strong scaling of parallel(simd), n = %i, m = %i\n", n, m);
+	printf("%% threads datasize chk_tput rec_tput chk_spdp rec_spdp\n");
+	for (int t = 1; t <= nprocs; t = (t < nprocs && 2 * t > nprocs) ?
+		     nprocs : 2 * t) {
+		double chk_time, rec_time;
+		gib_context_t *inner, *gc;
+		int size = 16 * 1024 * 1024;
+		void *data;
+
+		if (gib_init_simd(n, m, &inner) ||
+		    gib_init_parallel(inner, t, 0, &gc)) {
+			printf("Error initializing parallel context\n");
+			exit(EXIT_FAILURE);
+		}
+		gib_alloc(&data, size, &size, gc);
+		for (int i = 0; i < size * n; i++)
+			((char *) data)[i] = (unsigned char) rand() % 256;
+
+		time_iters(chk_time, gib_generate(data, size, gc), iters);
+
+		unsigned char *backup_data = (unsigned char *)
+			malloc(size * (n + m));
+		memcpy(backup_data, data, size * (n + m));
+
+		/* Lose the first m data buffers, and recover them from
+		 * the parity buffers shifted into their place.
+		 */
+		int buf_ids[256];
+		int nfailed = (m < n) ? m : n;
+		for (int i = 0; i < n - nfailed; i++)
+			buf_ids[i] = i + nfailed;
+		for (int i = 0; i < nfailed; i++) {
+			buf_ids[n - nfailed + i] = n + i;
+			buf_ids[n + i] = i;
+		}
+		for (int i = 0; i < n; i++)
+			memcpy((unsigned char *) data + i * size,
+			       backup_data + buf_ids[i] * size, size);
+		time_iters(rec_time,
+			   gib_recover(data, size, buf_ids, nfailed, gc),
+			   iters);
+		for (int i = 0; i < nfailed; i++) {
+			if (memcmp((unsigned char *) data + (n + i) * size,
+				   backup_data + buf_ids[n + i] * size,
+				   size)) {
+				printf("Parallel recovery failed with %i "
+				       "threads.\n", t);
+				exit(1);
+			}
+		}
+
+		double size_mb = size * n / 1024.0 / 1024.0;
+		if (t == 1) {
+			base_chk = chk_time;
+			base_rec = rec_time;
+		}
+		printf("%9i %8i %8.3lf %8.3lf %8.3lf %8.3lf\n", t, size * n,
+		       size_mb / chk_time, size_mb / rec_time,
+		       base_chk / chk_time, base_rec / rec_time);
+
+		/* Remote bytes crossed the interconnect */
+		for (int k = 0; gib_parallel_nodes(gc) > 1 &&
+			     k < gib_parallel_nodes(gc); k++) {
+			gib_node_stats s;
+			gib_parallel_node_stats(gc, k, &s);
+			printf("%%   node %i: %lu bytes, %lu remote, "
+			       "%8.3lf MB/s\n", k, s.bytes, s.remote_bytes,
+			       s.ns ? s.bytes / 1024.0 / 1024.0 /
+			       (s.ns / 1e9) : 0.0);
+		}
+
+		free(backup_data);
+		gib_free(data, gc);
+		gib_destroy(gc);
+	}
+}
+
+/* A batch of many small stripes of varying size, load-balanced by the
+ * work-stealing scheduler.
+ */
+void
+batch_test(int n, int m, int nstripes, int iters)
+{
+	gib_context_t *gc;
+	gib_ws *ws;
+	gib_stripe *stripes = new gib_stripe[nstripes];
+	double batch_time, total = 0;
+
+	if (gib_init_simd(n, m, &gc) || gib_ws_create(0, 0, &ws)) {
+		printf("Error initializing work-stealing test\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < nstripes; i++) {
+		int size = 4096 * (1 + rand() % 16);
+		gib_alloc(&stripes[i].buffers, size, &size, gc);
+		for (int b = 0; b < size * n; b++)
+			((char *) stripes[i].buffers)[b] = rand() % 256;
+		stripes[i].c = gc;
+		stripes[i].buf_size = size;
+		stripes[i].work_size = size;
+		stripes[i].buf_ids = NULL;
+		total += size * n;
+	}
+
+	time_iters(batch_time, gib_ws_run(ws, stripes, nstripes), iters);
+
+	printf("%% Work-stealing batch of %i stripes, n = %i, m = %i\n",
+	       nstripes, n, m);
+	printf("%% chk_tput %8.3lf\n", total / 1024 / 1024 / batch_time);
+	printf("%%   worker    tasks   steals\n");
+	for (int w = 0; w < gib_ws_nworkers(ws); w++) {
+		struct gib_ws_stats st;
+		gib_ws_stats(ws, w, &st);
+		printf("%% %8i %8lu %8lu\n", w, st.tasks, st.steals);
+	}
+
+	for (int i = 0; i < nstripes; i++)
+		gib_free(stripes[i].buffers, gc);
+	delete[] stripes;
+	gib_ws_destroy(ws);
+	gib_destroy(gc);
+}
+
+/* The RAID-6 codec against the general SIMD path at m = 2, recovering
+ * the first two data buffers.
+ */
+void
+raid6_test(int iters)
+{
+	printf("%% RAID-6 (m = 2): general simd path vs. P/Q codec\n");
+	printf("%%      n datasize simd_chk simd_rec raid6_chk raid6_rec\n");
+	for (int n = 4; n <= 16; n += 4) {
+		int size = 1024 * 1024;
+		printf("%8i %8i ", n, size * n);
+		for (int j = 0; j < 2; j++) {
+			double chk_time, rec_time;
+			gib_context_t *gc;
+			void *data, *dense;
+			int rc, ld;
+
+			if (j == 0)
+				rc = gib_init_simd(n, 2, &gc);
+			else
+				rc = gib_init_raid6(n, &gc);
+			if (rc) {
+				printf("Error:  %i\n", rc);
+				exit(EXIT_FAILURE);
+			}
+			gib_alloc(&data, size, &ld, gc);
+			gib_alloc(&dense, size, &ld, gc);
+			for (int i = 0; i < ld * n; i++)
+				((char *) data)[i] = rand() % 256;
+
+			time_iters(chk_time, gib_generate(data, ld, gc), iters);
+
+			int buf_ids[256];
+			for (int i = 0; i < n; i++)
+				buf_ids[i] = i + 2;
+			buf_ids[n] = 0;
+			buf_ids[n + 1] = 1;
+			for (int i = 0; i < n; i++)
+				memcpy((unsigned char *) dense + i * ld,
+				       (unsigned char *) data + buf_ids[i] * ld,
+				       ld);
+			time_iters(rec_time,
+				   gib_recover(dense, ld, buf_ids, 2, gc),
+				   iters);
+			if (memcmp((unsigned char *) dense + n * ld, data,
+				   2 * ld)) {
+				printf("RAID-6 recovery check failed.\n");
+				exit(1);
+			}
+
+			double size_mb = size * n / 1024.0 / 1024.0;
+			printf("%8.3lf %8.3lf ", size_mb / chk_time,
+			       size_mb / rec_time);
+			gib_free(data, gc);
+			gib_free(dense, gc);
+			gib_destroy(gc);
+		}
+		printf("\n");
+	}
+}
+
+/* Bytes of expanded tables each CPU-side backend holds for its coding
+ * matrix, and for one cached decoding plan.
+ */
+void
+footprint_test(int n, int m)
+{
+	const char *names[] = { "cpu", "jerasure", "simd", "jcauchy" };
+
+	printf("%% Table footprint, n = %i, m = %i\n", n, m);
+	printf("%%  backend  context    plans\n");
+	for (int j = 0; j < 4; j++) {
+		unsigned long ctx_bytes, plan_bytes;
+		gib_context_t *gc;
+		void *data;
+		int rc, ld;
+
+		if (j == 0)
+			rc = gib_init_cpu(n, m, &gc);
+		else if (j == 1)
+			rc = gib_init_jerasure(n, m, &gc);
+		else if (j == 2)
+			rc = gib_init_simd(n, m, &gc);
+		else
+			rc = gib_init_jerasure_cauchy(n, m, &gc);
+		if (rc) {
+			printf("Error:  %i\n", rc);
+			exit(EXIT_FAILURE);
+		}
+		gib_alloc(&data, 64 * 1024, &ld, gc);
+		memset(data, 0, ld * (n + m));
+
+		int buf_ids[256];
+		for (int i = 0; i < n; i++)
+			buf_ids[i] = i + m;
+		for (int i = 0; i < m; i++)
+			buf_ids[n + i] = i;
+		gib_recover(data, ld, buf_ids, m, gc);
+		gib_table_footprint(gc, &ctx_bytes, &plan_bytes);
+		printf("%% %8s %8lu %8lu\n", names[j], ctx_bytes, plan_bytes);
+		gib_free(data, gc);
+		gib_destroy(gc);
+	}
+}
+
+/* The gib::codec specializations against the cpu and simd backends,
+ * recovering the first m data buffers.
+ */
+void
+fixed_test(int iters)
+{
+	static const int shapes[][2] = {
+		{ 4, 2 }, { 6, 3 }, { 8, 2 }, { 10, 4 }, { 12, 4 }
+	};
+
+	printf("%% Fixed-shape codecs vs. cpu and simd\n");
+	printf("%%      n        m datasize  cpu_chk  cpu_rec simd_chk "
+	       "simd_rec  fix_chk  fix_rec\n");
+	for (int s = 0; s < 5; s++) {
+		int n = shapes[s][0], m = shapes[s][1];
+		int size = 1024 * 1024;
+		printf("%8i %8i %8i ", n, m, size * n);
+		for (int j = 0; j < 3; j++) {
+			double chk_time, rec_time;
+			gib_context_t *gc;
+			void *data, *dense;
+			int rc, ld;
+
+			if (j == 0)
+				rc = gib_init_cpu(n, m, &gc);
+			else if (j == 1)
+				rc = gib_init_simd(n, m, &gc);
+			else
+				rc = gib::init_fixed(n, m, &gc);
+			if (rc) {
+				printf("Error:  %i\n", rc);
+				exit(EXIT_FAILURE);
+			}
+			gib_alloc(&data, size, &ld, gc);
+			gib_alloc(&dense, size, &ld, gc);
+			for (int i = 0; i < ld * n; i++)
+				((char *) data)[i] = rand() % 256;
+
+			time_iters(chk_time, gib_generate(data, ld, gc), iters);
+
+			int buf_ids[256];
+			for (int i = 0; i < n; i++)
+				buf_ids[i] = i + m;
+			for (int i = 0; i < m; i++)
+				buf_ids[n + i] = i;
+			for (int i = 0; i < n; i++)
+				memcpy((unsigned char *) dense + i * ld,
+				       (unsigned char *) data + buf_ids[i] * ld,
+				       ld);
+			time_iters(rec_time,
+				   gib_recover(dense, ld, buf_ids, m, gc),
+				   iters);
+			if (memcmp((unsigned char *) dense + n * ld, data,
+				   m * ld)) {
+				printf("Fixed-shape recovery check failed.\n");
+				exit(1);
+			}
+
+			double size_mb = size * n / 1024.0 / 1024.0;
+			printf("%8.3lf %8.3lf ", size_mb / chk_time,
+			       size_mb / rec_time);
+			gib_free(data, gc);
+			gib_free(dense, gc);
+			gib_destroy(gc);
+		}
+		printf("\n");
+	}
+}
+
+/* Kernels compiled for the matrix at run time against the table-driven
+ * cpu and simd backends.  Each context recovers once before it is
+ * timed, so that compiling the plan's kernel is not counted.
+ */
+void
+jit_test(int iters)
+{
+	if (getenv("GIB_CACHE_DIR") == NULL) {
+		printf("%% Set GIB_CACHE_DIR to compare run-time compiled "
+		       "kernels.\n");
+		return;
+	}
+	printf("%% Run-time compiled kernels vs. cpu and simd\n");
+	printf("%%      n        m datasize  cpu_chk  cpu_rec simd_chk "
+	       "simd_rec  jit_chk  jit_rec\n");
+	for (int m = 2; m <= 4; m += 2) {
+		for (int n = 4; n <= 16; n += 4) {
+			int size = 1024 * 1024;
+			printf("%8i %8i %8i ", n, m, size * n);
+			for (int j = 0; j < 3; j++) {
+				double chk_time, rec_time;
+				gib_context_t *gc;
+				void *data, *dense;
+				int rc, ld;
+
+				if (j == 0)
+					rc = gib_init_cpu(n, m, &gc);
+				else if (j == 1)
+					rc = gib_init_simd(n, m, &gc);
+				else
+					rc = gib_init_jit(n, m, &gc);
+				if (rc) {
+					printf("Error:  %i\n", rc);
+					exit(EXIT_FAILURE);
+				}
+				gib_alloc(&data, size, &ld, gc);
+				gib_alloc(&dense, size, &ld, gc);
+				for (int i = 0; i < ld * n; i++)
+					((char *) data)[i] = rand() % 256;
+
+				time_iters(chk_time, gib_generate(data, ld, gc),
+					   iters);
+
+				int buf_ids[256];
+				for (int i = 0; i < n; i++)
+					buf_ids[i] = i + m;
+				for (int i = 0; i < m; i++)
+					buf_ids[n + i] = i;
+				for (int i = 0; i < n; i++)
+					memcpy((unsigned char *) dense + i * ld,
+					       (unsigned char *) data +
+					       buf_ids[i] * ld, ld);
+				gib_recover(dense, ld, buf_ids, m, gc);
+				time_iters(rec_time,
+					   gib_recover(dense, ld, buf_ids, m,
+						       gc),
+					   iters);
+				if (memcmp((unsigned char *) dense + n * ld,
+					   data, m * ld)) {
+					printf("JIT recovery check failed.\n");
+					exit(1);
+				}
+
+				double size_mb = size * n / 1024.0 / 1024.0;
+				printf("%8.3lf %8.3lf ", size_mb / chk_time,
+				       size_mb / rec_time);
+				gib_free(data, gc);
+				gib_free(dense, gc);
+				gib_destroy(gc);
+			}
+			printf("\n");
+		}
+	}
+}
+
+/* Wide stripes over GF(2^16), recovering the first m data buffers. */
+void
+wide_test(int iters)
+{
+	static const int shapes[][2] = {
+		{ 10, 4 }, { 64, 16 }, { 200, 40 }
+	};
+
+	printf("%% GF(2^16) stripes\n");
+	printf("%%      n        m datasize chk_tput rec_tput\n");
+	for (int s = 0; s < 3; s++) {
+		int n = shapes[s][0], m = shapes[s][1];
+		int size = 64 * 1024;
+		double chk_time, rec_time;
+		gib16_context_t *gc;
+		void *data, *dense;
+		int ld;
+
+		if (gib16_init(n, m, &gc)) {
+			printf("Error initializing GF(2^16) context\n");
+			exit(EXIT_FAILURE);
+		}
+		gib16_alloc(&data, size, &ld, gc);
+		gib16_alloc(&dense, size, &ld, gc);
+		for (int i = 0; i < ld * n; i++)
+			((char *) data)[i] = rand() % 256;
+
+		time_iters(chk_time, gib16_generate(data, ld, gc), iters);
+
+		int *buf_ids = new int[n + m];
+		for (int i = 0; i < n; i++)
+			buf_ids[i] = i + m;
+		for (int i = 0; i < m; i++)
+			buf_ids[n + i] = i;
+		for (int i = 0; i < n; i++)
+			memcpy((unsigned char *) dense + i * ld,
+			       (unsigned char *) data + buf_ids[i] * ld, ld);
+		time_iters(rec_time,
+			   gib16_recover(dense, ld, buf_ids, m, gc), iters);
+		if (memcmp((unsigned char *) dense + n * ld, data, m * ld)) {
+			printf("GF(2^16) recovery check failed.\n");
+			exit(1);
+		}
+
+		double size_mb = size * n / 1024.0 / 1024.0;
+		printf("%8i %8i %8i %8.3lf %8.3lf\n", n, m, size * n,
+		       size_mb / chk_time, size_mb / rec_time);
+		delete[] buf_ids;
+		gib16_free(data, gc);
+		gib16_free(dense, gc);
+		gib16_destroy(gc);
+	}
+}
+
+/* Many stripes generated one call at a time, and then all submitted
+ * at once to the asynchronous engine and waited for.
+ */
+void
+async_test(int n, int m, int nstripes, int iters)
+{
+	gib_context_t *gc;
+	gib_request **reqs = new gib_request *[nstripes];
+	void **data = new void *[nstripes];
+	int size = 256 * 1024, ld = size;
+	double sync_time, async_time;
+
+	if (gib_init_simd(n, m, &gc)) {
+		printf("Error initializing SIMD context\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int s = 0; s < nstripes; s++) {
+		gib_alloc(&data[s], size, &ld, gc);
+		for (int i = 0; i < ld * n; i++)
+			((char *) data[s])[i] = rand() % 256;
+	}
+
+	time_iters(sync_time,
+		   for (int s = 0; s < nstripes; s++)
+			   gib_generate(data[s], ld, gc), iters);
+	time_iters(async_time, {
+			for (int s = 0; s < nstripes; s++)
+				gib_generate_async(data[s], ld, ld, gc, -1,
+						   NULL, NULL, &reqs[s]);
+			for (int s = 0; s < nstripes; s++) {
+				if (gib_wait(reqs[s]) != GIB_SUC) {
+					printf("Asynchronous generate "
+					       "failed.\n");
+					exit(1);
+				}
+				gib_request_free(reqs[s]);
+			}
+		}, iters);
+
+	double size_mb = (double) size * n * nstripes / 1024.0 / 1024.0;
+	printf("%% Asynchronous submission of %i stripes, n = %i, m = %i\n",
+	       nstripes, n, m);
+	printf("%% sync_tput async_tput\n");
+	printf("%8.3lf %8.3lf\n", size_mb / sync_time, size_mb / async_time);
+
+	struct gib_async_stats st;
+	gib_async_stats(&st);
+	printf("%% depth rings submitted sleeps wakeups full_waits\n");
+	printf("%8lu %8lu %8lu %8lu %8lu %8lu\n", st.depth, st.rings,
+	       st.submitted, st.sleeps, st.wakeups, st.full_waits);
+
+	for (int s = 0; s < nstripes; s++)
+		gib_free(data[s], gc);
+	delete[] data;
+	delete[] reqs;
+	gib_destroy(gc);
+}
+
 int
 main(int argc, char **argv)
 {
 	int iters = 5;
 	printf("%% Speed test with correctness checks\n");
 	printf("%% datasize is n*bufsize, or the total size of all data buffers\n");
-	printf("%%                          cuda     cuda     cpu      cpu      jerasure jerasure\n");
-	printf("%%      n        m datasize chk_tput rec_tput chk_tput rec_tput chk_tput rec_tput\n");
+	printf("%% simd kernel is %s\n", gib_simd_path(NULL));
+	printf("%%                          cuda     cuda     cpu      cpu      jerasure jerasure simd     simd     jcauchy  jcauchy\n");
+	printf("%%      n        m datasize chk_tput rec_tput chk_tput rec_tput chk_tput rec_tput chk_tput rec_tput chk_tput rec_tput\n");
 
 	for (int m = min_test; m <= max_test; m++) {
 		for (int n = min_test; n <= max_test; n++) {
 			printf("%8i %8i ", n, m);
-			for (int j = 0; j < 3; j++) {
+			for (int j = 0; j < 5; j++) {
 				double chk_time, dns_time;
 				gib_context_t * gc;
 
@@ -65,6 +571,10 @@ main(int argc, char **argv)
 					rc = gib_init_cpu(n, m, &gc);
 				else if (j == 2)
 					rc = gib_init_jerasure(n, m, &gc);
+				else if (j == 3)
+					rc = gib_init_simd(n, m, &gc);
+				else if (j == 4)
+					rc = gib_init_jerasure_cauchy(n, m, &gc);
 
 				if (rc) {
 					printf("Error:  %i\n", rc);
@@ -153,5 +663,14 @@ main(int argc, char **argv)
 			printf("\n");
 		}
 	}
+
+	raid6_test(iters);
+	footprint_test(10, 4);
+	fixed_test(iters);
+	jit_test(iters);
+	wide_test(iters);
+	scaling_test(8, 4, iters);
+	batch_test(10, 4, 4096, iters);
+	async_test(10, 4, 256, iters);
 	return 0;
 }
@@ -0,0 +1,575 @@
+/* gibd.c: Encoding service for the processes of one host
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+
+/* gibd listens on a Unix socket (its argument, GIB_SERVER, or
+ * gibd.sock in $XDG_RUNTIME_DIR or /tmp/gibd-<uid>) and codes the
+ * stripes its clients place in shared memory, in place, with the
+ * library's asynchronous engine as the one pool of workers for the
+ * whole host.  GIBD_BACKEND picks the backend of its contexts: "simd"
+ * (the default), "jit" or "cpu".
+ *
+ * One thread takes requests off the clients' rings and hands them to
+ * the engine, and sleeps in epoll when the rings are all empty.  New
+ * connections wait in the same epoll for their hello.  Each request is
+ * copied out of the segment and checked before it is used, so that a
+ * client can only ever have its own memory written, and the rings are
+ * taken from in turns and in bounded steps, so that no client can hold
+ * up the others.  When a client goes away, its segment is kept until
+ * its last request is done.
+ */
+
+#define _GNU_SOURCE
+#include <gibraltar.h>
+#include <gib_shm.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+
+#define GIBD_EVENTS 64
+/* How often, in ms, to look at clients that left work behind */
+#define GIBD_REAP_MS 10
+/* Most requests taken from one client before serving the next */
+#define GIBD_BATCH 32
+/* How long, in ms, a new connection has to say hello */
+#define GIBD_HELLO_MS 1000
+
+struct gibd_client {
+	int sock;
+	int bell;
+	struct gib_shm_header *shm;
+	unsigned long size;
+	int inflight; /* Requests with the engine */
+	int dead;
+	long hello; /* While waiting for the hello, when it is due */
+	struct gibd_client *next;
+};
+
+struct gibd_job {
+	struct gibd_client *cl;
+	struct gib_shm_req *req;
+};
+
+struct gibd_context {
+	int n;
+	int m;
+	struct gib_context_t *c;
+	struct gibd_context *next;
+};
+
+static struct gibd_client *clients;
+static struct gibd_client *pending; /* Yet to say hello */
+static struct gibd_context *contexts;
+static int ndead;
+static int (*gibd_init)(int n, int m, struct gib_context_t **c) =
+	gib_init_simd;
+
+static long
+gibd_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Contexts are shared by all clients and kept for good */
+static struct gib_context_t *
+gibd_context(int n, int m)
+{
+	struct gibd_context *ctx;
+
+	for (ctx = contexts; ctx != NULL; ctx = ctx->next)
+		if (ctx->n == n && ctx->m == m)
+			return ctx->c;
+	ctx = malloc(sizeof(struct gibd_context));
+	if (ctx == NULL)
+		return NULL;
+	if (gibd_init(n, m, &ctx->c) != GIB_SUC) {
+		free(ctx);
+		return NULL;
+	}
+	ctx->n = n;
+	ctx->m = m;
+	ctx->next = contexts;
+	contexts = ctx;
+	return ctx->c;
+}
+
+static void
+gibd_finish(struct gib_shm_req *req, int rc)
+{
+	req->rc = rc;
+	__atomic_store_n(&req->state, GIB_SHM_DONE, __ATOMIC_RELEASE);
+	gib_event_notify(&req->done, 1);
+}
+
+static void
+gibd_done(struct gib_request *r, int rc, void *arg)
+{
+	struct gibd_job *job = arg;
+
+	gibd_finish(job->req, rc);
+	__sync_fetch_and_sub(&job->cl->inflight, 1);
+	free(job);
+}
+
+static int
+gibd_check(struct gibd_client *cl, struct gib_shm_req *r)
+{
+	unsigned long end;
+	int i;
+
+	if (r->n <= 0 || r->m <= 0 || r->n + r->m > 256 ||
+	    r->buf_size <= 0 || r->work_size <= 0 ||
+	    r->work_size > r->buf_size || r->buffers < GIB_SHM_DATA ||
+	    r->recover_last > r->m || r->cls < 0)
+		return GIB_ERR;
+	end = r->buffers + (unsigned long)r->buf_size * (r->n + r->m);
+	if (end > cl->size || end < r->buffers)
+		return GIB_ERR;
+	for (i = 0; r->recover_last >= 0 && i < r->n + r->recover_last; i++)
+		if (r->buf_ids[i] < 0 || r->buf_ids[i] >= r->n + r->m)
+			return GIB_ERR;
+	return GIB_SUC;
+}
+
+static void
+gibd_submit(struct gibd_client *cl, long ticket)
+{
+	struct gib_shm_req *req, r;
+	struct gib_context_t *c;
+	struct gibd_job *job;
+	char *buffers;
+	int rc = GIB_ERR;
+
+	if (ticket < 0 || ticket >= GIB_SHM_DEPTH)
+		return;
+	req = &cl->shm->reqs[ticket];
+	memcpy(&r, req, sizeof(r));
+	if (gibd_check(cl, &r) != GIB_SUC)
+		goto fail;
+	c = gibd_context(r.n, r.m);
+	job = malloc(sizeof(struct gibd_job));
+	if (c == NULL || job == NULL) {
+		free(job);
+		rc = GIB_OOM;
+		goto fail;
+	}
+	job->cl = cl;
+	job->req = req;
+	buffers = (char *)cl->shm + r.buffers;
+
+	__sync_fetch_and_add(&cl->inflight, 1);
+	if (r.recover_last < 0)
+		rc = gib_generate_async(buffers, r.buf_size, r.work_size, c,
+					r.cls, gibd_done, job, NULL);
+	else
+		rc = gib_recover_async(buffers, r.buf_size, r.work_size,
+				       r.buf_ids, r.recover_last, c, r.cls,
+				       gibd_done, job, NULL);
+	if (rc == GIB_SUC)
+		return;
+	__sync_fetch_and_sub(&cl->inflight, 1);
+	free(job);
+fail:
+	gibd_finish(req, rc);
+}
+
+static void
+gibd_hangup(struct gibd_client *cl, int ep)
+{
+	epoll_ctl(ep, EPOLL_CTL_DEL, cl->sock, NULL);
+	epoll_ctl(ep, EPOLL_CTL_DEL, cl->bell, NULL);
+	cl->dead = 1;
+	ndead++;
+}
+
+/* Takes up to GIBD_BATCH requests, so that a client that keeps its ring
+ * full still leaves the others their turn.  The ring is in the client's
+ * memory, and one that cannot be popped has been damaged by it, so the
+ * client is hung up on.
+ */
+static int
+gibd_drain(struct gibd_client *cl, int ep)
+{
+	struct gib_shm_header *shm = cl->shm;
+	int rc, count = 0;
+	void *ptr;
+	long ticket;
+
+	while (count < GIBD_BATCH) {
+		rc = gib_mpmc_pop_in(&shm->sq, shm->sq_slots, GIB_SHM_DEPTH,
+				     &ptr, &ticket);
+		if (rc == GIB_BUSY)
+			break;
+		if (rc != GIB_SUC) {
+			gibd_hangup(cl, ep);
+			break;
+		}
+		gibd_submit(cl, ticket);
+		count++;
+	}
+	return count;
+}
+
+static void
+gibd_reap(void)
+{
+	struct gibd_client **p = &clients, *cl;
+
+	while ((cl = *p) != NULL) {
+		if (!cl->dead ||
+		    __atomic_load_n(&cl->inflight, __ATOMIC_ACQUIRE) != 0) {
+			p = &cl->next;
+			continue;
+		}
+		*p = cl->next;
+		munmap(cl->shm, cl->size);
+		close(cl->sock);
+		close(cl->bell);
+		free(cl);
+		ndead--;
+	}
+}
+
+/* Receives a struct gib_shm_hello with the segment and doorbell, or
+ * returns GIB_BUSY if it has not arrived yet
+ */
+static int
+gibd_hello(int sock, struct gib_shm_hello *hello, int *fds)
+{
+	union {
+		struct cmsghdr h;
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+	} ctl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t len;
+
+	iov.iov_base = hello;
+	iov.iov_len = sizeof(*hello);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+	len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return GIB_BUSY;
+	if (len < 0)
+		return GIB_ERR;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+	    cmsg->cmsg_type != SCM_RIGHTS)
+		return GIB_ERR;
+	if (cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+		/* Close whatever was sent */
+		int i, n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < n; i++)
+			close(((int *)CMSG_DATA(cmsg))[i]);
+		return GIB_ERR;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+	if (len != sizeof(*hello) || (msg.msg_flags & MSG_CTRUNC) ||
+	    hello->magic != GIB_SHM_MAGIC ||
+	    hello->version != GIB_SHM_VERSION)
+		return GIB_ERR;
+	return GIB_SUC;
+}
+
+/* A new connection is nonblocking and waits in epoll for its hello
+ * like any other event, so one that is slow to say it, or never does,
+ * holds up no one; gibd_expire drops it after GIBD_HELLO_MS.
+ */
+static void
+gibd_accept(int lsock, int ep)
+{
+	struct gibd_client *cl;
+	struct epoll_event ev;
+	int sock;
+
+	sock = accept4(lsock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (sock < 0)
+		return;
+	cl = calloc(1, sizeof(struct gibd_client));
+	if (cl == NULL) {
+		close(sock);
+		return;
+	}
+	cl->sock = sock;
+	cl->bell = -1;
+	cl->hello = gibd_now() + GIBD_HELLO_MS;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = cl;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev)) {
+		free(cl);
+		close(sock);
+		return;
+	}
+	cl->next = pending;
+	pending = cl;
+}
+
+static void
+gibd_unpend(struct gibd_client *cl)
+{
+	struct gibd_client **p;
+
+	for (p = &pending; *p != cl; p = &(*p)->next)
+		;
+	*p = cl->next;
+}
+
+/* Completes the handshake of a pending client, making it a client
+ * proper or dropping it
+ */
+static void
+gibd_greet(struct gibd_client *cl, int ep)
+{
+	struct gib_shm_hello hello;
+	struct epoll_event ev;
+	struct stat st;
+	int seals, fds[2] = { -1, -1 }, rc;
+	void *shm = MAP_FAILED;
+
+	rc = gibd_hello(cl->sock, &hello, fds);
+	if (rc == GIB_BUSY)
+		return;
+	if (rc != GIB_SUC)
+		goto out;
+	rc = GIB_ERR;
+
+	/* The segment must not be able to shrink under the workers */
+	seals = fcntl(fds[0], F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fds[0], &st) ||
+	    (unsigned long)st.st_size < hello.size ||
+	    hello.size <= GIB_SHM_DATA)
+		goto out;
+	shm = mmap(NULL, hello.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   fds[0], 0);
+	if (shm == MAP_FAILED) {
+		rc = GIB_OOM;
+		goto out;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = cl;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, fds[1], &ev))
+		goto out;
+	cl->bell = fds[1];
+	cl->shm = shm;
+	cl->size = hello.size;
+	cl->hello = 0;
+	rc = GIB_SUC;
+
+out:
+	send(cl->sock, &rc, sizeof(rc), MSG_NOSIGNAL);
+	if (fds[0] >= 0)
+		close(fds[0]);
+	gibd_unpend(cl);
+	if (rc == GIB_SUC) {
+		cl->next = clients;
+		clients = cl;
+		return;
+	}
+	if (shm != MAP_FAILED)
+		munmap(shm, hello.size);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	epoll_ctl(ep, EPOLL_CTL_DEL, cl->sock, NULL);
+	close(cl->sock);
+	free(cl);
+}
+
+/* Drops the connections that have not said hello in time, and returns
+ * how long until the next one is due, or -1 if none are waiting
+ */
+static int
+gibd_expire(int ep)
+{
+	struct gibd_client **p = &pending, *cl;
+	long now = gibd_now(), next = -1;
+
+	while ((cl = *p) != NULL) {
+		if (cl->hello > now) {
+			if (next < 0 || cl->hello - now < next)
+				next = cl->hello - now;
+			p = &cl->next;
+			continue;
+		}
+		*p = cl->next;
+		epoll_ctl(ep, EPOLL_CTL_DEL, cl->sock, NULL);
+		close(cl->sock);
+		free(cl);
+	}
+	return next;
+}
+
+/* The doorbell rang, or the client went away */
+static void
+gibd_event(struct gibd_client *cl, int ep)
+{
+	uint64_t count;
+	ssize_t ret;
+	char c;
+
+	if (cl->hello) {
+		gibd_greet(cl, ep);
+		return;
+	}
+	if (cl->dead)
+		return;
+	ret = read(cl->bell, &count, sizeof(count));
+	(void)ret;
+	ret = recv(cl->sock, &c, 1, MSG_DONTWAIT);
+	if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+		gibd_hangup(cl, ep);
+}
+
+/* The default socket's directory is made if need be, and must be the
+ * user's alone, so that no one else can take the socket's place.
+ */
+static int
+gibd_default(char *path, unsigned long len)
+{
+	char dir[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	struct stat st;
+
+	if (gib_shm_socket(path, dir, len) != GIB_SUC) {
+		fprintf(stderr, "gibd: socket path too long\n");
+		return -1;
+	}
+	if (mkdir(dir, 0700) && errno != EEXIST) {
+		perror("gibd: mkdir");
+		return -1;
+	}
+	if (lstat(dir, &st) || !S_ISDIR(st.st_mode) ||
+	    st.st_uid != geteuid() || (st.st_mode & 077)) {
+		fprintf(stderr, "gibd: %s is not private to this user\n",
+			dir);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+gibd_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "gibd: socket path too long\n");
+		return -1;
+	}
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		perror("gibd: socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sock, 16)) {
+		perror("gibd: bind");
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct epoll_event ev, events[GIBD_EVENTS];
+	const char *path = getenv("GIB_SERVER");
+	const char *backend = getenv("GIBD_BACKEND");
+	char def[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	struct gibd_client *cl;
+	int lsock, ep, i, n, busy, timeout;
+
+	if (argc > 1)
+		path = argv[1];
+	if (path == NULL) {
+		if (gibd_default(def, sizeof(def)))
+			return EXIT_FAILURE;
+		path = def;
+	}
+	if (backend != NULL && strcmp(backend, "jit") == 0)
+		gibd_init = gib_init_jit;
+	else if (backend != NULL && strcmp(backend, "cpu") == 0)
+		gibd_init = gib_init_cpu;
+	else if (backend != NULL && strcmp(backend, "simd") != 0) {
+		fprintf(stderr, "gibd: unknown backend %s\n", backend);
+		return EXIT_FAILURE;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	lsock = gibd_listen(path);
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	if (lsock < 0 || ep < 0)
+		return EXIT_FAILURE;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(ep, EPOLL_CTL_ADD, lsock, &ev);
+
+	for (;;) {
+		busy = 0;
+		for (cl = clients; cl != NULL; cl = cl->next)
+			if (!cl->dead)
+				busy += gibd_drain(cl, ep);
+		if (ndead > 0)
+			gibd_reap();
+		if (busy)
+			continue;
+
+		/* Arm every doorbell, then look once more before sleeping */
+		for (cl = clients; cl != NULL; cl = cl->next)
+			if (!cl->dead)
+				__atomic_store_n(&cl->shm->armed, 1,
+						 __ATOMIC_SEQ_CST);
+		for (cl = clients; cl != NULL && !busy; cl = cl->next)
+			if (!cl->dead && gib_mpmc_count(&cl->shm->sq) != 0)
+				busy = 1;
+		if (busy)
+			continue;
+
+		timeout = gibd_expire(ep);
+		if (ndead > 0 && (timeout < 0 || timeout > GIBD_REAP_MS))
+			timeout = GIBD_REAP_MS;
+		n = epoll_wait(ep, events, GIBD_EVENTS, timeout);
+		for (i = 0; i < n; i++) {
+			if (events[i].data.ptr == NULL)
+				gibd_accept(lsock, ep);
+			else
+				gibd_event(events[i].data.ptr, ep);
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -8,6 +8,14 @@
  * Changes:
  * Initial version, Matthew L. Curry
  * Dec 16, 2014, Rodrigo Sardinas; revised to use new dynamic api.
+ * Checks the scatter/gather calls against gib_generate at odd sizes.
+ * Checks the noncontiguous calls, which must not write past work_size.
+ * Checks parity updates against parity generated for the new data.
+ * Checks batches of stripes of every odd size at once.
+ * Checks in-place sparse recovery, which must write only the lost buffers.
+ * Checks GF(2^16) coding at wide shapes and sizes of an odd symbol count.
+ * Checks asynchronous coding, cancellation and reaping of completions.
+ * Checks coding through gibd, when it is running.
  */
 
 /* This is a rather ridiculous example of a sweeping test.  At the parameters
@@ -21,6 +29,10 @@
  * memory contents.  At the end of the recovery process, it is directly
  * compared to the original data buffers.  When timed, this demonstrates that
  * the memory movement is not a performance bottleneck when done properly.
+ *
+ * After each sweep, the other ways of coding a stripe are checked against
+ * gib_generate at sizes that are not multiples of anything the backends
+ * work in, and every output is checked for writes past its end.
  */
 #include <gibraltar.h>
 #include "../inc/gib_context.h"
@@ -29,6 +41,9 @@
 #include <sys/time.h>
 #include <cstring>
 #include <cstdio>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
 using namespace std;
 
 int max_dim = 8;  /* How big can n and m be? */
@@ -113,6 +128,656 @@ test_config(gib_context gc, int *fail_config, int *buf,
 	return 0;
 }
 
+/* Sizes that are not multiples of sizeof(long), nor of the 64 bytes the
+ * vector kernels take at a time.
+ */
+const int odd_sizes[] = { 1, 7, 50, 500, 2049, 65543 };
+const int nodd = sizeof(odd_sizes) / sizeof(odd_sizes[0]);
+const int ref_size = 64*1024 + 64; /* Above every odd size */
+const int guard = 64;
+const unsigned char guard_byte = 0xa5;
+
+/* A stripe of random data with parity generated at ref_size.  Each byte
+ * of parity depends only on the same byte of the data, so prefixes of
+ * it are what every other call must produce for smaller sizes.
+ */
+unsigned char *
+make_ref(gib_context gc)
+{
+	unsigned char *ref =
+		(unsigned char *)malloc((gc->n + gc->m) * ref_size);
+	for (int i = 0; i < gc->n * ref_size; i++)
+		ref[i] = rand();
+	gib_generate(ref, ref_size, gc);
+	return ref;
+}
+
+/* len bytes with guard bytes after them */
+unsigned char *
+guarded(int len)
+{
+	unsigned char *p = (unsigned char *)malloc(len + guard);
+	memset(p, guard_byte, len + guard);
+	return p;
+}
+
+/* got must match want over [0, len), and be untouched over [len, end). */
+void
+check(const char *what, int len, const unsigned char *got,
+      const unsigned char *want, int end)
+{
+	if (memcmp(got, want, len)) {
+		printf("%s failed at size %i.\n", what, len);
+		exit(1);
+	}
+	for (int b = len; b < end; b++) {
+		if (got[b] != guard_byte) {
+			printf("%s wrote past size %i.\n", what, len);
+			exit(1);
+		}
+	}
+}
+
+/* Loses m buffers, cyclically from len % (n+m), so that different sizes
+ * lose different mixes of data and parity.  buf_ids lists the survivors
+ * in order and then the lost buffers, and failed flags the lost ones.
+ */
+void
+lose(int n, int m, int len, int *buf_ids, char *failed)
+{
+	int nbufs = n + m;
+	int first = len % nbufs;
+	int nsurv = 0, nlost = 0;
+
+	for (int i = 0; i < nbufs; i++)
+		failed[i] = (i - first + nbufs) % nbufs < m;
+	for (int i = 0; i < nbufs; i++) {
+		if (failed[i])
+			buf_ids[n + nlost++] = i;
+		else
+			buf_ids[nsurv++] = i;
+	}
+}
+
+void
+test_iov(gib_context gc, const unsigned char *ref)
+{
+	unsigned char *in[256], *out[256];
+	int buf_ids[256];
+	char failed[256];
+
+	for (int s = 0; s < nodd; s++) {
+		int len = odd_sizes[s];
+
+		for (int i = 0; i < gc->n; i++)
+			in[i] = (unsigned char *)ref + i * ref_size;
+		for (int j = 0; j < gc->m; j++)
+			out[j] = guarded(len);
+		if (gib_generate_iov(in, out, len, gc)) {
+			printf("gib_generate_iov failed at size %i.\n", len);
+			exit(1);
+		}
+		for (int j = 0; j < gc->m; j++) {
+			check("gib_generate_iov", len, out[j],
+			      ref + (gc->n + j) * ref_size, len + guard);
+			free(out[j]);
+		}
+
+		lose(gc->n, gc->m, len, buf_ids, failed);
+		for (int i = 0; i < gc->n; i++)
+			in[i] = (unsigned char *)ref + buf_ids[i] * ref_size;
+		for (int j = 0; j < gc->m; j++)
+			out[j] = guarded(len);
+		if (gib_recover_iov(in, buf_ids, out, gc->m, len, gc)) {
+			printf("gib_recover_iov failed at size %i.\n", len);
+			exit(1);
+		}
+		for (int j = 0; j < gc->m; j++) {
+			check("gib_recover_iov", len, out[j],
+			      ref + buf_ids[gc->n + j] * ref_size,
+			      len + guard);
+			free(out[j]);
+		}
+	}
+}
+
+/* Codes the first len bytes of a stripe at stride ref_size, whose
+ * outputs start out as guard bytes, which must survive past len.
+ */
+void
+test_nc(gib_context gc, const unsigned char *ref)
+{
+	int nbufs = gc->n + gc->m;
+	unsigned char *buf = (unsigned char *)malloc(nbufs * ref_size);
+	int buf_ids[256];
+	char failed[256];
+
+	for (int s = 0; s < nodd; s++) {
+		int len = odd_sizes[s];
+
+		memcpy(buf, ref, gc->n * ref_size);
+		memset(buf + gc->n * ref_size, guard_byte, gc->m * ref_size);
+		if (gib_generate_nc(buf, ref_size, len, gc)) {
+			printf("gib_generate_nc failed at size %i.\n", len);
+			exit(1);
+		}
+		for (int j = gc->n; j < nbufs; j++)
+			check("gib_generate_nc", len, buf + j * ref_size,
+			      ref + j * ref_size, ref_size);
+
+		lose(gc->n, gc->m, len, buf_ids, failed);
+		for (int i = 0; i < gc->n; i++)
+			memcpy(buf + i * ref_size, ref + buf_ids[i] * ref_size,
+			       ref_size);
+		memset(buf + gc->n * ref_size, guard_byte, gc->m * ref_size);
+		if (gib_recover_nc(buf, ref_size, len, buf_ids, gc->m, gc)) {
+			printf("gib_recover_nc failed at size %i.\n", len);
+			exit(1);
+		}
+		for (int j = 0; j < gc->m; j++)
+			check("gib_recover_nc", len,
+			      buf + (gc->n + j) * ref_size,
+			      ref + buf_ids[gc->n + j] * ref_size, ref_size);
+	}
+	free(buf);
+}
+
+/* Rewrites the first len bytes of two data buffers (one, if n is 1)
+ * and updates copies of the parity, which must then match the parity of
+ * the new data.
+ */
+void
+test_update(gib_context gc, const unsigned char *ref)
+{
+	int nbufs = gc->n + gc->m;
+	unsigned char *buf = (unsigned char *)malloc(nbufs * ref_size);
+	unsigned char *old_data[2], *new_data[2], *parity[256];
+	int data_ids[2];
+	int ncols = (gc->n > 1) ? 2 : 1;
+
+	for (int s = 0; s < nodd; s++) {
+		int len = odd_sizes[s];
+
+		memcpy(buf, ref, gc->n * ref_size);
+		for (int i = 0; i < ncols; i++) {
+			data_ids[i] = (len + i) % gc->n;
+			old_data[i] = (unsigned char *)ref +
+				data_ids[i] * ref_size;
+			new_data[i] = buf + data_ids[i] * ref_size;
+			for (int b = 0; b < len; b++)
+				new_data[i][b] = rand();
+		}
+		for (int j = 0; j < gc->m; j++) {
+			parity[j] = guarded(len);
+			memcpy(parity[j], ref + (gc->n + j) * ref_size, len);
+		}
+		if (gib_update_cols(ncols, data_ids, old_data, new_data,
+				    parity, len, gc)) {
+			printf("gib_update_cols failed at size %i.\n", len);
+			exit(1);
+		}
+		gib_generate(buf, ref_size, gc);
+		for (int j = 0; j < gc->m; j++) {
+			check("gib_update_cols", len, parity[j],
+			      buf + (gc->n + j) * ref_size, len + guard);
+			free(parity[j]);
+		}
+	}
+	free(buf);
+}
+
+/* One stripe of each odd size, packed at stride len as gib_alloc would
+ * lay it out, with guard bytes after it.
+ */
+void
+test_batch(gib_context gc, const unsigned char *ref)
+{
+	int nbufs = gc->n + gc->m;
+	void *stripes[nodd];
+	int sizes[nodd];
+	int ids[nodd][256];
+	int *buf_ids[nodd];
+	int recover_last[nodd];
+	char failed[256];
+
+	for (int s = 0; s < nodd; s++) {
+		int len = sizes[s] = odd_sizes[s];
+		unsigned char *p = guarded(nbufs * len);
+
+		for (int i = 0; i < gc->n; i++)
+			memcpy(p + i * len, ref + i * ref_size, len);
+		stripes[s] = p;
+	}
+	if (gib_generate_batch(stripes, sizes, nodd, gc)) {
+		printf("gib_generate_batch failed.\n");
+		exit(1);
+	}
+	for (int s = 0; s < nodd; s++) {
+		int len = sizes[s];
+		unsigned char *p = (unsigned char *)stripes[s];
+
+		for (int j = gc->n; j < nbufs; j++)
+			check("gib_generate_batch", len, p + j * len,
+			      ref + j * ref_size, (j == nbufs - 1) ?
+			      len + guard : len);
+	}
+
+	for (int s = 0; s < nodd; s++) {
+		int len = sizes[s];
+		unsigned char *p = (unsigned char *)stripes[s];
+
+		lose(gc->n, gc->m, len, ids[s], failed);
+		buf_ids[s] = ids[s];
+		recover_last[s] = gc->m;
+		for (int i = 0; i < gc->n; i++)
+			memcpy(p + i * len, ref + ids[s][i] * ref_size, len);
+		memset(p + gc->n * len, guard_byte, gc->m * len);
+	}
+	if (gib_recover_batch(stripes, sizes, buf_ids, recover_last, nodd,
+			      gc)) {
+		printf("gib_recover_batch failed.\n");
+		exit(1);
+	}
+	for (int s = 0; s < nodd; s++) {
+		int len = sizes[s];
+		unsigned char *p = (unsigned char *)stripes[s];
+
+		for (int j = 0; j < gc->m; j++)
+			check("gib_recover_batch", len, p + (gc->n + j) * len,
+			      ref + ids[s][gc->n + j] * ref_size,
+			      (j == gc->m - 1) ? len + guard : len);
+		free(p);
+	}
+}
+
+/* The lost buffers start out as guard bytes in place, and only their
+ * first len bytes may be written.
+ */
+void
+test_sparse(gib_context gc, const unsigned char *ref)
+{
+	int nbufs = gc->n + gc->m;
+	unsigned char *buf = (unsigned char *)malloc(nbufs * ref_size);
+	int buf_ids[256];
+	char failed[256];
+
+	for (int s = 0; s < nodd; s++) {
+		int len = odd_sizes[s];
+
+		lose(gc->n, gc->m, len, buf_ids, failed);
+		memcpy(buf, ref, nbufs * ref_size);
+		for (int i = 0; i < nbufs; i++)
+			if (failed[i])
+				memset(buf + i * ref_size, guard_byte,
+				       ref_size);
+		if (gib_recover_sparse_nc(buf, ref_size, len, failed, gc)) {
+			printf("gib_recover_sparse_nc failed at size %i.\n",
+			       len);
+			exit(1);
+		}
+		for (int i = 0; i < nbufs; i++)
+			check("gib_recover_sparse_nc", failed[i] ? len :
+			      ref_size, buf + i * ref_size, ref + i * ref_size,
+			      ref_size);
+	}
+	free(buf);
+}
+
+/* Called before waiters are woken, so gib_wait must find it done */
+void
+async_done(struct gib_request *req, int rc, void *arg)
+{
+	*(int *)arg = rc;
+}
+
+/* Takes count completions from gib_async_reap, sleeping on the eventfd
+ * between batches.  Each arg points at the result its request was
+ * waited for with, which it must match.
+ */
+void
+reap(int fd, int count)
+{
+	struct gib_completion done[16];
+	int got, seen = 0;
+
+	while (seen < count) {
+		while ((got = gib_async_reap(done, 16)) > 0) {
+			for (int k = 0; k < got; k++) {
+				if (done[k].rc != *(int *)done[k].arg) {
+					printf("gib_async_reap returned %i "
+					       "for a request that ended "
+					       "with %i.\n", done[k].rc,
+					       *(int *)done[k].arg);
+					exit(1);
+				}
+			}
+			seen += got;
+			if (got < 16)
+				break;
+		}
+		if (seen >= count)
+			break;
+		if (fd < 0) {
+			sched_yield();
+			continue;
+		}
+		struct pollfd p = { fd, POLLIN, 0 };
+		unsigned long long v;
+		if (poll(&p, 1, 10000) != 1) {
+			printf("gib_async_fd was never signaled.\n");
+			exit(1);
+		}
+		if (read(fd, &v, sizeof(v)) < 0)
+			continue;
+	}
+	if (seen > count) {
+		printf("gib_async_reap returned too many completions.\n");
+		exit(1);
+	}
+}
+
+/* Submits one stripe of each odd size at once, in every class, to be
+ * generated and then recovered as test_nc does, and then a queue of
+ * whole stripes to cancel from the back.  A cancelled request must end
+ * with GIB_CANCELED, and one that was too late to cancel must be coded.
+ * Every completion must also come out of gib_async_reap.
+ */
+void
+test_async(gib_context gc, const unsigned char *ref)
+{
+	const int ncancel = 32;
+	int nbufs = gc->n + gc->m;
+	unsigned char *bufs[ncancel];
+	struct gib_request *reqs[ncancel];
+	int results[ncancel];
+	int ids[nodd][256];
+	char failed[256];
+	int fd = gib_async_fd();
+
+	for (int s = 0; s < nodd; s++) {
+		bufs[s] = (unsigned char *)malloc(nbufs * ref_size);
+		memcpy(bufs[s], ref, gc->n * ref_size);
+		memset(bufs[s] + gc->n * ref_size, guard_byte,
+		       gc->m * ref_size);
+		results[s] = GIB_BUSY;
+		if (gib_generate_async(bufs[s], ref_size, odd_sizes[s], gc,
+				       s % 4, async_done, &results[s],
+				       &reqs[s])) {
+			printf("gib_generate_async failed.\n");
+			exit(1);
+		}
+	}
+	for (int s = 0; s < nodd; s++) {
+		int len = odd_sizes[s];
+
+		if (gib_wait(reqs[s]) != GIB_SUC || results[s] != GIB_SUC) {
+			printf("gib_generate_async failed at size %i.\n",
+			       len);
+			exit(1);
+		}
+		gib_request_free(reqs[s]);
+		for (int j = gc->n; j < nbufs; j++)
+			check("gib_generate_async", len,
+			      bufs[s] + j * ref_size, ref + j * ref_size,
+			      ref_size);
+	}
+	reap(fd, nodd);
+
+	for (int s = 0; s < nodd; s++) {
+		int len = odd_sizes[s];
+
+		lose(gc->n, gc->m, len, ids[s], failed);
+		for (int i = 0; i < gc->n; i++)
+			memcpy(bufs[s] + i * ref_size,
+			       ref + ids[s][i] * ref_size, ref_size);
+		memset(bufs[s] + gc->n * ref_size, guard_byte,
+		       gc->m * ref_size);
+		results[s] = GIB_BUSY;
+		if (gib_recover_async(bufs[s], ref_size, len, ids[s], gc->m,
+				      gc, s % 4, async_done, &results[s],
+				      &reqs[s])) {
+			printf("gib_recover_async failed.\n");
+			exit(1);
+		}
+	}
+	for (int s = 0; s < nodd; s++) {
+		int len = odd_sizes[s];
+
+		if (gib_wait(reqs[s]) != GIB_SUC || results[s] != GIB_SUC) {
+			printf("gib_recover_async failed at size %i.\n",
+			       len);
+			exit(1);
+		}
+		gib_request_free(reqs[s]);
+		for (int j = 0; j < gc->m; j++)
+			check("gib_recover_async", len,
+			      bufs[s] + (gc->n + j) * ref_size,
+			      ref + ids[s][gc->n + j] * ref_size, ref_size);
+		free(bufs[s]);
+	}
+	reap(fd, nodd);
+
+	for (int k = 0; k < ncancel; k++) {
+		bufs[k] = (unsigned char *)malloc(nbufs * ref_size);
+		memcpy(bufs[k], ref, gc->n * ref_size);
+		memset(bufs[k] + gc->n * ref_size, guard_byte,
+		       gc->m * ref_size);
+		results[k] = GIB_BUSY;
+		if (gib_generate_async(bufs[k], ref_size, ref_size, gc,
+				       GIB_CLASS_BACKGROUND, async_done,
+				       &results[k], &reqs[k])) {
+			printf("gib_generate_async failed.\n");
+			exit(1);
+		}
+	}
+	for (int k = ncancel - 1; k >= 0; k--) {
+		int canceled = gib_cancel(reqs[k]) == GIB_SUC;
+		int rc = gib_wait(reqs[k]);
+
+		if (rc != (canceled ? GIB_CANCELED : GIB_SUC) ||
+		    results[k] != rc) {
+			printf("gib_cancel: request ended with %i.\n", rc);
+			exit(1);
+		}
+		gib_request_free(reqs[k]);
+	}
+	for (int k = 0; k < ncancel; k++) {
+		if (results[k] == GIB_SUC)
+			for (int j = gc->n; j < nbufs; j++)
+				check("gib_generate_async", ref_size,
+				      bufs[k] + j * ref_size,
+				      ref + j * ref_size, ref_size);
+	}
+	reap(fd, ncancel);
+	for (int k = 0; k < ncancel; k++)
+		free(bufs[k]);
+}
+
+void
+test_variants(gib_context gc)
+{
+	unsigned char *ref = make_ref(gc);
+
+	test_iov(gc, ref);
+	test_nc(gc, ref);
+	test_update(gc, ref);
+	test_batch(gc, ref);
+	test_sparse(gc, ref);
+	test_async(gc, ref);
+	free(ref);
+}
+
+/* Even sizes that are odd multiples of the 2-byte symbol */
+const int odd_sizes16[] = { 2, 14, 50, 502, 2050, 65542 };
+
+/* GF(2^16) stripes, at shapes too wide for GF(2^8) as well as a narrow
+ * one.  Parity generated at ref_size is the reference for
+ * gib16_generate_nc, whose outputs start out as guard bytes, and
+ * recovery of lost data and parity must give back the original.
+ */
+void
+test_gib16(void)
+{
+	static const int shapes[][2] = { { 4, 2 }, { 300, 4 }, { 200, 40 } };
+
+	for (int k = 0; k < 3; k++) {
+		int n = shapes[k][0], m = shapes[k][1], nbufs = n + m;
+		struct gib16_context_t *c;
+		unsigned char *ref, *buf;
+		int *buf_ids = (int *)malloc(nbufs * sizeof(int));
+		char *failed = (char *)malloc(nbufs);
+
+		printf("GF(2^16) n = %i, m = %i\n", n, m);
+		if (gib16_init(n, m, &c)) {
+			printf("gib16_init failed.\n");
+			exit(1);
+		}
+		ref = (unsigned char *)malloc((size_t)nbufs * ref_size);
+		buf = (unsigned char *)malloc((size_t)nbufs * ref_size);
+		for (int i = 0; i < n * ref_size; i++)
+			ref[i] = rand();
+		if (gib16_generate(ref, ref_size, c)) {
+			printf("gib16_generate failed.\n");
+			exit(1);
+		}
+
+		for (int s = 0; s < nodd; s++) {
+			int len = odd_sizes16[s];
+
+			memcpy(buf, ref, (size_t)n * ref_size);
+			memset(buf + (size_t)n * ref_size, guard_byte,
+			       (size_t)m * ref_size);
+			if (gib16_generate_nc(buf, ref_size, len, c)) {
+				printf("gib16_generate_nc failed at size "
+				       "%i.\n", len);
+				exit(1);
+			}
+			for (int j = n; j < nbufs; j++)
+				check("gib16_generate_nc", len,
+				      buf + (size_t)j * ref_size,
+				      ref + (size_t)j * ref_size, ref_size);
+
+			lose(n, m, len / 2, buf_ids, failed);
+			for (int i = 0; i < n; i++)
+				memcpy(buf + (size_t)i * ref_size,
+				       ref + (size_t)buf_ids[i] * ref_size,
+				       ref_size);
+			memset(buf + (size_t)n * ref_size, guard_byte,
+			       (size_t)m * ref_size);
+			if (gib16_recover_nc(buf, ref_size, len, buf_ids, m,
+					     c)) {
+				printf("gib16_recover_nc failed at size "
+				       "%i.\n", len);
+				exit(1);
+			}
+			for (int j = 0; j < m; j++)
+				check("gib16_recover_nc", len,
+				      buf + (size_t)(n + j) * ref_size,
+				      ref + (size_t)buf_ids[n + j] * ref_size,
+				      ref_size);
+		}
+		free(ref);
+		free(buf);
+		free(buf_ids);
+		free(failed);
+		gib16_destroy(c);
+	}
+}
+
+/* Codes through gibd, if one is listening at GIB_SERVER or the default
+ * socket, and compares against the CPU backend, whose parity is that
+ * of every backend gibd runs.  Each size is generated and recovered in
+ * its own stripe, all submitted before any is waited for, and the
+ * daemon must leave guard bytes past work_size alone.
+ */
+void
+test_client(void)
+{
+	static const int shapes[][2] = { { 2, 2 }, { 4, 2 }, { 8, 4 } };
+	struct gib_client *cl;
+
+	if (gib_client_connect(NULL, 0, &cl) != GIB_SUC) {
+		printf("No gibd is running; skipping the client test.\n");
+		return;
+	}
+	for (int k = 0; k < 3; k++) {
+		int n = shapes[k][0], m = shapes[k][1], nbufs = n + m;
+		gib_context_t *gc;
+		unsigned char *ref, *bufs[nodd];
+		int ld[nodd], tickets[nodd], ids[nodd][256];
+		char failed[256];
+
+		printf("gibd n = %i, m = %i\n", n, m);
+		if (gib_init_cpu(n, m, &gc)) {
+			printf("gib_init_cpu failed.\n");
+			exit(1);
+		}
+		ref = make_ref(gc);
+		for (int s = 0; s < nodd; s++) {
+			if (gib_client_alloc(cl, n, m, ref_size,
+					     (void **)&bufs[s], &ld[s])) {
+				printf("gib_client_alloc failed.\n");
+				exit(1);
+			}
+			for (int i = 0; i < n; i++)
+				memcpy(bufs[s] + i * ld[s], ref + i * ref_size,
+				       ref_size);
+			memset(bufs[s] + n * ld[s], guard_byte, m * ld[s]);
+			if (gib_client_generate_async(cl, n, m, bufs[s], ld[s],
+						      odd_sizes[s],
+						      &tickets[s])) {
+				printf("gib_client_generate_async failed.\n");
+				exit(1);
+			}
+		}
+		for (int s = 0; s < nodd; s++) {
+			int len = odd_sizes[s];
+
+			if (gib_client_wait(cl, tickets[s]) != GIB_SUC) {
+				printf("gibd generate failed at size %i.\n",
+				       len);
+				exit(1);
+			}
+			for (int j = n; j < nbufs; j++)
+				check("gibd generate", len, bufs[s] + j * ld[s],
+				      ref + j * ref_size, ld[s]);
+		}
+
+		for (int s = 0; s < nodd; s++) {
+			int len = odd_sizes[s];
+
+			lose(n, m, len, ids[s], failed);
+			for (int i = 0; i < n; i++)
+				memcpy(bufs[s] + i * ld[s],
+				       ref + ids[s][i] * ref_size, ref_size);
+			memset(bufs[s] + n * ld[s], guard_byte, m * ld[s]);
+			if (gib_client_recover_async(cl, n, m, bufs[s], ld[s],
+						     len, ids[s], m,
+						     &tickets[s])) {
+				printf("gib_client_recover_async failed.\n");
+				exit(1);
+			}
+		}
+		for (int s = 0; s < nodd; s++) {
+			int len = odd_sizes[s];
+
+			if (gib_client_wait(cl, tickets[s]) != GIB_SUC) {
+				printf("gibd recover failed at size %i.\n",
+				       len);
+				exit(1);
+			}
+			for (int j = 0; j < m; j++)
+				check("gibd recover", len,
+				      bufs[s] + (n + j) * ld[s],
+				      ref + ids[s][n + j] * ref_size, ld[s]);
+			gib_client_free(cl, bufs[s]);
+		}
+		free(ref);
+		gib_destroy(gc);
+	}
+	gib_client_close(cl);
+}
+
 int
 choose(int n, int m)
 {
@@ -189,8 +854,8 @@ main(int argc, char **argv)
 	for (int i = 0; i < max_dim*buf_size; i++)
 		backup_buf[i] = rand();
 
-	for(int j = 0; j < 3; j++){
-		for (int m = 2; m <= max_dim; m++) {
+	for(int j = 0; j < 4; j++){
+		for (int m = 1; m <= max_dim; m++) {
 			for (int n = 2; n <= max_dim; n++) {
 				fprintf(stderr, "n = %i, m = %i\n", n, m);
 
@@ -206,6 +871,9 @@ main(int argc, char **argv)
 				} else if (j == 2) {
 					printf("Jerasure\n");
 					rc = gib_init_jerasure(n, m, &gc);
+				} else if (j == 3) {
+					printf("SIMD\n");
+					rc = gib_init_simd(n, m, &gc);
 				}
 
 				rc = gib_alloc((void **)(&buf),
@@ -247,11 +915,14 @@ main(int argc, char **argv)
 						     buf_size * sizeof(int),
 						     gc);
 				}
+				test_variants(gc);
 
 				gib_free(buf, gc);
 				gib_destroy(gc);
 			}
 		}
 	}
+	test_gib16();
+	test_client();
 	return 0;
 }
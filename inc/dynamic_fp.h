@@ -28,8 +28,32 @@ struct dynamic_fp {
 	int (*gib_recover_nc)(void *buffers, int buf_size, int work_size,
 			      int *buf_ids, int recover_last,
 			      struct gib_context_t *c);
+	int (*gib_recover_sparse)(void *buffers, int buf_size,
+				  char *failed_bufs, struct gib_context_t *c);
+	int (*gib_recover_sparse_nc)(void *buffers, int buf_size,
+				     int work_size, char *failed_bufs,
+				     struct gib_context_t *c);
+	/* Optional; gibraltar.c loops over the single-stripe calls if
+	 * these are NULL.
+	 */
+	int (*gib_generate_batch)(void **buffers, int *buf_sizes, int count,
+				  struct gib_context_t *c);
+	int (*gib_recover_batch)(void **buffers, int *buf_sizes,
+				 int **buf_ids, int *recover_last, int count,
+				 struct gib_context_t *c);
+	int (*gib_generate_iov)(unsigned char **data, unsigned char **parity,
+				int len, struct gib_context_t *c);
+	int (*gib_recover_iov)(unsigned char **survivors, int *buf_ids,
+			       unsigned char **out, int recover_last, int len,
+			       struct gib_context_t *c);
+	int (*gib_update_cols)(int ncols, int *data_ids,
+			       unsigned char **old_data,
+			       unsigned char **new_data,
+			       unsigned char **parity, int len,
+			       struct gib_context_t *c);
 };
 
-extern struct dynamic_fp cuda, jerasure, cpu;
+extern struct dynamic_fp cuda, jerasure, jerasure_cauchy, cpu, simd,
+	parallel, raid6, jit;
 
 #endif
@@ -0,0 +1,39 @@
+/* gib_alloc.h: Internal allocator for stripes of coding buffers
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+#ifndef GIB_ALLOC_H_
+#define GIB_ALLOC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Minimum alignment of every buffer in a stripe.  GIB_ALLOC_ALIGN in
+ * the environment raises it, e.g. to 4096 for O_DIRECT I/O.
+ */
+#define GIB_ALLOC_ALIGN 64
+
+/* Allocates count buffers of at least buf_size bytes each, back to
+ * back at the stride returned in ld.  Every buffer starts on an
+ * alignment boundary, and the stride is an odd number of units, the
+ * least common multiple of the alignment and unit, so that the
+ * buffers of a stripe fall in different cache sets rather than all
+ * aliasing the same ones.  Backends whose sizes must be multiples of
+ * a block pass it as unit, and 1 otherwise.  GIB_ALLOC_HUGEPAGES and
+ * GIB_ALLOC_NODE select the backing memory; see the README.
+ */
+int gib_stripe_alloc(int count, int buf_size, int unit, void **buffers,
+		     int *ld);
+void gib_stripe_free(void *buffers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_ALLOC_H_*/
@@ -9,6 +9,9 @@
  * Initial version, Matthew L. Curry
  * Dec 16, 2014, Rodrigo Sardinas; added ability to call functions
  * specific to a back-end.
+ * Added the decoding plan cache.
+ * Added per-context expanded multiplication tables.
+ * Added the block size, for splitting calls into chunks.
  *
  */
 #ifndef GIB_CONTEXT_H_
@@ -16,9 +19,21 @@
 
 #include "dynamic_fp.h"
 
+struct gib_plan_cache;
+
 struct gib_context_t {
 	int n, m;
 	unsigned char *F;
+	/* The product rows gib_gf_table[F[i]] of every entry of F, laid
+	 * out contiguously for the CPU kernels, or NULL.
+	 */
+	unsigned char *F_rows;
+	unsigned long table_bytes; /* Expanded tables owned by the context */
+	/* Every size given to the context must be a multiple of this: 8
+	 * packets for Jerasure's Cauchy code, and 1 for the rest.
+	 */
+	int block;
+	struct gib_plan_cache *plans; /* Decoding plans by erasure pattern */
 	/* The stuff below is only used in the GPU case */
 	void *acc_context;
 	struct dynamic_fp * strategy;
@@ -26,4 +41,17 @@ struct gib_context_t {
 
 typedef struct gib_context_t* gib_context;
 
+/* Rounds len up to a multiple of both align, a power of two, and the
+ * block size of c, for cutting calls on c into chunks.
+ */
+static inline int
+gib_context_round(struct gib_context_t *c, int len, int align)
+{
+	int grain = c->block;
+
+	while (grain % align)
+		grain *= 2;
+	return (len + grain - 1) / grain * grain;
+}
+
 #endif /*GIB_CONTEXT_H_*/
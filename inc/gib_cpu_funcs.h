@@ -6,6 +6,7 @@
  *
  * Changes:
  * Initial version, Matthew L. Curry
+ * Added the expanded table builders.
  *
  */
 #include "gibraltar.h"
@@ -30,6 +31,26 @@ int gib_cpu_recover(void *buffers, int buf_size, int *buf_ids,
 int gib_cpu_recover_nc(void *buffers, int buf_size, int work_size,
 		       int *buf_ids, int recover_last,
 		       struct gib_context_t *c);
+int gib_cpu_decode_rows(struct gib_context_t *c, int *buf_ids,
+			int recover_last, unsigned char *rows);
+int gib_cpu_expand_rows(const unsigned char *coefs, int count,
+			unsigned char **rows);
+struct gib_plan;
+int gib_cpu_plan_build(struct gib_context_t *c, int *buf_ids,
+		       struct gib_plan *plan);
+int gib_cpu_generate_batch(void **buffers, int *buf_sizes, int count,
+			   struct gib_context_t *c);
+int gib_cpu_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+			  int *recover_last, int count,
+			  struct gib_context_t *c);
+int gib_cpu_generate_iov(unsigned char **data, unsigned char **parity,
+			 int len, struct gib_context_t *c);
+int gib_cpu_recover_iov(unsigned char **survivors, int *buf_ids,
+			unsigned char **out, int recover_last, int len,
+			struct gib_context_t *c);
+int gib_cpu_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+			unsigned char **new_data, unsigned char **parity,
+			int len, struct gib_context_t *c);
 
 #ifdef __cplusplus
 }
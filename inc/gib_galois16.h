@@ -0,0 +1,29 @@
+/* gib_galois16.h: CPU-based GF(2^16) arithmetic functions.
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+#ifndef GIB_GALOIS16_H_
+#define GIB_GALOIS16_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern unsigned short gib_gf16_log[65536];
+extern unsigned short gib_gf16_ilog[65536];
+int gib_galois16_init(void);
+unsigned short gib_galois16_mul(unsigned short a, unsigned short b);
+unsigned short gib_galois16_div(unsigned short a, unsigned short b);
+int gib_galois16_gen_F(unsigned short *mat, int rows, int cols);
+int gib_galois16_invert(unsigned short *mat, unsigned short *inv, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_GALOIS16_H_*/
@@ -0,0 +1,54 @@
+/* gib_jit_funcs.h: Internal interface to the run-time compiled kernels
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+#ifndef GIB_JIT_FUNCS_H_
+#define GIB_JIT_FUNCS_H_
+
+#include "gibraltar.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A kernel specialized to one matrix M, computing out[r] = sum over i
+ * of M[r][i] * in[i] for the first len bytes of every buffer.
+ */
+typedef void (*gib_jit_dot_fn)(unsigned char **in, unsigned char **out,
+			       int len);
+
+struct gib_jit_kernel {
+	void *handle; /* From dlopen */
+	gib_jit_dot_fn dot;
+};
+
+/* Loads the kernel for mat from GIB_CACHE_DIR.  If it is not cached,
+ * it is compiled when build is nonzero, and GIB_BUSY is returned
+ * otherwise.
+ */
+int gib_jit_compile(const unsigned char *mat, int rows, int cols, int build,
+		    struct gib_jit_kernel *k);
+void gib_jit_release(struct gib_jit_kernel *k);
+
+int gib_jit_init(int n, int m, struct gib_context_t **c);
+int gib_jit_destroy(struct gib_context_t *c);
+int gib_jit_generate_nc(void *buffers, int buf_size, int work_size,
+			struct gib_context_t *c);
+int gib_jit_recover_nc(void *buffers, int buf_size, int work_size,
+		       int *buf_ids, int recover_last,
+		       struct gib_context_t *c);
+int gib_jit_generate_iov(unsigned char **data, unsigned char **parity,
+			 int len, struct gib_context_t *c);
+int gib_jit_recover_iov(unsigned char **survivors, int *buf_ids,
+			unsigned char **out, int recover_last, int len,
+			struct gib_context_t *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_JIT_FUNCS_H_*/
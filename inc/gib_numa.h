@@ -0,0 +1,34 @@
+/* gib_numa.h: Internal view of the machine's NUMA topology
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+#ifndef GIB_NUMA_H_
+#define GIB_NUMA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Nodes are numbered densely from 0, counting only nodes with
+ * processors; gib_numa_id gives the kernel's number for one.
+ */
+#define GIB_NUMA_MAX_NODES 64
+
+/* Number of nodes, 1 if the topology cannot be read */
+int gib_numa_nodes(void);
+int gib_numa_id(int node);
+/* Restricts the calling thread to the processors of node */
+int gib_numa_bind_thread(int node);
+/* Node of the processor the calling thread is running on */
+int gib_numa_current(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_NUMA_H_*/
@@ -0,0 +1,66 @@
+/* gib_plan_cache.h: Per-context cache of prepared decoding plans
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Plans account for the memory they hold.
+ *
+ */
+#ifndef GIB_PLAN_CACHE_H_
+#define GIB_PLAN_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct gib_context_t;
+
+/* Default number of plans kept per context; GIB_PLAN_CACHE_SIZE in the
+ * environment overrides it.
+ */
+#define GIB_PLAN_CACHE_SIZE 64
+
+/* Everything needed to recover buffers buf_ids[n..n+recover_last) from
+ * buffers buf_ids[0..n).  rows holds the recover_last x n decoding
+ * rows in Gibraltar's field; backends that need more (expanded tables,
+ * or another library's matrices) hang it off priv.
+ */
+struct gib_plan {
+	int recover_last;
+	int *key; /* Copy of buf_ids[0..n+recover_last) */
+	unsigned long hash;
+	unsigned char *rows;
+	void *priv;
+	void (*priv_free)(void *priv);
+	unsigned long bytes; /* Size of rows and priv, for accounting */
+
+	int refs;
+	struct gib_plan *prev, *next;
+};
+
+/* Fills in rows and/or priv of a new plan. */
+typedef int (*gib_plan_build_fn)(struct gib_context_t *c, int *buf_ids,
+				 struct gib_plan *plan);
+
+struct gib_plan_cache;
+
+int gib_plan_cache_create(int capacity, struct gib_plan_cache **pc);
+void gib_plan_cache_destroy(struct gib_plan_cache *pc);
+/* Returns a referenced plan for the pattern, building it on a miss.
+ * Each successful gib_plan_get must be paired with a gib_plan_put.
+ */
+int gib_plan_get(struct gib_context_t *c, int *buf_ids, int recover_last,
+		 gib_plan_build_fn build, struct gib_plan **plan);
+void gib_plan_put(struct gib_context_t *c, struct gib_plan *plan);
+
+/* Builds the rows of a plan with gib_cpu_decode_rows. */
+int gib_plan_build_rows(struct gib_context_t *c, int *buf_ids,
+			struct gib_plan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_PLAN_CACHE_H_*/
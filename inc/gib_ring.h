@@ -0,0 +1,120 @@
+/* gib_ring.h: Internal bounded lock-free rings and futex waiting
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Rings and events may live in memory shared between processes.
+ * Events may be waited on with a timeout.
+ *
+ */
+#ifndef GIB_RING_H_
+#define GIB_RING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GIB_RING_LINE 64
+
+/* Every slot has a cache line to itself, so that a producer filling one
+ * slot never invalidates the line a consumer is reading the next from.
+ * seq is only used by the MPMC ring.
+ */
+struct gib_ring_slot {
+	unsigned long seq;
+	void *ptr;
+	long val;
+	char pad[GIB_RING_LINE - 2 * sizeof(long) - sizeof(void *)];
+};
+
+/* Single producer, single consumer.  Each side keeps a stale copy of
+ * the other's index and only rereads the real one when the copy says
+ * the ring is full (or empty).
+ */
+struct gib_spsc {
+	unsigned long head; /* Next slot to read */
+	unsigned long tail_cache;
+	char pad0[GIB_RING_LINE - 2 * sizeof(long)];
+	unsigned long tail; /* Next slot to write */
+	unsigned long head_cache;
+	char pad1[GIB_RING_LINE - 2 * sizeof(long)];
+	unsigned long mask;
+	struct gib_ring_slot *slots;
+};
+
+/* Multiple producers and consumers, after Vyukov's bounded queue: the
+ * sequence number of a slot says whether it is ready to be written or
+ * read for the current lap, and head and tail are claimed with CAS.
+ */
+struct gib_mpmc {
+	unsigned long head;
+	char pad0[GIB_RING_LINE - sizeof(long)];
+	unsigned long tail;
+	char pad1[GIB_RING_LINE - sizeof(long)];
+	unsigned long mask;
+	struct gib_ring_slot *slots;
+};
+
+/* depth is rounded up to a power of two.  Push and pop return GIB_BUSY
+ * when the ring is full or empty.
+ */
+int gib_spsc_init(struct gib_spsc *r, unsigned long depth);
+void gib_spsc_destroy(struct gib_spsc *r);
+int gib_spsc_push(struct gib_spsc *r, void *ptr, long val);
+int gib_spsc_pop(struct gib_spsc *r, void **ptr, long *val);
+unsigned long gib_spsc_count(struct gib_spsc *r);
+
+int gib_mpmc_init(struct gib_mpmc *r, unsigned long depth);
+void gib_mpmc_destroy(struct gib_mpmc *r);
+int gib_mpmc_push(struct gib_mpmc *r, void *ptr, long val);
+int gib_mpmc_pop(struct gib_mpmc *r, void **ptr, long *val);
+unsigned long gib_mpmc_count(struct gib_mpmc *r);
+
+/* For a ring in memory shared with another process, whose slots sit at
+ * a known place next to it.  Each side passes the slots and the depth
+ * (a power of two) itself, rather than trusting the copies in the
+ * shared ring, and only val is meaningful to the other side.  As the
+ * other side can also scribble on head and the sequence numbers,
+ * gib_mpmc_pop_in gives up with GIB_ERR after GIB_RING_TRIES attempts
+ * to claim a slot instead of retrying for good.
+ */
+#define GIB_RING_TRIES 1024
+
+void gib_mpmc_init_in(struct gib_mpmc *r, struct gib_ring_slot *slots,
+		      unsigned long depth);
+int gib_mpmc_push_in(struct gib_mpmc *r, struct gib_ring_slot *slots,
+		     unsigned long depth, void *ptr, long val);
+int gib_mpmc_pop_in(struct gib_mpmc *r, struct gib_ring_slot *slots,
+		    unsigned long depth, void **ptr, long *val);
+
+/* An eventcount.  Waiters spin on their condition for a while, then
+ * sleep on seq with a futex; notifiers bump seq and only make the
+ * system call when someone is asleep.  The spin budget adapts: it
+ * grows when spinning pays off and shrinks when the waiter ends up
+ * sleeping anyway.
+ */
+struct gib_event {
+	int seq;
+	int waiters;
+	int spin;
+	int shared; /* Waiters may be in other processes */
+	unsigned long sleeps;
+	unsigned long wakeups;
+};
+
+/* Returns once ready(arg) is nonzero */
+void gib_event_await(struct gib_event *ev, int (*ready)(void *), void *arg);
+/* As gib_event_await, but sleeps at most once, for up to ms
+ * milliseconds, and returns whether ready(arg) is nonzero
+ */
+int gib_event_await_for(struct gib_event *ev, int (*ready)(void *),
+			void *arg, int ms);
+void gib_event_notify(struct gib_event *ev, int all);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_RING_H_*/
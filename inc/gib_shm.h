@@ -0,0 +1,90 @@
+/* gib_shm.h: Internal layout shared by gibd and its clients
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+#ifndef GIB_SHM_H_
+#define GIB_SHM_H_
+
+#include "gib_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A client creates a sealed memfd holding a struct gib_shm_header and
+ * then its stripes, and an eventfd, and sends both to the daemon in a
+ * struct gib_shm_hello over a SOCK_SEQPACKET Unix socket.  The daemon
+ * answers with one int, GIB_SUC or an error.  From then on the socket
+ * only tells the daemon when the client goes away.
+ *
+ * Requests are described in place in reqs[], and their indices pushed
+ * on sq.  The daemon arms the doorbell before it sleeps; a client that
+ * finds it armed after pushing disarms it and writes the eventfd.  The
+ * daemon codes the stripe in place, stores rc, sets state and wakes
+ * done, so completion needs no copies and no further messages.
+ */
+#define GIB_SHM_MAGIC 0x67696264
+#define GIB_SHM_VERSION 1
+#define GIB_SHM_DEPTH 256
+#define GIB_SHM_SOCKET "gibd.sock"
+#define GIB_SHM_SIZE (64UL << 20)
+#define GIB_SHM_PAGE 4096
+
+enum {
+	GIB_SHM_FREE,
+	GIB_SHM_QUEUED,
+	GIB_SHM_DONE
+};
+
+struct gib_shm_req {
+	int recover_last; /* -1 for generate */
+	int n;
+	int m;
+	int cls;
+	int buf_size;
+	int work_size;
+	unsigned long buffers; /* Offset in the segment */
+	int state;
+	int rc;
+	struct gib_event done;
+	int buf_ids[256];
+};
+
+struct gib_shm_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned long size;
+	int armed; /* The daemon waits for the doorbell */
+	char pad[GIB_RING_LINE];
+	struct gib_mpmc sq;
+	struct gib_ring_slot sq_slots[GIB_SHM_DEPTH];
+	struct gib_shm_req reqs[GIB_SHM_DEPTH];
+};
+
+/* Stripes start at this offset */
+#define GIB_SHM_DATA ((sizeof(struct gib_shm_header) + GIB_SHM_PAGE - 1) & \
+		      ~(unsigned long)(GIB_SHM_PAGE - 1))
+
+struct gib_shm_hello {
+	unsigned int magic;
+	unsigned int version;
+	unsigned long size;
+};
+
+/* The default socket is GIB_SHM_SOCKET in a directory of the user's
+ * own, $XDG_RUNTIME_DIR or else /tmp/gibd-<uid>.  Writes its path to
+ * path, and the directory's to dir if that is not NULL; both take len
+ * bytes.
+ */
+int gib_shm_socket(char *path, char *dir, unsigned long len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_SHM_H_*/
@@ -0,0 +1,85 @@
+/* gib_simd_funcs.h: Internal interface to the vectorized GF(2^8) kernels
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version; split-table kernels with runtime ISA dispatch.
+ * Added GF2P8AFFINEQB kernels for processors with GFNI.
+ * Added XOR kernels for m = 1.
+ *
+ */
+#ifndef GIB_SIMD_FUNCS_H_
+#define GIB_SIMD_FUNCS_H_
+
+#include "gibraltar.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Instruction set levels, in increasing order of preference. */
+enum gib_simd_isa {
+	GIB_SIMD_SCALAR = 0,
+	GIB_SIMD_SSSE3,
+	GIB_SIMD_AVX2,
+	GIB_SIMD_AVX512,
+	GIB_SIMD_GFNI_AVX2,
+	GIB_SIMD_GFNI_AVX512,
+	GIB_SIMD_NISA
+};
+
+/* Multiplication by a constant c is split into two 16-entry lookups,
+ * c*x = lo[x & 0xf] ^ hi[x >> 4], which fit a single PSHUFB operand.
+ * The same product is also kept as the 8x8 bit matrix consumed by
+ * GF2P8AFFINEQB; GF2P8MULB is not usable, as it is hardwired to a
+ * different field polynomial than Gibraltar's.
+ */
+struct gib_simd_tab {
+	unsigned char lo[16];
+	unsigned char hi[16];
+	unsigned long long affine;
+};
+
+/* Computes out[r] = sum over i of tabs[r*cols+i] * in[i] for the first
+ * len bytes of every buffer.
+ */
+typedef void (*gib_simd_dot_fn)(const struct gib_simd_tab *tabs, int rows,
+				int cols, unsigned char **in,
+				unsigned char **out, int len);
+
+int gib_simd_detect(void);
+const char *gib_simd_isa_name(int isa);
+gib_simd_dot_fn gib_simd_get_dot(int isa);
+/* A kernel with the same interface for matrices of all ones. */
+gib_simd_dot_fn gib_simd_get_xor(int isa);
+void gib_simd_tab_init(struct gib_simd_tab *t, unsigned char coef);
+
+int gib_simd_init(int n, int m, struct gib_context_t **c);
+int gib_simd_destroy(struct gib_context_t *c);
+int gib_simd_alloc(void **buffers, int buf_size, int *ld,
+		   struct gib_context_t *c);
+int gib_simd_free(void *buffers);
+int gib_simd_generate_nc(void *buffers, int buf_size, int work_size,
+			 struct gib_context_t *c);
+int gib_simd_recover_nc(void *buffers, int buf_size, int work_size,
+			int *buf_ids, int recover_last,
+			struct gib_context_t *c);
+int gib_simd_generate_batch(void **buffers, int *buf_sizes, int count,
+			    struct gib_context_t *c);
+int gib_simd_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+			   int *recover_last, int count,
+			   struct gib_context_t *c);
+int gib_simd_generate_iov(unsigned char **data, unsigned char **parity,
+			  int len, struct gib_context_t *c);
+int gib_simd_recover_iov(unsigned char **survivors, int *buf_ids,
+			 unsigned char **out, int recover_last, int len,
+			 struct gib_context_t *c);
+int gib_simd_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+			 unsigned char **new_data, unsigned char **parity,
+			 int len, struct gib_context_t *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_SIMD_FUNCS_H_*/
@@ -0,0 +1,54 @@
+/* gib_thread_pool.h: Persistent worker threads for the parallel backend
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Workers can be pinned to NUMA nodes and take jobs from their own.
+ *
+ */
+#ifndef GIB_THREAD_POOL_H_
+#define GIB_THREAD_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct gib_pool;
+
+/* Called once for each job index in [0, njobs). */
+typedef void (*gib_pool_fn)(void *arg, int job);
+
+int gib_pool_create(int nthreads, struct gib_pool **pool);
+/* As gib_pool_create, but with the workers dealt out over the nodes
+ * and pinned to them.  The calling thread counts as one of nthreads,
+ * so each node gets a worker only if nthreads > nodes.
+ */
+int gib_pool_create_numa(int nthreads, int nodes, struct gib_pool **pool);
+int gib_pool_destroy(struct gib_pool *pool);
+int gib_pool_size(struct gib_pool *pool);
+int gib_pool_nodes(struct gib_pool *pool);
+/* Threads the pool has on node, counting the calling thread on node 0 */
+int gib_pool_node_size(struct gib_pool *pool, int node);
+/* Node of the calling thread: its own for workers, and the one it is
+ * running on for others.
+ */
+int gib_pool_current_node(struct gib_pool *pool);
+/* Runs njobs jobs on the pool and the calling thread, returning once
+ * every job has finished.  Calls from several threads are serialized.
+ */
+int gib_pool_run(struct gib_pool *pool, int njobs, gib_pool_fn fn,
+		 void *arg);
+/* Runs node_jobs[k] jobs for each node k, numbered consecutively by
+ * node.  Threads take their own node's jobs first and then, unless
+ * local is set, help the other nodes.
+ */
+int gib_pool_run_nodes(struct gib_pool *pool, const int *node_jobs,
+		       int local, gib_pool_fn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*GIB_THREAD_POOL_H_*/
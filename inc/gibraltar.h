@@ -22,23 +22,336 @@ struct gib_context_t;
 int gib_init_cuda(int n, int m, struct gib_context_t **c);
 int gib_init_cpu(int n, int m, struct gib_context_t **c);
 int gib_init_jerasure(int n, int m, struct gib_context_t **c);
+int gib_init_simd(int n, int m, struct gib_context_t **c);
+/* Jerasure with a Cauchy bitmatrix code, which is coded with XORs only.
+ * Buffer sizes must be a multiple of 8 times the packet size, which is
+ * set by GIB_JERASURE_PACKETSIZE.
+ */
+int gib_init_jerasure_cauchy(int n, int m, struct gib_context_t **c);
+/* A RAID-6 code (m = 2) whose P and Q parities are computed with XORs
+ * and multiplications by 2 only.  Its parity differs from the general
+ * contexts', so stripes must be recovered by a RAID-6 context.
+ */
+int gib_init_raid6(int n, struct gib_context_t **c);
+/* A CPU context running kernels compiled for its coding matrix, and for
+ * each decoding plan, by the local C compiler.  Objects are cached in
+ * GIB_CACHE_DIR, which must be set, belong to the user and be writable
+ * by no one else.  A plan runs the SIMD kernels until its object has
+ * compiled in the background.  Cached objects are never removed.
+ */
+int gib_init_jit(int n, int m, struct gib_context_t **c);
+
+/* Name of the kernel a SIMD context runs, e.g. "avx2" or "gfni-avx512".
+ * With a NULL context, names the kernel gib_init_simd would select.
+ */
+const char *gib_simd_path(struct gib_context_t *c);
+
+/* Wraps an existing context so that its generate and recover calls are
+ * split across nthreads threads (all processors if nthreads <= 0).  No
+ * thread gets fewer than min_chunk bytes of each buffer (a default is
+ * used if min_chunk <= 0).  The new context owns inner, and destroys it
+ * along with itself.
+ */
+int gib_init_parallel(struct gib_context_t *inner, int nthreads,
+		      int min_chunk, struct gib_context_t **c);
+
+/* On NUMA machines a parallel context pins its threads to the nodes,
+ * and gib_alloc on it places part k of every buffer on node k, which
+ * its generate and recover calls then give to node k's threads.  The
+ * counters below are accumulated per node over all calls: bytes of
+ * data coded by the node's threads, how many of those lay in another
+ * node's part, and the time the threads spent coding them, so bytes /
+ * ns is the node's throughput.  gib_parallel_nodes is 1 on a machine
+ * (or context) without NUMA placement, and 0 for a context that is not
+ * a parallel one.
+ */
+struct gib_node_stats {
+	unsigned long bytes;
+	unsigned long remote_bytes;
+	unsigned long long ns;
+};
+int gib_parallel_nodes(struct gib_context_t *c);
+int gib_parallel_node_stats(struct gib_context_t *c, int node,
+			    struct gib_node_stats *stats);
+
+/* Work-stealing execution of batches of independent stripes.  Each
+ * stripe may use a different context; with buf_ids NULL it is
+ * generated, otherwise recovered, exactly as gib_generate_nc or
+ * gib_recover_nc would.  Stripes are cut or grouped into tasks of about
+ * grain bytes of input (a default is used if grain <= 0).
+ */
+struct gib_ws;
+struct gib_stripe {
+	struct gib_context_t *c;
+	void *buffers;
+	int buf_size;
+	int work_size;
+	int *buf_ids;
+	int recover_last;
+	int rc; /* Set by gib_ws_run */
+};
+struct gib_ws_stats {
+	unsigned long tasks;
+	unsigned long bytes;
+	unsigned long steals;
+	unsigned long failed_steals;
+};
+int gib_ws_create(int nthreads, int grain, struct gib_ws **ws);
+int gib_ws_destroy(struct gib_ws *ws);
+int gib_ws_run(struct gib_ws *ws, struct gib_stripe *stripes, int count);
+int gib_ws_nworkers(struct gib_ws *ws);
+/* Counters accumulated by one worker over all batches. */
+int gib_ws_stats(struct gib_ws *ws, int worker, struct gib_ws_stats *stats);
 
 /* Common Functions */
 int gib_destroy(struct gib_context_t *c);
 int gib_alloc(void **buffers, int buf_size, int *ld, struct gib_context_t *c);
 int gib_free(void *buffers, struct gib_context_t *c);
 int gib_generate(void *buffers, int buf_size, struct gib_context_t *c);
+/* The _nc calls code only the first work_size bytes of each buffer, at
+ * stride buf_size, and write nothing after them.  work_size may be any
+ * positive size up to buf_size, except on Cauchy contexts, where it
+ * must be a whole number of blocks.
+ */
 int gib_generate_nc(void *buffers, int buf_size, int work_size,
 		    struct gib_context_t *c);
+/* buf_ids[0..n) name the surviving buffers, in the order they are laid
+ * out in buffers, and buf_ids[n..n+recover_last) name the lost ones,
+ * which are written after them.  Lost buffers may be data or parity;
+ * all are produced in one pass over the survivors.
+ */
 int gib_recover(void *buffers, int buf_size, int *buf_ids, int recover_last,
 		struct gib_context_t *c);
 int gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
 		   int recover_last, struct gib_context_t *c);
+/* In-place recovery.  Every buffer stays at its position in the stripe,
+ * and failed_bufs holds one flag per buffer (n+m in all), nonzero for
+ * those that were lost.  Only the flagged buffers are written.
+ */
+int gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		       struct gib_context_t *c);
+int gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+			  char *failed_bufs, struct gib_context_t *c);
+/* Code count stripes of one context in a single call, so that per-call
+ * setup is paid once.  Stripe i is at buffers[i] with buffer size
+ * buf_sizes[i], laid out as for gib_generate and gib_recover.
+ */
+int gib_generate_batch(void **buffers, int *buf_sizes, int count,
+		       struct gib_context_t *c);
+int gib_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+		      int *recover_last, int count, struct gib_context_t *c);
+/* Scatter/gather variants, for buffers that are not in one gib_alloc
+ * region.  gib_generate_iov reads len bytes from each of the n data[]
+ * buffers and writes the m parity[] buffers.  gib_recover_iov reads the
+ * n survivors[], where survivors[i] holds buffer buf_ids[i], and writes
+ * buffer buf_ids[n+j] to out[j] for j < recover_last.  Inputs are never
+ * written, so they may be read-only mappings.  len may be any positive
+ * size, except on Cauchy contexts, where it must be a whole number of
+ * blocks; exactly len bytes of each output are written.
+ */
+int gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		     struct gib_context_t *c);
+int gib_recover_iov(unsigned char **survivors, int *buf_ids,
+		    unsigned char **out, int recover_last, int len,
+		    struct gib_context_t *c);
+
+/* Small-write updates.  When data buffer data_index changes from
+ * old_data to new_data, gib_update brings the m parity[] buffers up to
+ * date by adding F[j][data_index] * (old_data ^ new_data) to each,
+ * reading len bytes of two buffers instead of all n.  gib_update_cols
+ * applies ncols such changes, to data buffers data_ids[i], at once.
+ * Sizes follow the rule for the iov calls.
+ */
+int gib_update(int data_index, unsigned char *old_data,
+	       unsigned char *new_data, unsigned char **parity, int len,
+	       struct gib_context_t *c);
+int gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		    unsigned char **new_data, unsigned char **parity, int len,
+		    struct gib_context_t *c);
+
+/* Asynchronous generate and recover.  A request is queued and run by
+ * the library's own worker threads (GIB_ASYNC_THREADS of them, all
+ * processors by default), exactly as gib_generate_nc or gib_recover_nc
+ * would run it, while the caller gets on with other work.  The buffers
+ * must stay valid until the request completes; buf_ids is copied.
+ *
+ * With req non-NULL, a handle is returned there, which gib_poll and
+ * gib_wait query and which must be released with gib_request_free,
+ * before or after completion.  gib_poll returns GIB_BUSY until the
+ * request completes, and then its result, as gib_wait does after
+ * blocking.  gib_cancel withdraws a request that has not started, and
+ * returns GIB_ERR if it is too late; a cancelled request completes
+ * with GIB_CANCELED.
+ *
+ * If fn is given, it is called with the result on the thread that
+ * completed the request, before waiters are woken.
+ *
+ * Once gib_async_fd has been called, each completion is also queued as
+ * its arg and result, which gib_async_reap takes up to max of at a
+ * time.  The returned nonblocking eventfd (-1 if eventfd is not
+ * available) becomes readable when completions are waiting, for use
+ * in a poll or epoll loop: read it, then reap until gib_async_reap
+ * returns fewer than asked for, as it is signaled again only after
+ * that.  The queue holds 16 times GIB_ASYNC_DEPTH completions; ones
+ * that do not fit wait on an overflow list, which gib_async_reap takes
+ * from after the queue, and are counted as overflows.  None are lost,
+ * but each one waiting keeps its request's memory.
+ *
+ * Submissions go through a lock-free ring per submitting thread, of
+ * GIB_ASYNC_DEPTH (1024 by default) requests; a submitter whose ring
+ * is full waits for room.  gib_async_stats describes the engine.
+ */
+struct gib_request;
+typedef void (*gib_async_fn)(struct gib_request *req, int rc, void *arg);
+int gib_generate_async(void *buffers, int buf_size, int work_size,
+		       struct gib_context_t *c, int cls, gib_async_fn fn,
+		       void *arg, struct gib_request **req);
+int gib_recover_async(void *buffers, int buf_size, int work_size,
+		      int *buf_ids, int recover_last, struct gib_context_t *c,
+		      int cls, gib_async_fn fn, void *arg,
+		      struct gib_request **req);
+int gib_poll(struct gib_request *req);
+int gib_wait(struct gib_request *req);
+int gib_cancel(struct gib_request *req);
+int gib_request_free(struct gib_request *req);
+int gib_async_fd(void);
+struct gib_completion {
+	void *arg;
+	int rc;
+};
+int gib_async_reap(struct gib_completion *out, int max);
+
+struct gib_async_stats {
+	unsigned long depth; /* Slots per submission ring */
+	unsigned long workers;
+	unsigned long rings; /* Submission rings, one per thread */
+	unsigned long queued; /* Requests waiting in them now */
+	unsigned long submitted;
+	unsigned long completed; /* Requests run by the workers */
+	unsigned long sleeps; /* Times a worker went to sleep idle */
+	unsigned long wakeups; /* Times workers were woken */
+	unsigned long full_waits; /* Submitter sleeps on a full ring */
+	unsigned long completions; /* Waiting for gib_async_reap now */
+	unsigned long overflows; /* Completions that missed the queue */
+	unsigned long signals; /* Writes to the gib_async_fd eventfd */
+};
+int gib_async_stats(struct gib_async_stats *s);
+
+/* Priority classes for asynchronous requests, from 0, the most urgent,
+ * to 3.  Each submission names its class in cls; with cls < 0 it takes
+ * the calling thread's class, which gib_async_set_class sets (0 to
+ * start with), so foreground and background work may also come from
+ * different threads without passing classes around.
+ *
+ * Workers share their time between classes with waiting requests in
+ * proportion to the classes' shares, counted in bytes coded, and a
+ * class with a rate (bytes per second, 0 for none) is held to it even
+ * when the workers have nothing else to do.  Shares default to 8, 4, 2
+ * and 1; GIB_ASYNC_SHARES and GIB_ASYNC_RATES set them as lists such as
+ * "8,4,2,1", as does gib_async_class_config at run time.  Requests run
+ * in chunks of about GIB_ASYNC_CHUNK bytes of input (256 KiB by
+ * default), and a class that comes due preempts a long request of
+ * another at the next chunk boundary.
+ */
+struct gib_class_stats {
+	int share;
+	unsigned long rate;
+	unsigned long submitted;
+	unsigned long queued; /* Waiting now */
+	unsigned long completed; /* Run, not counting cancelled */
+	unsigned long bytes; /* Of input coded */
+	unsigned long latency_ns; /* Submission to completion, summed */
+	unsigned long max_latency_ns;
+	unsigned long preemptions; /* Its requests paused for another */
+	unsigned long throttled; /* Times it used up its rate budget */
+};
+int gib_async_set_class(int cls);
+int gib_async_class_config(int cls, int share, unsigned long rate);
+int gib_async_class_stats(int cls, struct gib_class_stats *s);
+
+/* Coding through gibd, a daemon that serves all the processes of a
+ * host with one pool of workers, instead of each process starting its
+ * own.  gib_client_connect reaches the daemon on the Unix socket at
+ * path (NULL for GIB_SERVER, or gibd.sock in $XDG_RUNTIME_DIR or
+ * /tmp/gibd-<uid>), makes sure it runs as the same user or as root,
+ * and shares a segment of size bytes (0 for 64 MiB) with it.  Stripes
+ * must lie in that segment, so they come from gib_client_alloc, laid
+ * out as gib_alloc lays them out, and the daemon codes them in place.
+ *
+ * Requests mirror gib_generate_nc and gib_recover_nc for an (n, m)
+ * code and return a ticket, of which there are 256 per connection;
+ * with none free, GIB_BUSY is returned.  gib_client_poll returns
+ * GIB_BUSY until the request completes, and then its result, as
+ * gib_client_wait does after blocking; either releases the ticket once
+ * it has returned the result.  If the daemon goes away, requests not
+ * yet done complete with GIB_ERR, as do any submitted after.
+ * Requests run in the class set with gib_client_set_class.  A
+ * connection is for one process, but may be used from several threads.
+ */
+struct gib_client;
+int gib_client_connect(const char *path, unsigned long size,
+		       struct gib_client **cl);
+int gib_client_close(struct gib_client *cl);
+int gib_client_alloc(struct gib_client *cl, int n, int m, int buf_size,
+		     void **buffers, int *ld);
+int gib_client_free(struct gib_client *cl, void *buffers);
+int gib_client_set_class(struct gib_client *cl, int cls);
+int gib_client_generate_async(struct gib_client *cl, int n, int m,
+			      void *buffers, int buf_size, int work_size,
+			      int *ticket);
+int gib_client_recover_async(struct gib_client *cl, int n, int m,
+			     void *buffers, int buf_size, int work_size,
+			     int *buf_ids, int recover_last, int *ticket);
+int gib_client_poll(struct gib_client *cl, int ticket);
+int gib_client_wait(struct gib_client *cl, int ticket);
+int gib_client_generate(struct gib_client *cl, int n, int m, void *buffers,
+			int buf_size, int work_size);
+int gib_client_recover(struct gib_client *cl, int n, int m, void *buffers,
+		       int buf_size, int work_size, int *buf_ids,
+		       int recover_last);
+
+/* Counts of recoveries that found their decoding plan already cached
+ * in the context, and of those that had to build it.
+ */
+int gib_plan_stats(struct gib_context_t *c, unsigned long *hits,
+		   unsigned long *misses);
+/* Bytes of expanded multiplication tables held by the context for its
+ * coding matrix, and by the decoding plans it currently caches.
+ */
+int gib_table_footprint(struct gib_context_t *c,
+			unsigned long *context_bytes,
+			unsigned long *plan_bytes);
+
+/* Reed-Solomon coding over GF(2^16), for stripes wider than GF(2^8)
+ * allows (n + m <= 65536).  Buffers hold little-endian 16-bit symbols,
+ * so work sizes must be even.  These contexts are not interchangeable
+ * with struct gib_context_t, and the calls mirror the ones above.
+ */
+struct gib16_context_t;
+int gib16_init(int n, int m, struct gib16_context_t **c);
+int gib16_destroy(struct gib16_context_t *c);
+int gib16_alloc(void **buffers, int buf_size, int *ld,
+		struct gib16_context_t *c);
+int gib16_free(void *buffers, struct gib16_context_t *c);
+int gib16_generate(void *buffers, int buf_size, struct gib16_context_t *c);
+int gib16_generate_nc(void *buffers, int buf_size, int work_size,
+		      struct gib16_context_t *c);
+int gib16_recover(void *buffers, int buf_size, int *buf_ids,
+		  int recover_last, struct gib16_context_t *c);
+int gib16_recover_nc(void *buffers, int buf_size, int work_size,
+		     int *buf_ids, int recover_last,
+		     struct gib16_context_t *c);
 
 /* Return codes */
 static const int GIB_SUC = 0; /* Success */
 static const int GIB_OOM = 1; /* Out of memory */
 const static int GIB_ERR = 2; /* General mysterious error */
+static const int GIB_BUSY = 3; /* Asynchronous request still running */
+static const int GIB_CANCELED = 4; /* Asynchronous request cancelled */
+
+/* Asynchronous request classes */
+static const int GIB_CLASS_FOREGROUND = 0;
+static const int GIB_CLASS_BACKGROUND = 3;
 
 #if __cplusplus
 }
@@ -0,0 +1,794 @@
+/* gibraltar.hpp: Compile-time specialized codecs for fixed (n, m)
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Codes with the SIMD backend's vector kernels, unrolled for the shape.
+ *
+ */
+
+/* gib::codec<N, M> is the CPU analogue of building gib_cuda_checksum.cu
+ * with -DN=n -DM=m.  The field's log tables, the coding matrix F and
+ * the nibble and affine tables of every entry of F are all computed by
+ * the compiler, so no gib_galois_init runs.  Each vector of input is
+ * coded by the PSHUFB or GF2P8AFFINEQB kernels of gib_simd_funcs.c,
+ * with the loops over its N buffers and M parities fixed at compile
+ * time, and the widest kernel the processor has (capped by
+ * GIB_SIMD_ISA) is picked on first use.  The code is the one the other
+ * backends use, so stripes may be generated by one and recovered by
+ * the other.
+ *
+ * A codec is used through an ordinary context:
+ *
+ *	gib_context c;
+ *	gib::codec<10, 4>::init(&c);	(or gib::init_fixed(10, 4, &c))
+ *	gib_generate(buffers, buf_size, c);
+ *
+ * Requires C++14.
+ */
+#ifndef GIBRALTAR_HPP_
+#define GIBRALTAR_HPP_
+
+#include "gibraltar.h"
+#include "gib_context.h"
+#include "gib_cpu_funcs.h"
+#include "gib_simd_funcs.h"
+#include "gib_plan_cache.h"
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GIB_HPP_X86 1
+#include <immintrin.h>
+#else
+#define GIB_HPP_X86 0
+#endif
+
+namespace gib {
+
+namespace detail {
+
+/* Field polynomial 0435, as in gib_galois.c */
+struct gf_tables {
+	unsigned char log[256];
+	unsigned char ilog[256];
+};
+
+constexpr gf_tables
+make_gf()
+{
+	gf_tables t = {};
+	int b = 1;
+
+	for (int l = 0; l < 255; l++) {
+		t.log[b] = (unsigned char)l;
+		t.ilog[l] = (unsigned char)b;
+		b <<= 1;
+		if (b & 256)
+			b ^= 0435;
+	}
+	return t;
+}
+
+constexpr gf_tables gf = make_gf();
+
+constexpr unsigned char
+mul(unsigned char a, unsigned char b)
+{
+	return (a == 0 || b == 0) ? 0 :
+		gf.ilog[(gf.log[a] + gf.log[b]) % 255];
+}
+
+constexpr unsigned char
+inv(unsigned char a)
+{
+	return gf.ilog[(255 - gf.log[a]) % 255];
+}
+
+/* The m x n matrix gib_galois_gen_F produces: the Vandermonde matrix
+ * A[i][j] = i^j of n+m rows, reduced by column operations to have the
+ * identity on top, less that identity.  m = 1 uses a row of ones, as
+ * gib_cpu_init does.
+ */
+template <int N, int M>
+struct coding_matrix {
+	unsigned char F[M][N];
+};
+
+template <int N, int M>
+constexpr coding_matrix<N, M>
+make_F()
+{
+	unsigned char A[N + M][N] = {};
+	coding_matrix<N, M> r = {};
+
+	for (int i = 0; i < N + M; i++) {
+		for (int j = 0; j < N; j++) {
+			unsigned char x = 1;
+			for (int p = 0; p < j; p++)
+				x = mul(x, (unsigned char)i);
+			A[i][j] = x;
+		}
+	}
+
+	/* gib_galois_gaussian_elim, without the inverse */
+	for (int i = 0; i < N; i++) {
+		if (A[i][i] == 0) {
+			int j = i + 1;
+			while (j < N && A[i][j] == 0)
+				j++;
+			for (int e = 0; e < N + M; e++) {
+				unsigned char tmp = A[e][i];
+				A[e][i] = A[e][j];
+				A[e][j] = tmp;
+			}
+		}
+		unsigned char d = inv(A[i][i]);
+		for (int e = 0; e < N + M; e++)
+			A[e][i] = mul(d, A[e][i]);
+		for (int j = 0; j < N; j++) {
+			unsigned char x = A[i][j];
+			if (j == i)
+				continue;
+			for (int e = 0; e < N + M; e++)
+				A[e][j] ^= mul(x, A[e][i]);
+		}
+	}
+
+	for (int i = 0; i < M; i++)
+		for (int j = 0; j < N; j++)
+			r.F[i][j] = (M == 1) ? 1 : A[N + i][j];
+	return r;
+}
+
+/* rows[j][i][x] = F[j][i] * x */
+template <int N, int M>
+struct coding_rows {
+	unsigned char rows[M][N][256];
+};
+
+template <int N, int M>
+constexpr coding_rows<N, M>
+make_rows(const coding_matrix<N, M> &f)
+{
+	coding_rows<N, M> r = {};
+
+	for (int j = 0; j < M; j++)
+		for (int i = 0; i < N; i++)
+			for (int x = 0; x < 256; x++)
+				r.rows[j][i][x] = mul(f.F[j][i],
+						      (unsigned char)x);
+	return r;
+}
+
+/* As gib_simd_tab_init, from the compile-time field */
+constexpr struct gib_simd_tab
+make_tab(unsigned char coef)
+{
+	struct gib_simd_tab t = {};
+
+	for (int x = 0; x < 16; x++) {
+		t.lo[x] = mul(coef, (unsigned char)x);
+		t.hi[x] = mul(coef, (unsigned char)(x << 4));
+	}
+	for (int i = 0; i < 8; i++) {
+		unsigned long long row = 0;
+		for (int x = 0; x < 8; x++)
+			if (mul(coef, (unsigned char)(1 << x)) & (1 << i))
+				row |= 1ULL << x;
+		t.affine |= row << (8 * (7 - i));
+	}
+	return t;
+}
+
+template <int N, int M>
+struct coding_tabs {
+	struct gib_simd_tab t[M][N];
+};
+
+template <int N, int M>
+constexpr coding_tabs<N, M>
+make_tabs(const coding_matrix<N, M> &f)
+{
+	coding_tabs<N, M> r = {};
+
+	for (int j = 0; j < M; j++)
+		for (int i = 0; i < N; i++)
+			r.t[j][i] = make_tab(f.F[j][i]);
+	return r;
+}
+
+/* out[r] = sum over i of t[r][i] * in[i], for r < R and the first len
+ * bytes.  The kernels below are those of gib_simd_funcs.c with the
+ * loops over rows and columns bounded at compile time, so that the
+ * compiler unrolls them.
+ */
+template <int N>
+using dot_fn = void (*)(const struct gib_simd_tab (*t)[N],
+			unsigned char *const *in,
+			unsigned char *const *out, int len);
+
+/* Handles bytes [start, len) */
+template <int N, int R>
+inline void
+dot_scalar_range(const struct gib_simd_tab (*t)[N],
+		 unsigned char *const *in, unsigned char *const *out,
+		 int start, int len)
+{
+	for (int b = start; b < len; b++) {
+		unsigned char x[N];
+		for (int i = 0; i < N; i++)
+			x[i] = in[i][b];
+		for (int r = 0; r < R; r++) {
+			unsigned char acc = 0;
+			for (int i = 0; i < N; i++)
+				acc ^= t[r][i].lo[x[i] & 0xf] ^
+					t[r][i].hi[x[i] >> 4];
+			out[r][b] = acc;
+		}
+	}
+}
+
+template <int N, int R>
+void
+dot_scalar(const struct gib_simd_tab (*t)[N], unsigned char *const *in,
+	   unsigned char *const *out, int len)
+{
+	dot_scalar_range<N, R>(t, in, out, 0, len);
+}
+
+#if GIB_HPP_X86
+/* GCC's AVX-512 intrinsics start from _mm512_undefined_epi32, which it
+ * then reports as maybe uninitialized in C++.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+template <int N, int R>
+__attribute__((target("ssse3"))) void
+dot_ssse3(const struct gib_simd_tab (*t)[N], unsigned char *const *in,
+	  unsigned char *const *out, int len)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	int off;
+
+	for (off = 0; off + 16 <= len; off += 16) {
+		__m128i x[N];
+		for (int i = 0; i < N; i++)
+			x[i] = _mm_loadu_si128((const __m128i *)
+					       (in[i] + off));
+		for (int r = 0; r < R; r++) {
+			__m128i acc = _mm_setzero_si128();
+			for (int i = 0; i < N; i++) {
+				__m128i lo, hi;
+				lo = _mm_loadu_si128((const __m128i *)
+						     t[r][i].lo);
+				hi = _mm_loadu_si128((const __m128i *)
+						     t[r][i].hi);
+				lo = _mm_shuffle_epi8(
+					lo, _mm_and_si128(x[i], mask));
+				hi = _mm_shuffle_epi8(
+					hi, _mm_and_si128(
+						_mm_srli_epi64(x[i], 4), mask));
+				acc = _mm_xor_si128(acc, _mm_xor_si128(lo, hi));
+			}
+			_mm_storeu_si128((__m128i *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range<N, R>(t, in, out, off, len);
+}
+
+template <int N, int R>
+__attribute__((target("avx2"))) void
+dot_avx2(const struct gib_simd_tab (*t)[N], unsigned char *const *in,
+	 unsigned char *const *out, int len)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	int off;
+
+	for (off = 0; off + 32 <= len; off += 32) {
+		__m256i x[N];
+		for (int i = 0; i < N; i++)
+			x[i] = _mm256_loadu_si256((const __m256i *)
+						  (in[i] + off));
+		for (int r = 0; r < R; r++) {
+			__m256i acc = _mm256_setzero_si256();
+			for (int i = 0; i < N; i++) {
+				__m256i lo, hi;
+				lo = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128((const __m128i *)
+							t[r][i].lo));
+				hi = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128((const __m128i *)
+							t[r][i].hi));
+				lo = _mm256_shuffle_epi8(
+					lo, _mm256_and_si256(x[i], mask));
+				hi = _mm256_shuffle_epi8(
+					hi, _mm256_and_si256(
+						_mm256_srli_epi64(x[i], 4),
+						mask));
+				acc = _mm256_xor_si256(
+					acc, _mm256_xor_si256(lo, hi));
+			}
+			_mm256_storeu_si256((__m256i *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range<N, R>(t, in, out, off, len);
+}
+
+template <int N, int R>
+__attribute__((target("avx512f,avx512bw"))) void
+dot_avx512(const struct gib_simd_tab (*t)[N], unsigned char *const *in,
+	   unsigned char *const *out, int len)
+{
+	const __m512i mask = _mm512_set1_epi8(0x0f);
+	int off;
+
+	for (off = 0; off + 64 <= len; off += 64) {
+		__m512i x[N];
+		for (int i = 0; i < N; i++)
+			x[i] = _mm512_loadu_si512((const void *)
+						  (in[i] + off));
+		for (int r = 0; r < R; r++) {
+			__m512i acc = _mm512_setzero_si512();
+			for (int i = 0; i < N; i++) {
+				__m512i lo, hi;
+				lo = _mm512_broadcast_i32x4(
+					_mm_loadu_si128((const __m128i *)
+							t[r][i].lo));
+				hi = _mm512_broadcast_i32x4(
+					_mm_loadu_si128((const __m128i *)
+							t[r][i].hi));
+				lo = _mm512_shuffle_epi8(
+					lo, _mm512_and_si512(x[i], mask));
+				hi = _mm512_shuffle_epi8(
+					hi, _mm512_and_si512(
+						_mm512_srli_epi64(x[i], 4),
+						mask));
+				acc = _mm512_xor_si512(
+					acc, _mm512_xor_si512(lo, hi));
+			}
+			_mm512_storeu_si512((void *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range<N, R>(t, in, out, off, len);
+}
+
+template <int N, int R>
+__attribute__((target("avx2,gfni"))) void
+dot_gfni_avx2(const struct gib_simd_tab (*t)[N], unsigned char *const *in,
+	      unsigned char *const *out, int len)
+{
+	int off;
+
+	for (off = 0; off + 32 <= len; off += 32) {
+		__m256i x[N];
+		for (int i = 0; i < N; i++)
+			x[i] = _mm256_loadu_si256((const __m256i *)
+						  (in[i] + off));
+		for (int r = 0; r < R; r++) {
+			__m256i acc = _mm256_setzero_si256();
+			for (int i = 0; i < N; i++) {
+				__m256i a = _mm256_set1_epi64x(
+					t[r][i].affine);
+				acc = _mm256_xor_si256(
+					acc, _mm256_gf2p8affine_epi64_epi8(
+						x[i], a, 0));
+			}
+			_mm256_storeu_si256((__m256i *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range<N, R>(t, in, out, off, len);
+}
+
+template <int N, int R>
+__attribute__((target("avx512f,avx512bw,gfni"))) void
+dot_gfni_avx512(const struct gib_simd_tab (*t)[N], unsigned char *const *in,
+		unsigned char *const *out, int len)
+{
+	int off;
+
+	for (off = 0; off + 64 <= len; off += 64) {
+		__m512i x[N];
+		for (int i = 0; i < N; i++)
+			x[i] = _mm512_loadu_si512((const void *)
+						  (in[i] + off));
+		for (int r = 0; r < R; r++) {
+			__m512i acc = _mm512_setzero_si512();
+			for (int i = 0; i < N; i++) {
+				__m512i a = _mm512_set1_epi64(
+					t[r][i].affine);
+				acc = _mm512_xor_si512(
+					acc, _mm512_gf2p8affine_epi64_epi8(
+						x[i], a, 0));
+			}
+			_mm512_storeu_si512((void *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range<N, R>(t, in, out, off, len);
+}
+#pragma GCC diagnostic pop
+#endif
+
+/* The kernel for isa, as gib_simd_get_dot picks it */
+template <int N, int R>
+dot_fn<N>
+get_dot(int isa)
+{
+	switch (isa) {
+#if GIB_HPP_X86
+	case GIB_SIMD_SSSE3:
+		return &dot_ssse3<N, R>;
+	case GIB_SIMD_AVX2:
+		return &dot_avx2<N, R>;
+	case GIB_SIMD_AVX512:
+		return &dot_avx512<N, R>;
+	case GIB_SIMD_GFNI_AVX2:
+		return &dot_gfni_avx2<N, R>;
+	case GIB_SIMD_GFNI_AVX512:
+		return &dot_gfni_avx512<N, R>;
+#endif
+	default:
+		return &dot_scalar<N, R>;
+	}
+}
+
+/* Evaluates f(0), ..., f(K-1) in order, for a pack expansion. */
+template <typename F, std::size_t... K>
+inline void
+unroll(F &&f, std::index_sequence<K...>)
+{
+	int dummy[] = { 0, (f(K), 0)... };
+	(void)dummy;
+}
+
+} /* namespace detail */
+
+template <int N, int M>
+class codec {
+	static_assert(N >= 1 && M >= 1 && N + M <= 256,
+		      "n + m buffers must fit GF(2^8)");
+
+	typedef std::make_index_sequence<M> parities;
+
+public:
+	static constexpr detail::coding_matrix<N, M> F =
+		detail::make_F<N, M>();
+	static constexpr detail::coding_rows<N, M> tab =
+		detail::make_rows<N, M>(F);
+	static constexpr detail::coding_tabs<N, M> vtab =
+		detail::make_tabs<N, M>(F);
+
+	/* parity[j] = sum over i of F[j][i] * data[i], for len bytes */
+	static void
+	encode(unsigned char *const *data, unsigned char *const *parity,
+	       int len)
+	{
+		kernels().encode(vtab.t, data, parity, len);
+	}
+
+	/* out[k] = sum over i of tabs[k][i] * survivors[i], for len bytes,
+	 * where tabs holds recover_last x N decoding tables.  Rows are
+	 * taken up to M at a time, by the kernel for that many.
+	 */
+	static void
+	decode(const struct gib_simd_tab (*tabs)[N],
+	       unsigned char *const *survivors, unsigned char *const *out,
+	       int recover_last, int len)
+	{
+		for (int k = 0; k < recover_last; k += M) {
+			int r = (recover_last - k < M) ? recover_last - k : M;
+			kernels().decode[r - 1](tabs + k, survivors, out + k,
+						len);
+		}
+	}
+
+	/* As gib_cpu_decode_rows, with the compile-time tables: invert
+	 * the survivors' rows of [I; F], and fold lost parity p in as
+	 * F[p] * inv.
+	 */
+	static int
+	decode_rows(const int *buf_ids, int recover_last,
+		    unsigned char (*rows)[N])
+	{
+		unsigned char a[N][N], v[N][N];
+
+		for (int i = 0; i < N; i++) {
+			int id = buf_ids[i];
+			for (int j = 0; j < N; j++) {
+				a[i][j] = (id < N) ? (id == j) :
+					F.F[id - N][j];
+				v[i][j] = (i == j);
+			}
+		}
+		for (int i = 0; i < N; i++) {
+			int p = i;
+			while (p < N && a[p][i] == 0)
+				p++;
+			if (p == N)
+				return GIB_ERR;
+			for (int j = 0; j < N; j++) {
+				std::swap(a[i][j], a[p][j]);
+				std::swap(v[i][j], v[p][j]);
+			}
+			unsigned char d = detail::inv(a[i][i]);
+			for (int j = 0; j < N; j++) {
+				a[i][j] = detail::mul(d, a[i][j]);
+				v[i][j] = detail::mul(d, v[i][j]);
+			}
+			for (int e = 0; e < N; e++) {
+				unsigned char x = a[e][i];
+				if (e == i || x == 0)
+					continue;
+				for (int j = 0; j < N; j++) {
+					a[e][j] ^= detail::mul(x, a[i][j]);
+					v[e][j] ^= detail::mul(x, v[i][j]);
+				}
+			}
+		}
+
+		for (int k = 0; k < recover_last; k++) {
+			int id = buf_ids[N + k];
+			for (int j = 0; j < N; j++) {
+				unsigned char acc = 0;
+				if (id < N) {
+					rows[k][j] = v[id][j];
+					continue;
+				}
+				/* Row id of [I; F] is F[id - N] */
+				for (int i = 0; i < N; i++)
+					acc ^= detail::mul(F.F[id - N][i],
+							   v[i][j]);
+				rows[k][j] = acc;
+			}
+		}
+		return GIB_SUC;
+	}
+
+	/* Creates a context whose dynamic_fp table runs this codec. */
+	static int
+	init(gib_context *c)
+	{
+		*c = (gib_context)malloc(sizeof(struct gib_context_t));
+		if (*c == NULL)
+			return GIB_OOM;
+		(*c)->F = (unsigned char *)malloc(M * N);
+		if ((*c)->F == NULL ||
+		    gib_plan_cache_create(GIB_PLAN_CACHE_SIZE,
+					  &(*c)->plans)) {
+			free((*c)->F);
+			free(*c);
+			return GIB_OOM;
+		}
+		memcpy((*c)->F, F.F, M * N);
+		(*c)->n = N;
+		(*c)->m = M;
+		/* The tables are static, and shared by all contexts */
+		(*c)->F_rows = NULL;
+		(*c)->table_bytes = 0;
+		(*c)->block = 1;
+		(*c)->acc_context = NULL;
+		(*c)->strategy = strategy();
+		return GIB_SUC;
+	}
+
+private:
+	/* The kernels for M rows, and for 1 to M rows */
+	struct kernel_set {
+		detail::dot_fn<N> encode;
+		detail::dot_fn<N> decode[M];
+	};
+
+	template <std::size_t... R>
+	static kernel_set
+	make_kernels(int isa, std::index_sequence<R...>)
+	{
+		kernel_set k = {
+			detail::get_dot<N, M>(isa),
+			{ detail::get_dot<N, (int)R + 1>(isa)... }
+		};
+		return k;
+	}
+
+	static const kernel_set &
+	kernels()
+	{
+		static const kernel_set k =
+			make_kernels(gib_simd_detect(), parities());
+		return k;
+	}
+
+	static struct dynamic_fp *
+	strategy()
+	{
+		static struct dynamic_fp fp = make_strategy();
+		return &fp;
+	}
+
+	static struct dynamic_fp
+	make_strategy()
+	{
+		struct dynamic_fp fp;
+
+		memset(&fp, 0, sizeof(fp));
+		fp.gib_destroy = &_gib_destroy;
+		fp.gib_alloc = &gib_cpu_alloc;
+		fp.gib_free = &_gib_free;
+		fp.gib_generate = &_gib_generate;
+		fp.gib_generate_nc = &_gib_generate_nc;
+		fp.gib_recover = &_gib_recover;
+		fp.gib_recover_nc = &_gib_recover_nc;
+		fp.gib_recover_sparse = &gib_cpu_recover_sparse;
+		fp.gib_recover_sparse_nc = &gib_cpu_recover_sparse_nc;
+		fp.gib_generate_iov = &_gib_generate_iov;
+		fp.gib_recover_iov = &_gib_recover_iov;
+		fp.gib_update_cols = &_gib_update_cols;
+		return fp;
+	}
+
+	static void
+	plan_free(void *priv)
+	{
+		free(priv);
+	}
+
+	/* Plans hold the tables of the decoding rows for decode(). */
+	static int
+	plan_build(gib_context c, int *buf_ids, struct gib_plan *plan)
+	{
+		int r = plan->recover_last;
+		unsigned char (*rows)[N];
+		struct gib_simd_tab (*tabs)[N];
+
+		plan->rows = (unsigned char *)malloc(r * N);
+		if (plan->rows == NULL)
+			return GIB_OOM;
+		rows = (unsigned char (*)[N])plan->rows;
+		if (decode_rows(buf_ids, r, rows))
+			return GIB_ERR;
+		tabs = (struct gib_simd_tab (*)[N])
+			malloc(r * N * sizeof(struct gib_simd_tab));
+		if (tabs == NULL)
+			return GIB_OOM;
+		for (int k = 0; k < r; k++)
+			for (int i = 0; i < N; i++)
+				tabs[k][i] = detail::make_tab(rows[k][i]);
+		plan->priv = tabs;
+		plan->priv_free = &plan_free;
+		plan->bytes += r * N + r * N * sizeof(struct gib_simd_tab);
+		return GIB_SUC;
+	}
+
+	static int
+	_gib_destroy(gib_context c)
+	{
+		gib_plan_cache_destroy(c->plans);
+		free(c->F);
+		free(c);
+		return GIB_SUC;
+	}
+
+	static int
+	_gib_free(void *buffers, gib_context c)
+	{
+		return gib_cpu_free(buffers);
+	}
+
+	static int
+	_gib_generate(void *buffers, int buf_size, gib_context c)
+	{
+		return _gib_generate_nc(buffers, buf_size, buf_size, c);
+	}
+
+	static int
+	_gib_generate_nc(void *buffers, int buf_size, int work_size,
+			 gib_context c)
+	{
+		unsigned char *buf = (unsigned char *)buffers;
+		unsigned char *in[N], *out[M];
+
+		for (int i = 0; i < N; i++)
+			in[i] = buf + i * buf_size;
+		for (int j = 0; j < M; j++)
+			out[j] = buf + (N + j) * buf_size;
+		encode(in, out, work_size);
+		return GIB_SUC;
+	}
+
+	static int
+	_gib_recover(void *buffers, int buf_size, int *buf_ids,
+		     int recover_last, gib_context c)
+	{
+		return _gib_recover_nc(buffers, buf_size, buf_size, buf_ids,
+				       recover_last, c);
+	}
+
+	static int
+	_gib_recover_nc(void *buffers, int buf_size, int work_size,
+			int *buf_ids, int recover_last, gib_context c)
+	{
+		unsigned char *buf = (unsigned char *)buffers;
+		unsigned char *in[N], *out[N + M];
+
+		for (int i = 0; i < N; i++)
+			in[i] = buf + i * buf_size;
+		for (int k = 0; k < recover_last; k++)
+			out[k] = buf + (N + k) * buf_size;
+		return _gib_recover_iov(in, buf_ids, out, recover_last,
+					work_size, c);
+	}
+
+	static int
+	_gib_generate_iov(unsigned char **data, unsigned char **parity,
+			  int len, gib_context c)
+	{
+		encode(data, parity, len);
+		return GIB_SUC;
+	}
+
+	static int
+	_gib_recover_iov(unsigned char **survivors, int *buf_ids,
+			 unsigned char **out, int recover_last, int len,
+			 gib_context c)
+	{
+		struct gib_plan *plan;
+		int rc;
+
+		rc = gib_plan_get(c, buf_ids, recover_last, &plan_build,
+				  &plan);
+		if (rc)
+			return rc;
+		decode((const struct gib_simd_tab (*)[N])plan->priv,
+		       survivors, out, recover_last, len);
+		gib_plan_put(c, plan);
+		return GIB_SUC;
+	}
+
+	static int
+	_gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+			 unsigned char **new_data, unsigned char **parity,
+			 int len, gib_context c)
+	{
+		for (int i = 0; i < ncols; i++) {
+			int id = data_ids[i];
+			for (int b = 0; b < len; b++) {
+				unsigned char d = old_data[i][b] ^
+					new_data[i][b];
+				detail::unroll([&](std::size_t j) {
+					parity[j][b] ^= tab.rows[j][id][d];
+				}, parities());
+			}
+		}
+		return GIB_SUC;
+	}
+};
+
+template <int N, int M>
+constexpr detail::coding_matrix<N, M> codec<N, M>::F;
+template <int N, int M>
+constexpr detail::coding_rows<N, M> codec<N, M>::tab;
+template <int N, int M>
+constexpr detail::coding_tabs<N, M> codec<N, M>::vtab;
+
+/* Specialized contexts for the common shapes; GIB_ERR for any other. */
+inline int
+init_fixed(int n, int m, gib_context *c)
+{
+	if (n == 4 && m == 2)
+		return codec<4, 2>::init(c);
+	if (n == 6 && m == 3)
+		return codec<6, 3>::init(c);
+	if (n == 8 && m == 2)
+		return codec<8, 2>::init(c);
+	if (n == 10 && m == 4)
+		return codec<10, 4>::init(c);
+	if (n == 12 && m == 4)
+		return codec<12, 4>::init(c);
+	return GIB_ERR;
+}
+
+} /* namespace gib */
+
+#endif /*GIBRALTAR_HPP_*/
@@ -0,0 +1,243 @@
+/* gib_alloc.c: Allocator for stripes of coding buffers
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Stripes can be interleaved over all NUMA nodes.
+ * The header has a page of its own, to leave first touch to the caller.
+ *
+ */
+
+#include "gibraltar.h"
+#include "gib_alloc.h"
+#include "gib_numa.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define GIB_HUGE_PAGE (2UL << 20)
+/* From linux/mempolicy.h */
+#define GIB_MPOL_PREFERRED 1
+#define GIB_MPOL_INTERLEAVE 3
+
+/* GIB_ALLOC_NODE value for spreading pages over every node */
+#define GIB_NODE_INTERLEAVE -2
+
+enum {
+	GIB_PAGES_DEFAULT,
+	GIB_PAGES_THP,
+	GIB_PAGES_HUGETLB
+};
+
+/* Kept just below the first buffer, so that gib_stripe_free can find
+ * out how the stripe was allocated.  It is written at allocation, so
+ * it ends a page of its own: a page it shared with the first buffer
+ * would be placed on the allocating thread's node, before a NUMA
+ * caller could touch it first from the node meant to own it.
+ */
+struct gib_stripe_hdr {
+	void *base;
+	size_t map_len; /* 0 if base came from posix_memalign */
+};
+
+static size_t
+gib_alloc_align(void)
+{
+	char *env = getenv("GIB_ALLOC_ALIGN");
+	long align;
+
+	if (env == NULL)
+		return GIB_ALLOC_ALIGN;
+	/* Powers of two up to a page, which mmap can always honor */
+	align = atol(env);
+	if (align < GIB_ALLOC_ALIGN || align > 4096 || (align & (align - 1)))
+		return GIB_ALLOC_ALIGN;
+	return align;
+}
+
+static int
+gib_alloc_pages(void)
+{
+	char *env = getenv("GIB_ALLOC_HUGEPAGES");
+
+	if (env == NULL)
+		return GIB_PAGES_DEFAULT;
+	if (strcmp(env, "hugetlb") == 0)
+		return GIB_PAGES_HUGETLB;
+	if (strcmp(env, "thp") == 0)
+		return GIB_PAGES_THP;
+	return GIB_PAGES_DEFAULT;
+}
+
+static int
+gib_alloc_node(void)
+{
+	char *env = getenv("GIB_ALLOC_NODE");
+
+	if (env == NULL || *env == '\0')
+		return -1;
+	if (strcmp(env, "interleave") == 0)
+		return GIB_NODE_INTERLEAVE;
+	return atoi(env);
+}
+
+static size_t
+gib_alloc_lcm(size_t a, size_t b)
+{
+	size_t x = a, y = b, t;
+
+	while (y != 0) {
+		t = x % y;
+		x = y;
+		y = t;
+	}
+	return a / x * b;
+}
+
+/* Maps len bytes of anonymous memory.  Explicit huge pages are tried
+ * first if asked for; when the pool is empty, fall back to ordinary
+ * pages, aligned and advised so that transparent huge pages can back
+ * them instead.
+ */
+static void *
+gib_alloc_map(size_t len, int pages, size_t *map_len)
+{
+	unsigned char *p, *start;
+	size_t extra = 0;
+
+#ifdef MAP_HUGETLB
+	if (pages == GIB_PAGES_HUGETLB) {
+		*map_len = (len + GIB_HUGE_PAGE - 1) & ~(GIB_HUGE_PAGE - 1);
+		p = mmap(NULL, *map_len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+			return p;
+	}
+#endif
+	if (pages != GIB_PAGES_DEFAULT) {
+		len = (len + GIB_HUGE_PAGE - 1) & ~(GIB_HUGE_PAGE - 1);
+		extra = GIB_HUGE_PAGE;
+	} else {
+		size_t page = sysconf(_SC_PAGESIZE);
+
+		len = (len + page - 1) & ~(page - 1);
+	}
+
+	p = mmap(NULL, len + extra, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	/* Trim the mapping to a huge page boundary at both ends */
+	start = p;
+	if (extra) {
+		start = (unsigned char *)
+			(((unsigned long)p + GIB_HUGE_PAGE - 1) &
+			 ~(GIB_HUGE_PAGE - 1));
+		if (start != p)
+			munmap(p, start - p);
+		if (start + len != p + len + extra)
+			munmap(start + len, p + extra - start);
+#ifdef MADV_HUGEPAGE
+		madvise(start, len, MADV_HUGEPAGE);
+#endif
+	}
+	*map_len = len;
+	return start;
+}
+
+/* Prefers node for the pages of [p, p + len), or spreads them over all
+ * nodes.  This is only advice: the kernel falls back to other nodes
+ * when node is full, and errors (no NUMA support, a bad node) leave
+ * the default policy in place.  The system call is made directly to
+ * avoid a dependency on libnuma.
+ */
+static void
+gib_alloc_bind(void *p, size_t len, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	unsigned long mask[16];
+	int bits = 8 * sizeof(mask[0]);
+	int i, id, mode = GIB_MPOL_PREFERRED;
+
+	memset(mask, 0, sizeof(mask));
+	if (node == GIB_NODE_INTERLEAVE) {
+		mode = GIB_MPOL_INTERLEAVE;
+		for (i = 0; i < gib_numa_nodes(); i++) {
+			id = gib_numa_id(i);
+			if (id < 16 * bits)
+				mask[id / bits] |= 1UL << (id % bits);
+		}
+	} else if (node >= 0 && node < 16 * bits) {
+		mask[node / bits] = 1UL << (node % bits);
+	} else {
+		return;
+	}
+	syscall(SYS_mbind, p, len, mode, mask, 16 * bits + 1, 0);
+#endif
+}
+
+int
+gib_stripe_alloc(int count, int buf_size, int unit, void **buffers,
+		 int *ld)
+{
+	size_t align = gib_alloc_align();
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t step, stride, len, map_len = 0;
+	int pages = gib_alloc_pages();
+	int node = gib_alloc_node();
+	struct gib_stripe_hdr *hdr;
+	void *base;
+
+	/* With an even number of units, buffer i and buffer i + k for
+	 * some small k would start in the same cache sets.  An odd
+	 * number is coprime with the set count, so the starts of a
+	 * stripe cycle through all sets before repeating.
+	 */
+	step = gib_alloc_lcm(align, unit > 0 ? unit : 1);
+	stride = (buf_size + step - 1) / step * step;
+	if (count > 1 && (stride / step) % 2 == 0)
+		stride += step;
+
+	/* The header's page keeps the buffers page aligned */
+	len = (size_t)count * stride + page;
+	if (pages == GIB_PAGES_DEFAULT && node == -1) {
+		if (posix_memalign(&base, page, len))
+			return GIB_OOM;
+	} else {
+		base = gib_alloc_map(len, pages, &map_len);
+		if (base == NULL)
+			return GIB_OOM;
+		if (node != -1)
+			gib_alloc_bind(base, map_len, node);
+	}
+
+	*buffers = (unsigned char *)base + page;
+	hdr = (struct gib_stripe_hdr *)*buffers - 1;
+	hdr->base = base;
+	hdr->map_len = map_len;
+	if (ld != NULL)
+		*ld = stride;
+	return GIB_SUC;
+}
+
+void
+gib_stripe_free(void *buffers)
+{
+	struct gib_stripe_hdr *hdr;
+
+	if (buffers == NULL)
+		return;
+	hdr = (struct gib_stripe_hdr *)buffers - 1;
+	if (hdr->map_len)
+		munmap(hdr->base, hdr->map_len);
+	else
+		free(hdr->base);
+}
@@ -0,0 +1,932 @@
+/* gib_async.c: Asynchronous generate and recover requests
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Requests travel on lock-free rings, with spin-then-futex waiting.
+ * Requests belong to priority classes with shares and rate budgets.
+ * Chunks are cut at multiples of the context's block size.
+ * Submissions name their class, falling back to the thread's.
+ * Completions that do not fit in the ring wait on a list, not dropped.
+ *
+ */
+
+/* Requests are served by a set of worker threads that is started on
+ * the first submission and lives as long as the process.  Each request
+ * runs as gib_generate_nc or gib_recover_nc calls on its context, so a
+ * context may have several requests in flight at once, as with
+ * gib_ws_run.
+ *
+ * Every submitting thread gets a single-producer ring of its own for
+ * each class, so submitting takes a few stores and no lock.  Workers
+ * take requests from any ring; a flag per ring lets only one of them
+ * pop at a time, which keeps each ring single-consumer without making
+ * a worker wait.  Threads beyond GIB_ASYNC_MAX_RINGS share one
+ * multi-producer ring per class.  Once gib_async_fd has been called,
+ * completions are also posted to a multi-producer, multi-consumer ring
+ * for gib_async_reap.  When that is full they are chained, through the
+ * requests themselves, on an overflow list that gib_async_reap drains
+ * after it, so posting never fails and never waits for the reaper.
+ *
+ * Classes are scheduled by virtual time, as in start-time fair
+ * queueing: coding a chunk advances its class's clock by its bytes
+ * over the class's share, and workers serve the waiting class with
+ * the earliest clock.  A class idle for a while rejoins at the clock
+ * of the last class picked, rather than with credit saved up.  A class
+ * with a rate is also held to it by a token bucket.  Requests are run
+ * in chunks of about GIB_ASYNC_CHUNK bytes of input, cut at multiples
+ * of the cache line and of the context's block size, and at each chunk
+ * boundary the worker first serves any class that has come due ahead
+ * of the one it is running.
+ *
+ * A request is referenced by the caller's handle, by the engine from
+ * submission until a worker has taken it off its ring, and by the
+ * overflow list while on it; it is freed when all have let go of it.
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_ring.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/* Default slots in each submission ring; GIB_ASYNC_DEPTH overrides it.
+ * The completion ring has GIB_ASYNC_CQ_FACTOR times as many.
+ */
+#define GIB_ASYNC_DEPTH 1024
+#define GIB_ASYNC_CQ_FACTOR 16
+#define GIB_ASYNC_MAX_RINGS 1024
+
+#define GIB_ASYNC_CLASSES 4
+#define GIB_ASYNC_CHUNK (256*1024)
+/* Longest a worker naps while only rate-limited work is waiting */
+#define GIB_ASYNC_NAP_NS 200000
+
+enum {
+	GIB_REQ_QUEUED,
+	GIB_REQ_RUNNING,
+	GIB_REQ_DONE
+};
+
+struct gib_request {
+	struct gib_context_t *c;
+	void *buffers;
+	int buf_size;
+	int work_size;
+	int recover_last; /* -1 for generate */
+	gib_async_fn fn;
+	void *arg;
+	int cls;
+	unsigned long submitted; /* ns */
+
+	int state;
+	int rc;
+	int refs;
+	struct gib_event done;
+	struct gib_request *spilled; /* Next on the overflow list */
+	int buf_ids[]; /* Copied, so the caller's may go away */
+};
+
+struct gib_async_ring {
+	struct gib_spsc q;
+	struct gib_event space; /* The producer sleeps here when q is full */
+	int owned; /* A live thread submits through it */
+	int consuming; /* A worker is popping from it */
+	struct gib_async_ring *sibling; /* Next ring of the same thread */
+	char pad[GIB_RING_LINE];
+};
+
+struct gib_async_class {
+	struct gib_async_ring *rings[GIB_ASYNC_MAX_RINGS];
+	int nrings; /* Entries of rings handed out */
+	struct gib_mpmc shared; /* For threads without a ring */
+
+	/* Under gib_async.lock */
+	int share;
+	unsigned long rate; /* Bytes per second, 0 for no limit */
+	double tokens;
+	unsigned long refilled; /* ns */
+	unsigned long vtime;
+
+	struct gib_class_stats stats;
+	char pad[GIB_RING_LINE];
+};
+
+struct gib_async_worker {
+	int next; /* Ring to look at first */
+	struct gib_request *req;
+	unsigned long nap; /* ns until rate-limited work may run */
+	char pad[GIB_RING_LINE];
+};
+
+static struct {
+	struct gib_event work; /* Idle workers sleep here */
+	char pad[GIB_RING_LINE];
+	pthread_spinlock_t lock; /* Scheduling state of the classes */
+	unsigned long vnow; /* Virtual time of the last class picked */
+	int chunk;
+	struct gib_async_class classes[GIB_ASYNC_CLASSES];
+	unsigned long depth;
+	struct gib_async_worker *workers;
+	int nworkers;
+
+	struct gib_mpmc cq;
+	int reaping; /* gib_async_fd has been called */
+	int armed; /* The next completion posted signals fd */
+	int fd;
+	pthread_mutex_t spill_lock; /* Of the overflow list */
+	struct gib_request *spill_head;
+	struct gib_request **spill_tail;
+	unsigned long nspilled; /* On the list now */
+	unsigned long overflows;
+	unsigned long signals;
+	int rc; /* Of starting the engine, 0 (GIB_SUC) until then */
+} gib_async = {
+	.armed = 1,
+	.fd = -1,
+	.spill_lock = PTHREAD_MUTEX_INITIALIZER,
+	.spill_tail = &gib_async.spill_head,
+};
+static pthread_once_t gib_async_once = PTHREAD_ONCE_INIT;
+static pthread_key_t gib_async_key;
+static __thread struct gib_async_ring *gib_async_mine[GIB_ASYNC_CLASSES];
+static __thread int gib_async_cls;
+
+static unsigned long
+gib_async_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void
+gib_async_put(struct gib_request *req)
+{
+	if (__sync_sub_and_fetch(&req->refs, 1) == 0)
+		free(req);
+}
+
+/* The fd is written once per batch: the completion that finds it armed
+ * signals it, and gib_async_reap arms it again once the ring is empty.
+ */
+static void
+gib_async_post(struct gib_request *req, int rc)
+{
+	uint64_t one = 1;
+	ssize_t ret;
+
+	if (gib_mpmc_push(&gib_async.cq, req->arg, rc) != GIB_SUC) {
+		__sync_fetch_and_add(&req->refs, 1);
+		req->spilled = NULL;
+		pthread_mutex_lock(&gib_async.spill_lock);
+		*gib_async.spill_tail = req;
+		gib_async.spill_tail = &req->spilled;
+		__atomic_store_n(&gib_async.nspilled, gib_async.nspilled + 1,
+				 __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&gib_async.spill_lock);
+		__sync_fetch_and_add(&gib_async.overflows, 1);
+	}
+	__sync_synchronize();
+	if (__sync_lock_test_and_set(&gib_async.armed, 0) == 1 &&
+	    gib_async.fd >= 0) {
+		__sync_fetch_and_add(&gib_async.signals, 1);
+		ret = write(gib_async.fd, &one, sizeof(one));
+		(void)ret;
+	}
+}
+
+/* The callback runs first, so that once gib_wait returns or the
+ * completion is posted, the callback has finished.
+ */
+static void
+gib_async_complete(struct gib_request *req, int rc)
+{
+	if (req->fn != NULL)
+		req->fn(req, rc, req->arg);
+	req->rc = rc;
+	__atomic_store_n(&req->state, GIB_REQ_DONE, __ATOMIC_RELEASE);
+	gib_event_notify(&req->done, 1);
+	if (__atomic_load_n(&gib_async.reaping, __ATOMIC_ACQUIRE))
+		gib_async_post(req, rc);
+}
+
+static int
+gib_async_pending(struct gib_async_class *cl)
+{
+	int i, n = __atomic_load_n(&cl->nrings, __ATOMIC_ACQUIRE);
+	struct gib_async_ring *r;
+
+	if (n > GIB_ASYNC_MAX_RINGS)
+		n = GIB_ASYNC_MAX_RINGS;
+	for (i = 0; i < n; i++) {
+		r = __atomic_load_n(&cl->rings[i], __ATOMIC_ACQUIRE);
+		if (r != NULL && gib_spsc_count(&r->q) != 0)
+			return 1;
+	}
+	return gib_mpmc_count(&cl->shared) != 0;
+}
+
+static struct gib_request *
+gib_async_take(struct gib_async_worker *w, struct gib_async_class *cl)
+{
+	int i, k, n = __atomic_load_n(&cl->nrings, __ATOMIC_ACQUIRE);
+	struct gib_async_ring *r;
+	void *req;
+	long val;
+
+	if (n > GIB_ASYNC_MAX_RINGS)
+		n = GIB_ASYNC_MAX_RINGS;
+	for (k = 0; k < n; k++) {
+		i = (w->next + k) % n;
+		r = __atomic_load_n(&cl->rings[i], __ATOMIC_ACQUIRE);
+		if (r == NULL || gib_spsc_count(&r->q) == 0)
+			continue;
+		if (__sync_lock_test_and_set(&r->consuming, 1))
+			continue;
+		if (gib_spsc_pop(&r->q, &req, &val) != GIB_SUC) {
+			__sync_lock_release(&r->consuming);
+			continue;
+		}
+		__sync_lock_release(&r->consuming);
+		gib_event_notify(&r->space, 0);
+		w->next = i + 1;
+		return req;
+	}
+	if (gib_mpmc_pop(&cl->shared, &req, &val) == GIB_SUC)
+		return req;
+	return NULL;
+}
+
+/* How long a rate-limited class must wait before running more, 0 if it
+ * may run now.  Its token bucket holds up to a tenth of a second's
+ * worth of bytes.  Called under gib_async.lock.
+ */
+static unsigned long
+gib_async_held(struct gib_async_class *cl, unsigned long *now)
+{
+	double burst = cl->rate / 10.0;
+
+	if (cl->rate == 0)
+		return 0;
+	if (*now == 0)
+		*now = gib_async_now();
+	cl->tokens += (double)cl->rate * (*now - cl->refilled) / 1e9;
+	if (cl->tokens > burst)
+		cl->tokens = burst;
+	cl->refilled = *now;
+	if (cl->tokens > 0)
+		return 0;
+	return -cl->tokens * 1e9 / cl->rate + 1;
+}
+
+/* Takes a request from the class that should run next: the waiting
+ * class with the earliest virtual time among those within their rate.
+ * With below >= 0, only from a class due before class below, or from
+ * any class if below has used up its rate.  If only rate-limited work
+ * is waiting, w->nap says how long until it may run.
+ */
+static struct gib_request *
+gib_async_pick(struct gib_async_worker *w, int below)
+{
+	struct gib_async_class *cl;
+	unsigned long now = 0, nap;
+	int k, best = -1, pending = 0;
+
+	for (k = 0; k < GIB_ASYNC_CLASSES; k++)
+		if (k != below && gib_async_pending(&gib_async.classes[k]))
+			pending |= 1 << k;
+	if (pending == 0)
+		return NULL;
+
+	pthread_spin_lock(&gib_async.lock);
+	for (k = 0; k < GIB_ASYNC_CLASSES; k++) {
+		if (!(pending & (1 << k)))
+			continue;
+		cl = &gib_async.classes[k];
+		if (cl->vtime < gib_async.vnow)
+			cl->vtime = gib_async.vnow;
+		nap = gib_async_held(cl, &now);
+		if (nap != 0) {
+			if (w->nap == 0 || nap < w->nap)
+				w->nap = nap;
+			continue;
+		}
+		if (best < 0 || cl->vtime < gib_async.classes[best].vtime)
+			best = k;
+	}
+	cl = &gib_async.classes[below < 0 ? 0 : below];
+	if (best >= 0 && below >= 0 &&
+	    gib_async.classes[best].vtime >= cl->vtime &&
+	    gib_async_held(cl, &now) == 0)
+		best = -1;
+	if (best >= 0)
+		gib_async.vnow = gib_async.classes[best].vtime;
+	pthread_spin_unlock(&gib_async.lock);
+
+	if (best < 0)
+		return NULL;
+	return gib_async_take(w, &gib_async.classes[best]);
+}
+
+static void
+gib_async_nap(unsigned long ns)
+{
+	struct timespec ts;
+
+	if (ns > GIB_ASYNC_NAP_NS)
+		ns = GIB_ASYNC_NAP_NS;
+	ts.tv_sec = 0;
+	ts.tv_nsec = ns;
+	nanosleep(&ts, NULL);
+}
+
+static void
+gib_async_charge(struct gib_async_class *cl, unsigned long bytes)
+{
+	pthread_spin_lock(&gib_async.lock);
+	cl->vtime += (bytes << 8) / cl->share;
+	if (cl->rate != 0) {
+		if (cl->tokens > 0 && cl->tokens <= bytes)
+			__sync_fetch_and_add(&cl->stats.throttled, 1);
+		cl->tokens -= bytes;
+	}
+	pthread_spin_unlock(&gib_async.lock);
+	__sync_fetch_and_add(&cl->stats.bytes, bytes);
+}
+
+static void gib_async_serve(struct gib_async_worker *w,
+			    struct gib_request *req, int nested);
+
+/* Byte ranges go through the noncontiguous entry points, as in
+ * gib_ws; a backend without them runs the request in one piece.
+ */
+static int
+gib_async_execute(struct gib_async_worker *w, struct gib_request *req,
+		  int nested)
+{
+	struct gib_async_class *cl = &gib_async.classes[req->cls];
+	struct gib_context_t *c = req->c;
+	struct gib_request *other;
+	int off, len, chunk = req->work_size, rc = GIB_SUC;
+	unsigned long now, nap;
+	int nc = (req->recover_last < 0) ?
+		(c->strategy->gib_generate_nc != NULL) :
+		(c->strategy->gib_recover_nc != NULL);
+	unsigned char *buf;
+
+	if (nc) {
+		chunk = gib_context_round(c, gib_async.chunk / c->n, 64);
+		if (chunk <= 0)
+			chunk = gib_context_round(c, 1, 64);
+	}
+	for (off = 0; off < req->work_size && rc == GIB_SUC; off += len) {
+		/* Chunk boundary: let a class that is due first go ahead,
+		 * and hold back while this one is over its rate.
+		 */
+		while (off > 0) {
+			other = nested ? NULL : gib_async_pick(w, req->cls);
+			if (other != NULL) {
+				__sync_fetch_and_add(&cl->stats.preemptions, 1);
+				gib_async_serve(w, other, 1);
+				continue;
+			}
+			if (__atomic_load_n(&cl->rate, __ATOMIC_RELAXED) == 0)
+				break;
+			now = 0;
+			pthread_spin_lock(&gib_async.lock);
+			nap = gib_async_held(cl, &now);
+			pthread_spin_unlock(&gib_async.lock);
+			if (nap == 0)
+				break;
+			gib_async_nap(nap);
+		}
+		len = (req->work_size - off < chunk) ?
+			req->work_size - off : chunk;
+		buf = (unsigned char *)req->buffers + off;
+		if (req->recover_last < 0)
+			rc = gib_generate_nc(buf, req->buf_size, len, c);
+		else
+			rc = gib_recover_nc(buf, req->buf_size, len,
+					    req->buf_ids, req->recover_last, c);
+		gib_async_charge(cl, (unsigned long)len * c->n);
+	}
+	return rc;
+}
+
+static void
+gib_async_serve(struct gib_async_worker *w, struct gib_request *req,
+		int nested)
+{
+	struct gib_class_stats *st = &gib_async.classes[req->cls].stats;
+	unsigned long latency, max;
+	int rc;
+
+	/* Lost to gib_cancel, which has completed it */
+	if (!__sync_bool_compare_and_swap(&req->state, GIB_REQ_QUEUED,
+					  GIB_REQ_RUNNING)) {
+		gib_async_put(req);
+		return;
+	}
+	rc = gib_async_execute(w, req, nested);
+
+	latency = gib_async_now() - req->submitted;
+	__sync_fetch_and_add(&st->completed, 1);
+	__sync_fetch_and_add(&st->latency_ns, latency);
+	max = __atomic_load_n(&st->max_latency_ns, __ATOMIC_RELAXED);
+	while (latency > max &&
+	       !__atomic_compare_exchange_n(&st->max_latency_ns, &max,
+					    latency, 1, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+	gib_async_complete(req, rc);
+	gib_async_put(req);
+}
+
+static int
+gib_async_ready(void *arg)
+{
+	struct gib_async_worker *w = arg;
+
+	w->nap = 0;
+	w->req = gib_async_pick(w, -1);
+	return w->req != NULL || w->nap != 0;
+}
+
+static void *
+gib_async_worker(void *arg)
+{
+	struct gib_async_worker *w = arg;
+
+	for (;;) {
+		gib_event_await(&gib_async.work, gib_async_ready, w);
+		if (w->req != NULL)
+			gib_async_serve(w, w->req, 0);
+		else /* Only rate-limited work is waiting */
+			gib_async_nap(w->nap);
+	}
+	return NULL;
+}
+
+/* Lets other threads take over the rings of one that has exited */
+static void
+gib_async_release(void *arg)
+{
+	struct gib_async_ring *r, *next;
+
+	for (r = arg; r != NULL; r = next) {
+		next = r->sibling;
+		__atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+	}
+}
+
+/* Reads a comma-separated list of up to GIB_ASYNC_CLASSES numbers */
+static void
+gib_async_getenv_list(const char *name, unsigned long *vals)
+{
+	char *env = getenv(name), *end;
+	int k;
+
+	for (k = 0; env != NULL && k < GIB_ASYNC_CLASSES; k++) {
+		vals[k] = strtoul(env, &end, 0);
+		if (*end != ',')
+			break;
+		env = end + 1;
+	}
+}
+
+/* GIB_ASYNC_THREADS sets the number of workers, all processors by
+ * default.
+ */
+static void
+gib_async_start(void)
+{
+	unsigned long shares[GIB_ASYNC_CLASSES];
+	unsigned long rates[GIB_ASYNC_CLASSES];
+	char *env = getenv("GIB_ASYNC_THREADS");
+	int i, nthreads = 0;
+	pthread_attr_t attr;
+	pthread_t thread;
+
+	if (env != NULL)
+		nthreads = atoi(env);
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	env = getenv("GIB_ASYNC_DEPTH");
+	gib_async.depth = GIB_ASYNC_DEPTH;
+	if (env != NULL && atoi(env) > 0)
+		gib_async.depth = atoi(env);
+	env = getenv("GIB_ASYNC_CHUNK");
+	gib_async.chunk = GIB_ASYNC_CHUNK;
+	if (env != NULL && atoi(env) > 0)
+		gib_async.chunk = atoi(env);
+
+	/* Each class gets half the share of the one before it */
+	for (i = 0; i < GIB_ASYNC_CLASSES; i++) {
+		shares[i] = 1 << (GIB_ASYNC_CLASSES - 1 - i);
+		rates[i] = 0;
+	}
+	gib_async_getenv_list("GIB_ASYNC_SHARES", shares);
+	gib_async_getenv_list("GIB_ASYNC_RATES", rates);
+	pthread_spin_init(&gib_async.lock, PTHREAD_PROCESS_PRIVATE);
+	for (i = 0; i < GIB_ASYNC_CLASSES; i++) {
+		struct gib_async_class *cl = &gib_async.classes[i];
+
+		cl->share = (shares[i] > 0) ? shares[i] : 1;
+		cl->rate = rates[i];
+		cl->refilled = gib_async_now();
+		if (gib_mpmc_init(&cl->shared, gib_async.depth)) {
+			gib_async.rc = GIB_OOM;
+			return;
+		}
+	}
+
+	gib_async.workers = calloc(nthreads, sizeof(struct gib_async_worker));
+	if (gib_async.workers == NULL ||
+	    gib_mpmc_init(&gib_async.cq,
+			  GIB_ASYNC_CQ_FACTOR * gib_async.depth) ||
+	    pthread_key_create(&gib_async_key, gib_async_release)) {
+		gib_async.rc = GIB_OOM;
+		return;
+	}
+#ifdef __linux__
+	gib_async.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&thread, &attr, gib_async_worker,
+				   &gib_async.workers[i]))
+			break;
+	pthread_attr_destroy(&attr);
+	gib_async.nworkers = i;
+	if (i == 0)
+		gib_async.rc = GIB_ERR;
+}
+
+/* The calling thread's submission ring for a class, NULL once they
+ * have run out.
+ */
+static struct gib_async_ring *
+gib_async_ring(int cls)
+{
+	struct gib_async_class *cl = &gib_async.classes[cls];
+	struct gib_async_ring *r;
+	void *p;
+	int i, n;
+
+	if (gib_async_mine[cls] != NULL)
+		return gib_async_mine[cls];
+
+	n = __atomic_load_n(&cl->nrings, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n && i < GIB_ASYNC_MAX_RINGS; i++) {
+		r = __atomic_load_n(&cl->rings[i], __ATOMIC_ACQUIRE);
+		if (r != NULL && __atomic_load_n(&r->owned, __ATOMIC_RELAXED)
+		    == 0 && __sync_bool_compare_and_swap(&r->owned, 0, 1))
+			goto found;
+	}
+
+	if (n >= GIB_ASYNC_MAX_RINGS ||
+	    posix_memalign(&p, GIB_RING_LINE, sizeof(struct gib_async_ring)))
+		return NULL;
+	r = p;
+	memset(r, 0, sizeof(struct gib_async_ring));
+	if (gib_spsc_init(&r->q, gib_async.depth)) {
+		free(r);
+		return NULL;
+	}
+	r->owned = 1;
+	i = __sync_fetch_and_add(&cl->nrings, 1);
+	if (i >= GIB_ASYNC_MAX_RINGS) {
+		gib_spsc_destroy(&r->q);
+		free(r);
+		return NULL;
+	}
+	__atomic_store_n(&cl->rings[i], r, __ATOMIC_RELEASE);
+
+found:
+	/* Chain the thread's rings, for gib_async_release */
+	r->sibling = pthread_getspecific(gib_async_key);
+	gib_async_mine[cls] = r;
+	pthread_setspecific(gib_async_key, r);
+	return r;
+}
+
+struct gib_async_push {
+	struct gib_async_class *cl;
+	struct gib_async_ring *r;
+	struct gib_request *req;
+};
+
+static int
+gib_async_pushed(void *arg)
+{
+	struct gib_async_push *p = arg;
+
+	if (p->r == NULL)
+		return gib_mpmc_push(&p->cl->shared, p->req, 0) == GIB_SUC;
+	return gib_spsc_push(&p->r->q, p->req, 0) == GIB_SUC;
+}
+
+static int
+gib_async_submit(void *buffers, int buf_size, int work_size, int *buf_ids,
+		 int recover_last, struct gib_context_t *c, int cls,
+		 gib_async_fn fn, void *arg, struct gib_request **req)
+{
+	struct gib_async_push p;
+	struct gib_request *r;
+	int nids = (recover_last < 0) ? 0 : c->n + recover_last;
+
+	if (cls < 0)
+		cls = gib_async_cls;
+	if (cls >= GIB_ASYNC_CLASSES)
+		return GIB_ERR;
+	pthread_once(&gib_async_once, gib_async_start);
+	if (gib_async.rc != GIB_SUC)
+		return gib_async.rc;
+
+	r = malloc(sizeof(struct gib_request) + nids * sizeof(int));
+	if (r == NULL)
+		return GIB_OOM;
+	r->c = c;
+	r->buffers = buffers;
+	r->buf_size = buf_size;
+	r->work_size = work_size;
+	r->recover_last = recover_last;
+	r->fn = fn;
+	r->arg = arg;
+	r->cls = cls;
+	r->submitted = gib_async_now();
+	r->state = GIB_REQ_QUEUED;
+	r->rc = GIB_BUSY;
+	r->refs = (req != NULL) ? 2 : 1;
+	memset(&r->done, 0, sizeof(r->done));
+	if (nids > 0)
+		memcpy(r->buf_ids, buf_ids, nids * sizeof(int));
+	if (req != NULL)
+		*req = r;
+
+	/* A full ring waits for a worker to make room */
+	p.cl = &gib_async.classes[r->cls];
+	p.r = gib_async_ring(r->cls);
+	p.req = r;
+	if (!gib_async_pushed(&p)) {
+		if (p.r != NULL)
+			gib_event_await(&p.r->space, gib_async_pushed, &p);
+		else
+			while (!gib_async_pushed(&p))
+				sched_yield();
+	}
+	gib_event_notify(&gib_async.work, 0);
+	return GIB_SUC;
+}
+
+int
+gib_generate_async(void *buffers, int buf_size, int work_size,
+		   struct gib_context_t *c, int cls, gib_async_fn fn,
+		   void *arg, struct gib_request **req)
+{
+	return gib_async_submit(buffers, buf_size, work_size, NULL, -1, c,
+				cls, fn, arg, req);
+}
+
+int
+gib_recover_async(void *buffers, int buf_size, int work_size, int *buf_ids,
+		  int recover_last, struct gib_context_t *c, int cls,
+		  gib_async_fn fn, void *arg, struct gib_request **req)
+{
+	if (recover_last < 0 || c->n + recover_last > 256)
+		return GIB_ERR;
+	return gib_async_submit(buffers, buf_size, work_size, buf_ids,
+				recover_last, c, cls, fn, arg, req);
+}
+
+int
+gib_poll(struct gib_request *req)
+{
+	if (__atomic_load_n(&req->state, __ATOMIC_ACQUIRE) != GIB_REQ_DONE)
+		return GIB_BUSY;
+	return req->rc;
+}
+
+static int
+gib_async_done(void *arg)
+{
+	struct gib_request *req = arg;
+
+	return __atomic_load_n(&req->state, __ATOMIC_ACQUIRE) ==
+		GIB_REQ_DONE;
+}
+
+int
+gib_wait(struct gib_request *req)
+{
+	gib_event_await(&req->done, gib_async_done, req);
+	return req->rc;
+}
+
+/* The request stays on its ring; the worker that takes it off finds it
+ * already claimed, and only drops the engine's reference.
+ */
+int
+gib_cancel(struct gib_request *req)
+{
+	if (!__sync_bool_compare_and_swap(&req->state, GIB_REQ_QUEUED,
+					  GIB_REQ_RUNNING))
+		return GIB_ERR;
+	gib_async_complete(req, GIB_CANCELED);
+	return GIB_SUC;
+}
+
+int
+gib_request_free(struct gib_request *req)
+{
+	gib_async_put(req);
+	return GIB_SUC;
+}
+
+int
+gib_async_set_class(int cls)
+{
+	if (cls < 0 || cls >= GIB_ASYNC_CLASSES)
+		return GIB_ERR;
+	gib_async_cls = cls;
+	return GIB_SUC;
+}
+
+int
+gib_async_class_config(int cls, int share, unsigned long rate)
+{
+	struct gib_async_class *cl;
+
+	if (cls < 0 || cls >= GIB_ASYNC_CLASSES || share <= 0)
+		return GIB_ERR;
+	pthread_once(&gib_async_once, gib_async_start);
+	if (gib_async.rc != GIB_SUC)
+		return gib_async.rc;
+
+	cl = &gib_async.classes[cls];
+	pthread_spin_lock(&gib_async.lock);
+	cl->share = share;
+	if (cl->rate == 0 && rate != 0) {
+		cl->tokens = 0;
+		cl->refilled = gib_async_now();
+	}
+	__atomic_store_n(&cl->rate, rate, __ATOMIC_RELAXED);
+	pthread_spin_unlock(&gib_async.lock);
+	return GIB_SUC;
+}
+
+int
+gib_async_class_stats(int cls, struct gib_class_stats *s)
+{
+	struct gib_async_class *cl;
+	struct gib_async_ring *r;
+	int i, n;
+
+	if (cls < 0 || cls >= GIB_ASYNC_CLASSES)
+		return GIB_ERR;
+	memset(s, 0, sizeof(*s));
+	if (gib_async.nworkers == 0)
+		return GIB_SUC;
+
+	cl = &gib_async.classes[cls];
+	pthread_spin_lock(&gib_async.lock);
+	s->share = cl->share;
+	s->rate = cl->rate;
+	pthread_spin_unlock(&gib_async.lock);
+	n = __atomic_load_n(&cl->nrings, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n && i < GIB_ASYNC_MAX_RINGS; i++) {
+		r = __atomic_load_n(&cl->rings[i], __ATOMIC_ACQUIRE);
+		if (r == NULL)
+			continue;
+		s->submitted += __atomic_load_n(&r->q.tail, __ATOMIC_RELAXED);
+		s->queued += gib_spsc_count(&r->q);
+	}
+	s->submitted += __atomic_load_n(&cl->shared.tail, __ATOMIC_RELAXED);
+	s->queued += gib_mpmc_count(&cl->shared);
+	s->completed = __atomic_load_n(&cl->stats.completed,
+				       __ATOMIC_RELAXED);
+	s->bytes = __atomic_load_n(&cl->stats.bytes, __ATOMIC_RELAXED);
+	s->latency_ns = __atomic_load_n(&cl->stats.latency_ns,
+					__ATOMIC_RELAXED);
+	s->max_latency_ns = __atomic_load_n(&cl->stats.max_latency_ns,
+					    __ATOMIC_RELAXED);
+	s->preemptions = __atomic_load_n(&cl->stats.preemptions,
+					 __ATOMIC_RELAXED);
+	s->throttled = __atomic_load_n(&cl->stats.throttled,
+				       __ATOMIC_RELAXED);
+	return GIB_SUC;
+}
+
+int
+gib_async_fd(void)
+{
+	pthread_once(&gib_async_once, gib_async_start);
+	__atomic_store_n(&gib_async.reaping, 1, __ATOMIC_RELEASE);
+	return gib_async.fd;
+}
+
+/* Takes completions from the ring, then from the overflow list */
+static int
+gib_async_gather(struct gib_completion *out, int n, int max)
+{
+	struct gib_request *req;
+	void *arg;
+	long rc;
+
+	while (n < max && gib_mpmc_pop(&gib_async.cq, &arg, &rc) == GIB_SUC) {
+		out[n].arg = arg;
+		out[n].rc = rc;
+		n++;
+	}
+	if (n == max ||
+	    __atomic_load_n(&gib_async.nspilled, __ATOMIC_SEQ_CST) == 0)
+		return n;
+
+	pthread_mutex_lock(&gib_async.spill_lock);
+	while (n < max && (req = gib_async.spill_head) != NULL) {
+		gib_async.spill_head = req->spilled;
+		if (gib_async.spill_head == NULL)
+			gib_async.spill_tail = &gib_async.spill_head;
+		__atomic_store_n(&gib_async.nspilled, gib_async.nspilled - 1,
+				 __ATOMIC_RELAXED);
+		out[n].arg = req->arg;
+		out[n].rc = req->rc;
+		n++;
+		gib_async_put(req);
+	}
+	pthread_mutex_unlock(&gib_async.spill_lock);
+	return n;
+}
+
+int
+gib_async_reap(struct gib_completion *out, int max)
+{
+	int n;
+
+	n = gib_async_gather(out, 0, max);
+	if (n == max || gib_async.rc != GIB_SUC)
+		return n;
+
+	/* Empty: arm the fd, then take what was posted before that */
+	__atomic_store_n(&gib_async.armed, 1, __ATOMIC_SEQ_CST);
+	return gib_async_gather(out, n, max);
+}
+
+int
+gib_async_stats(struct gib_async_stats *s)
+{
+	struct gib_async_class *cl;
+	struct gib_async_ring *r;
+	int i, k, n;
+
+	memset(s, 0, sizeof(*s));
+	if (gib_async.nworkers == 0)
+		return GIB_SUC;
+
+	s->depth = gib_async.depth;
+	s->workers = gib_async.nworkers;
+	for (k = 0; k < GIB_ASYNC_CLASSES; k++) {
+		cl = &gib_async.classes[k];
+		n = __atomic_load_n(&cl->nrings, __ATOMIC_ACQUIRE);
+		for (i = 0; i < n && i < GIB_ASYNC_MAX_RINGS; i++) {
+			r = __atomic_load_n(&cl->rings[i], __ATOMIC_ACQUIRE);
+			if (r == NULL)
+				continue;
+			s->rings++;
+			s->submitted += __atomic_load_n(&r->q.tail,
+							__ATOMIC_RELAXED);
+			s->queued += gib_spsc_count(&r->q);
+			s->full_waits += __atomic_load_n(&r->space.sleeps,
+							 __ATOMIC_RELAXED);
+		}
+		s->submitted += __atomic_load_n(&cl->shared.tail,
+						__ATOMIC_RELAXED);
+		s->queued += gib_mpmc_count(&cl->shared);
+		s->completed += __atomic_load_n(&cl->stats.completed,
+						__ATOMIC_RELAXED);
+	}
+	s->sleeps = __atomic_load_n(&gib_async.work.sleeps, __ATOMIC_RELAXED);
+	s->wakeups = __atomic_load_n(&gib_async.work.wakeups,
+				     __ATOMIC_RELAXED);
+	s->completions = gib_mpmc_count(&gib_async.cq) +
+		__atomic_load_n(&gib_async.nspilled, __ATOMIC_RELAXED);
+	s->overflows = __atomic_load_n(&gib_async.overflows, __ATOMIC_RELAXED);
+	s->signals = __atomic_load_n(&gib_async.signals, __ATOMIC_RELAXED);
+	return GIB_SUC;
+}
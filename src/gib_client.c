@@ -0,0 +1,546 @@
+/* gib_client.c: Coding through the gibd daemon over shared memory
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+
+/* A client owns one shared segment, laid out as in gib_shm.h.  Its
+ * stripes are carved from the part after the header, first fit, and
+ * the bookkeeping for that and for the free tickets (request slots)
+ * stays in the client's own memory, out of the daemon's reach.
+ */
+
+#define _GNU_SOURCE
+#include "../inc/gibraltar.h"
+#include "../inc/gib_alloc.h"
+#include "../inc/gib_shm.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* How long, in ms, a waiter sleeps before looking for a hangup */
+#define GIB_CLIENT_POLL_MS 100
+
+struct gib_client_extent {
+	unsigned long off;
+	unsigned long len;
+	struct gib_client_extent *next;
+};
+
+struct gib_client {
+	int sock;
+	int bell;
+	struct gib_shm_header *shm;
+	unsigned long size;
+	int cls;
+	int dead; /* The daemon hung up */
+
+	pthread_mutex_t lock; /* Of the tickets and extents below */
+	int nfree;
+	int free_tickets[GIB_SHM_DEPTH];
+	struct gib_client_extent *holes; /* Free space, by offset */
+	struct gib_client_extent *stripes; /* Allocated space */
+};
+
+static void
+gib_client_drop(struct gib_client_extent *e)
+{
+	struct gib_client_extent *next;
+
+	for (; e != NULL; e = next) {
+		next = e->next;
+		free(e);
+	}
+}
+
+int
+gib_client_close(struct gib_client *cl)
+{
+	if (cl->sock >= 0)
+		close(cl->sock);
+	if (cl->bell >= 0)
+		close(cl->bell);
+	if (cl->shm != NULL)
+		munmap(cl->shm, cl->size);
+	gib_client_drop(cl->holes);
+	gib_client_drop(cl->stripes);
+	pthread_mutex_destroy(&cl->lock);
+	free(cl);
+	return GIB_SUC;
+}
+
+static void
+gib_client_init_shm(struct gib_client *cl)
+{
+	struct gib_shm_header *shm = cl->shm;
+	int i;
+
+	shm->magic = GIB_SHM_MAGIC;
+	shm->version = GIB_SHM_VERSION;
+	shm->size = cl->size;
+	shm->armed = 0;
+	gib_mpmc_init_in(&shm->sq, shm->sq_slots, GIB_SHM_DEPTH);
+	for (i = 0; i < GIB_SHM_DEPTH; i++) {
+		memset(&shm->reqs[i].done, 0, sizeof(struct gib_event));
+		shm->reqs[i].done.shared = 1;
+		shm->reqs[i].state = GIB_SHM_FREE;
+		cl->free_tickets[i] = GIB_SHM_DEPTH - 1 - i;
+	}
+	cl->nfree = GIB_SHM_DEPTH;
+}
+
+/* Hands the segment and doorbell to the daemon, and returns its answer */
+static int
+gib_client_hello(struct gib_client *cl, int memfd)
+{
+	struct gib_shm_hello hello;
+	union {
+		struct cmsghdr h;
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+	} ctl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int fds[2] = { memfd, cl->bell };
+	int reply;
+
+	hello.magic = GIB_SHM_MAGIC;
+	hello.version = GIB_SHM_VERSION;
+	hello.size = cl->size;
+	iov.iov_base = &hello;
+	iov.iov_len = sizeof(hello);
+	memset(&msg, 0, sizeof(msg));
+	memset(&ctl, 0, sizeof(ctl));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(cl->sock, &msg, MSG_NOSIGNAL) != sizeof(hello))
+		return GIB_ERR;
+	if (recv(cl->sock, &reply, sizeof(reply), 0) != sizeof(reply))
+		return GIB_ERR;
+	return reply;
+}
+
+int
+gib_shm_socket(char *path, char *dir, unsigned long len)
+{
+	const char *run = getenv("XDG_RUNTIME_DIR");
+	char buf[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	int ret;
+
+	if (run != NULL && run[0] != '\0')
+		ret = snprintf(buf, sizeof(buf), "%s", run);
+	else
+		ret = snprintf(buf, sizeof(buf), "/tmp/gibd-%u",
+			       (unsigned int)geteuid());
+	if (ret < 0 || (unsigned long)ret >= len)
+		return GIB_ERR;
+	if (dir != NULL)
+		strcpy(dir, buf);
+	ret = snprintf(path, len, "%s/%s", buf, GIB_SHM_SOCKET);
+	if (ret < 0 || (unsigned long)ret >= len)
+		return GIB_ERR;
+	return GIB_SUC;
+}
+
+/* Anyone could be listening at a path in a shared directory, and the
+ * stripes are handed to whoever is, so it must be the user or root.
+ */
+static int
+gib_client_peer(int sock)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) ||
+	    len != sizeof(cred))
+		return GIB_ERR;
+	if (cred.uid != geteuid() && cred.uid != 0)
+		return GIB_ERR;
+	return GIB_SUC;
+}
+
+int
+gib_client_connect(const char *path, unsigned long size,
+		   struct gib_client **client)
+{
+	struct sockaddr_un addr;
+	char def[sizeof(addr.sun_path)];
+	struct gib_client *cl;
+	void *shm;
+	int memfd, rc = GIB_ERR;
+
+	if (path == NULL)
+		path = getenv("GIB_SERVER");
+	if (path == NULL) {
+		if (gib_shm_socket(def, NULL, sizeof(def)) != GIB_SUC)
+			return GIB_ERR;
+		path = def;
+	}
+	if (size == 0)
+		size = GIB_SHM_SIZE;
+	size = (size + GIB_SHM_PAGE - 1) & ~(unsigned long)(GIB_SHM_PAGE - 1);
+	if (size <= GIB_SHM_DATA || strlen(path) >= sizeof(addr.sun_path))
+		return GIB_ERR;
+
+	cl = calloc(1, sizeof(struct gib_client));
+	if (cl == NULL)
+		return GIB_OOM;
+	cl->sock = cl->bell = -1;
+	cl->size = size;
+	pthread_mutex_init(&cl->lock, NULL);
+
+	/* Sealed, so that the daemon need not fear it shrinking */
+	memfd = memfd_create("gibraltar", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (memfd < 0)
+		goto fail;
+	if (ftruncate(memfd, size) ||
+	    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+		  F_SEAL_SEAL))
+		goto fail_fd;
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (shm == MAP_FAILED) {
+		rc = GIB_OOM;
+		goto fail_fd;
+	}
+	cl->shm = shm;
+	gib_client_init_shm(cl);
+
+	cl->holes = malloc(sizeof(struct gib_client_extent));
+	if (cl->holes == NULL) {
+		rc = GIB_OOM;
+		goto fail_fd;
+	}
+	cl->holes->off = GIB_SHM_DATA;
+	cl->holes->len = size - GIB_SHM_DATA;
+	cl->holes->next = NULL;
+
+	cl->bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	cl->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (cl->bell < 0 || cl->sock < 0)
+		goto fail_fd;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(cl->sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    gib_client_peer(cl->sock) != GIB_SUC)
+		goto fail_fd;
+	rc = gib_client_hello(cl, memfd);
+	if (rc != GIB_SUC)
+		goto fail_fd;
+
+	close(memfd);
+	*client = cl;
+	return GIB_SUC;
+
+fail_fd:
+	close(memfd);
+fail:
+	gib_client_close(cl);
+	return rc;
+}
+
+/* Stripes are laid out as by gib_alloc, with an odd number of
+ * alignment units between buffers.
+ */
+int
+gib_client_alloc(struct gib_client *cl, int n, int m, int buf_size,
+		 void **buffers, int *ld)
+{
+	struct gib_client_extent **p, *hole, *e;
+	unsigned long units, len;
+
+	if (n <= 0 || m <= 0 || buf_size <= 0)
+		return GIB_ERR;
+	units = (buf_size + GIB_ALLOC_ALIGN - 1) / GIB_ALLOC_ALIGN;
+	if (units % 2 == 0)
+		units++;
+	len = units * GIB_ALLOC_ALIGN * (n + m);
+
+	e = malloc(sizeof(struct gib_client_extent));
+	if (e == NULL)
+		return GIB_OOM;
+	pthread_mutex_lock(&cl->lock);
+	for (p = &cl->holes; *p != NULL && (*p)->len < len; p = &(*p)->next)
+		;
+	if (*p == NULL) {
+		pthread_mutex_unlock(&cl->lock);
+		free(e);
+		return GIB_OOM;
+	}
+	hole = *p;
+	e->off = hole->off;
+	e->len = len;
+	e->next = cl->stripes;
+	cl->stripes = e;
+	hole->off += len;
+	hole->len -= len;
+	if (hole->len == 0) {
+		*p = hole->next;
+		free(hole);
+	}
+	pthread_mutex_unlock(&cl->lock);
+
+	*buffers = (char *)cl->shm + e->off;
+	*ld = units * GIB_ALLOC_ALIGN;
+	return GIB_SUC;
+}
+
+int
+gib_client_free(struct gib_client *cl, void *buffers)
+{
+	unsigned long off = (char *)buffers - (char *)cl->shm;
+	struct gib_client_extent **p, *e, *prev = NULL, *next;
+
+	pthread_mutex_lock(&cl->lock);
+	for (p = &cl->stripes; *p != NULL && (*p)->off != off;
+	     p = &(*p)->next)
+		;
+	e = *p;
+	if (e == NULL) {
+		pthread_mutex_unlock(&cl->lock);
+		return GIB_ERR;
+	}
+	*p = e->next;
+
+	/* Back into the holes, merging with its neighbours */
+	for (next = cl->holes; next != NULL && next->off < off;
+	     next = next->next)
+		prev = next;
+	e->next = next;
+	if (prev != NULL)
+		prev->next = e;
+	else
+		cl->holes = e;
+	if (next != NULL && e->off + e->len == next->off) {
+		e->len += next->len;
+		e->next = next->next;
+		free(next);
+	}
+	if (prev != NULL && prev->off + prev->len == e->off) {
+		prev->len += e->len;
+		prev->next = e->next;
+		free(e);
+	}
+	pthread_mutex_unlock(&cl->lock);
+	return GIB_SUC;
+}
+
+int
+gib_client_set_class(struct gib_client *cl, int cls)
+{
+	if (cls < 0 || cls > GIB_CLASS_BACKGROUND)
+		return GIB_ERR;
+	cl->cls = cls;
+	return GIB_SUC;
+}
+
+static int
+gib_client_submit(struct gib_client *cl, int n, int m, void *buffers,
+		  int buf_size, int work_size, int *buf_ids, int recover_last,
+		  int *ticket)
+{
+	unsigned long off = (char *)buffers - (char *)cl->shm;
+	int nids = (recover_last < 0) ? 0 : n + recover_last;
+	struct gib_shm_header *shm = cl->shm;
+	struct gib_shm_req *req;
+	uint64_t one = 1;
+	ssize_t ret;
+	int t, rc;
+
+	if (n <= 0 || m <= 0 || n + m > 256 || recover_last > m ||
+	    (char *)buffers < (char *)shm + GIB_SHM_DATA ||
+	    off + (unsigned long)buf_size * (n + m) > cl->size)
+		return GIB_ERR;
+
+	pthread_mutex_lock(&cl->lock);
+	if (cl->dead || cl->nfree == 0) {
+		rc = cl->dead ? GIB_ERR : GIB_BUSY;
+		pthread_mutex_unlock(&cl->lock);
+		return rc;
+	}
+	t = cl->free_tickets[--cl->nfree];
+	pthread_mutex_unlock(&cl->lock);
+
+	req = &shm->reqs[t];
+	req->recover_last = recover_last;
+	req->n = n;
+	req->m = m;
+	req->cls = cl->cls;
+	req->buf_size = buf_size;
+	req->work_size = work_size;
+	req->buffers = off;
+	req->rc = GIB_BUSY;
+	if (nids > 0)
+		memcpy(req->buf_ids, buf_ids, nids * sizeof(int));
+	__atomic_store_n(&req->state, GIB_SHM_QUEUED, __ATOMIC_RELEASE);
+
+	/* There are only as many tickets as slots, so this cannot fail */
+	gib_mpmc_push_in(&shm->sq, shm->sq_slots, GIB_SHM_DEPTH, NULL, t);
+	__sync_synchronize();
+	if (__sync_lock_test_and_set(&shm->armed, 0) == 1) {
+		ret = write(cl->bell, &one, sizeof(one));
+		(void)ret;
+	}
+	*ticket = t;
+	return GIB_SUC;
+}
+
+int
+gib_client_generate_async(struct gib_client *cl, int n, int m,
+			  void *buffers, int buf_size, int work_size,
+			  int *ticket)
+{
+	return gib_client_submit(cl, n, m, buffers, buf_size, work_size,
+				 NULL, -1, ticket);
+}
+
+int
+gib_client_recover_async(struct gib_client *cl, int n, int m, void *buffers,
+			 int buf_size, int work_size, int *buf_ids,
+			 int recover_last, int *ticket)
+{
+	if (recover_last < 0)
+		return GIB_ERR;
+	return gib_client_submit(cl, n, m, buffers, buf_size, work_size,
+				 buf_ids, recover_last, ticket);
+}
+
+static struct gib_shm_req *
+gib_client_req(struct gib_client *cl, int ticket)
+{
+	if (ticket < 0 || ticket >= GIB_SHM_DEPTH ||
+	    cl->shm->reqs[ticket].state == GIB_SHM_FREE)
+		return NULL;
+	return &cl->shm->reqs[ticket];
+}
+
+static int
+gib_client_release(struct gib_client *cl, int ticket)
+{
+	struct gib_shm_req *req = &cl->shm->reqs[ticket];
+	int rc = req->rc;
+
+	req->state = GIB_SHM_FREE;
+	pthread_mutex_lock(&cl->lock);
+	cl->free_tickets[cl->nfree++] = ticket;
+	pthread_mutex_unlock(&cl->lock);
+	return rc;
+}
+
+/* gibd only closes its end once it is done with all of the client's
+ * requests, so after a hangup those not done never will be, and they
+ * are failed here.  Returns whether the daemon has gone.
+ */
+static int
+gib_client_hangup(struct gib_client *cl)
+{
+	struct pollfd pfd = { cl->sock, POLLRDHUP, 0 };
+	struct gib_shm_req *req;
+	int i;
+
+	if (!__atomic_load_n(&cl->dead, __ATOMIC_ACQUIRE) &&
+	    (poll(&pfd, 1, 0) <= 0 ||
+	     !(pfd.revents & (POLLHUP | POLLRDHUP | POLLERR))))
+		return 0;
+
+	pthread_mutex_lock(&cl->lock);
+	if (!cl->dead) {
+		for (i = 0; i < GIB_SHM_DEPTH; i++) {
+			req = &cl->shm->reqs[i];
+			if (req->state != GIB_SHM_QUEUED)
+				continue;
+			req->rc = GIB_ERR;
+			__atomic_store_n(&req->state, GIB_SHM_DONE,
+					 __ATOMIC_RELEASE);
+			gib_event_notify(&req->done, 1);
+		}
+		__atomic_store_n(&cl->dead, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&cl->lock);
+	return 1;
+}
+
+int
+gib_client_poll(struct gib_client *cl, int ticket)
+{
+	struct gib_shm_req *req = gib_client_req(cl, ticket);
+
+	if (req == NULL)
+		return GIB_ERR;
+	if (__atomic_load_n(&req->state, __ATOMIC_ACQUIRE) != GIB_SHM_DONE &&
+	    !gib_client_hangup(cl))
+		return GIB_BUSY;
+	return gib_client_release(cl, ticket);
+}
+
+static int
+gib_client_done(void *arg)
+{
+	struct gib_shm_req *req = arg;
+
+	return __atomic_load_n(&req->state, __ATOMIC_ACQUIRE) ==
+		GIB_SHM_DONE;
+}
+
+int
+gib_client_wait(struct gib_client *cl, int ticket)
+{
+	struct gib_shm_req *req = gib_client_req(cl, ticket);
+
+	if (req == NULL)
+		return GIB_ERR;
+	while (!gib_event_await_for(&req->done, gib_client_done, req,
+				    GIB_CLIENT_POLL_MS))
+		if (gib_client_hangup(cl))
+			break;
+	return gib_client_release(cl, ticket);
+}
+
+int
+gib_client_generate(struct gib_client *cl, int n, int m, void *buffers,
+		    int buf_size, int work_size)
+{
+	int rc, ticket;
+
+	rc = gib_client_generate_async(cl, n, m, buffers, buf_size,
+				       work_size, &ticket);
+	if (rc != GIB_SUC)
+		return rc;
+	return gib_client_wait(cl, ticket);
+}
+
+int
+gib_client_recover(struct gib_client *cl, int n, int m, void *buffers,
+		   int buf_size, int work_size, int *buf_ids,
+		   int recover_last)
+{
+	int rc, ticket;
+
+	rc = gib_client_recover_async(cl, n, m, buffers, buf_size,
+				      work_size, buf_ids, recover_last,
+				      &ticket);
+	if (rc != GIB_SUC)
+		return rc;
+	return gib_client_wait(cl, ticket);
+}
@@ -6,14 +6,33 @@
  *
  * Changes:
  * Initial version, Matthew L. Curry
+ * Replaced the byte-at-a-time loops with a cache-blocked driver.
+ * Recovery takes its decoding rows from the context's plan cache.
+ * Added the parity update path for small writes.
+ * Lost parity is recovered in the same pass as lost data.
+ * Implemented in-place sparse recovery.
+ * m = 1 contexts use XOR parity.
+ * Kernels read per-context expanded tables rather than gib_gf_table.
+ * Decoding matrices are allocated on the heap.
+ * Buffers come from the aligned stripe allocator.
+ * The tile size settings are read once.
  *
  */
 
 #include "../inc/gib_galois.h"
 #include "../inc/gib_cpu_funcs.h"
 #include "../inc/gib_context.h"
+#include "../inc/gib_plan_cache.h"
+#include "../inc/gib_alloc.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static pthread_once_t gib_cpu_tile_once = PTHREAD_ONCE_INIT;
+static long gib_cpu_l1_size;
+static int gib_cpu_tile_env; /* GIB_TILE_SIZE, 0 if unset */
 
 int
 gib_cpu_init (int n, int m, struct gib_context_t **c)
@@ -27,21 +46,40 @@ gib_cpu_init (int n, int m, struct gib_context_t **c)
 	if (*c == NULL)
 		return GIB_OOM;
 
+	(*c)->plans = NULL;
+	(*c)->F_rows = NULL;
+	(*c)->block = 1;
 	do {
+		rc = GIB_OOM;
 		(*c)->F = malloc(m*n);
 		if ((*c)->F == NULL)
 			break;
+		rc = gib_plan_cache_create(GIB_PLAN_CACHE_SIZE, &(*c)->plans);
+		if (rc)
+			break;
 
 		(*c)->n = n;
 		(*c)->m = m;
 		rc = gib_galois_gen_F((*c)->F, m, n);
 		if (rc)
 			break;
+		/* Any nonzero row is a valid single parity, and a row of
+		 * ones makes it plain XOR.
+		 */
+		if (m == 1)
+			memset((*c)->F, 1, n);
+		rc = gib_cpu_expand_rows((*c)->F, m*n, &(*c)->F_rows);
+		if (rc)
+			break;
+		(*c)->table_bytes = (unsigned long)m*n*256;
 
 		return 0;
 	} while (0);
 
+	if ((*c)->plans != NULL)
+		gib_plan_cache_destroy((*c)->plans);
 	free((*c)->F);
+	free((*c)->F_rows);
 	free(*c);
 	return rc;
 }
@@ -49,7 +87,9 @@ gib_cpu_init (int n, int m, struct gib_context_t **c)
 int
 gib_cpu_destroy(struct gib_context_t *c)
 {
+	gib_plan_cache_destroy(c->plans);
 	free(c->F);
+	free(c->F_rows);
 	free(c);
 	return 0;
 }
@@ -62,27 +102,18 @@ gib_cpu_alloc(void **buffers, int buf_size, int *ld, struct gib_context_t *c)
 	 * can continue assuming the buf_size is the same if he/she
 	 * wants, but the routines may run slower.
 	 *
-	 * Athough this CPU implementation is not performance-based,
-	 * it operates twice as fast if the stride is odd, so it is
-	 * done.
+	 * The stride used to be made odd, which kept the buffers from
+	 * aliasing each other in the cache but left them unaligned.
+	 * The stripe allocator gets the same effect with whole cache
+	 * lines.
 	 */
-	if (buf_size % 2 == 0)
-		buf_size += 1;
-
-	if (ld != NULL)
-		(*ld) = buf_size;
-
-	*buffers = malloc((c->n+c->m)*buf_size);
-	if (*buffers == NULL)
-		return GIB_OOM;
-
-	return 0;
+	return gib_stripe_alloc(c->n + c->m, buf_size, 1, buffers, ld);
 }
 
 int
 gib_cpu_free(void *buffers)
 {
-	free(buffers);
+	gib_stripe_free(buffers);
 	return 0;
 }
 
@@ -92,30 +123,135 @@ gib_cpu_generate(void *buffers, int buf_size, struct gib_context_t *c)
 	return gib_generate_nc(buffers, buf_size, buf_size, c);
 }
 
+/* The byte range each pass of the tiled driver works on.  A tile of
+ * every input and output buffer should fit in L1 together, so the
+ * default is the L1 data cache size divided by the number of buffers.
+ * GIB_TILE_SIZE overrides the cache size probe with a fixed tile size in
+ * bytes.  Both are looked at once, on first use.
+ */
+static void
+gib_cpu_tile_init(void)
+{
+	char *env = getenv("GIB_TILE_SIZE");
+	long sz = -1;
+
+	if (env != NULL && atoi(env) > 0)
+		gib_cpu_tile_env = atoi(env);
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+	sz = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+	gib_cpu_l1_size = (sz > 0) ? sz : 32*1024;
+}
+
+static int
+gib_cpu_tile_size(int nbufs)
+{
+	long tile;
+
+	pthread_once(&gib_cpu_tile_once, gib_cpu_tile_init);
+	if (gib_cpu_tile_env > 0)
+		return gib_cpu_tile_env;
+
+	tile = (gib_cpu_l1_size / nbufs) & ~63L;
+	return (tile < 64) ? 64 : (int)tile;
+}
+
+/* Copies the gib_gf_table row of each of count coefficients into one
+ * contiguous block, so that a stripe's kernels touch rows*cols*256 bytes
+ * of tables instead of rows scattered over the full 64 KiB table.
+ */
+int
+gib_cpu_expand_rows(const unsigned char *coefs, int count,
+		    unsigned char **rows)
+{
+	int i;
+
+	*rows = malloc((size_t)count * 256);
+	if (*rows == NULL)
+		return GIB_OOM;
+	for (i = 0; i < count; i++)
+		memcpy(*rows + (size_t)i * 256, gib_gf_table[coefs[i]], 256);
+	return 0;
+}
+
+/* Builds a plan's decoding rows along with their expanded tables. */
+int
+gib_cpu_plan_build(struct gib_context_t *c, int *buf_ids,
+		   struct gib_plan *plan)
+{
+	unsigned char *tabs;
+	int count = plan->recover_last * c->n;
+	int rc;
+
+	rc = gib_plan_build_rows(c, buf_ids, plan);
+	if (rc)
+		return rc;
+	rc = gib_cpu_expand_rows(plan->rows, count, &tabs);
+	if (rc)
+		return rc;
+	plan->priv = tabs;
+	plan->priv_free = free;
+	plan->bytes += (unsigned long)count * 256;
+	return 0;
+}
+
+/* Computes out[j] = sum over i of M[j*cols+i] * in[i] over the first
+ * len bytes of each buffer, where tabs holds the expanded row of each
+ * entry of M (see gib_cpu_expand_rows).  Rather than walking every
+ * buffer for each byte, the driver streams a tile of every buffer at a
+ * time, so that memory is touched sequentially and only one 256-byte
+ * row is live in the innermost loop.
+ */
+static void
+gib_cpu_tiled_dot(const unsigned char *tabs, int rows, int cols,
+		  unsigned char **in, unsigned char **out, int len)
+{
+	int tile = gib_cpu_tile_size(rows + cols);
+	int t, i, j, b, end;
+
+	for (t = 0; t < len; t += tile) {
+		end = (t + tile < len) ? t + tile : len;
+		for (j = 0; j < rows; j++) {
+			unsigned char *o = out[j];
+			for (i = 0; i < cols; i++) {
+				const unsigned char *row =
+					tabs + (size_t)(j * cols + i) * 256;
+				const unsigned char *x = in[i];
+				/* row[1] is the coefficient itself */
+				if (row[1] == 1) {
+					/* Plain XOR, as for m = 1 */
+					if (i == 0)
+						memcpy(o + t, x + t, end - t);
+					else
+						for (b = t; b < end; b++)
+							o[b] ^= x[b];
+				} else if (i == 0) {
+					for (b = t; b < end; b++)
+						o[b] = row[x[b]];
+				} else {
+					for (b = t; b < end; b++)
+						o[b] ^= row[x[b]];
+				}
+			}
+		}
+	}
+}
+
 int
 gib_cpu_generate_nc(void *buffers, int buf_size, int work_size, struct gib_context_t *c)
 {
-	/* This is a noncontiguous implementation, which may be added
-	 * to Gibraltar eventually.
-	 */
 	unsigned char *c_buf = buffers;
-	int i, b, j, tmp, x, y, z;
+	unsigned char *in[256], *out[256];
+	int i;
 	int m = c->m;
 	int n = c->n;
 
-	for (b = 0; b < work_size; b++) {
-		for (tmp = n; tmp < m + n; ++tmp) {
-			c_buf[tmp * buf_size + b] = 0;
-		}
-		for (j = 0; j < m; ++j) {
-			for (i = 0; i < n; ++i) {
-				z = (n + j) * buf_size + b;
-				x = c->F[j * n + i];
-				y = c_buf[i * buf_size + b];
-				c_buf[z] ^= gib_gf_table[x][y];
-			}
-		}
-	}
+	for (i = 0; i < n; i++)
+		in[i] = c_buf + i * buf_size;
+	for (i = 0; i < m; i++)
+		out[i] = c_buf + (n + i) * buf_size;
+
+	gib_cpu_tiled_dot(c->F_rows, m, n, in, out, work_size);
 
 	return 0;
 }
@@ -128,31 +264,36 @@ gib_cpu_recover(void *buffers, int buf_size, int *buf_ids,
 			      recover_last, c);
 }
 
+/* Fills rows (recover_last x n) with the coefficients that produce the
+ * buffers named in buf_ids[n..n+recover_last) from the survivors named
+ * in buf_ids[0..n).  A lost data buffer d takes row d of the inverted
+ * survivor matrix.  A lost parity buffer n+p would be F[p] applied to
+ * the recovered data, so its row is the product F[p] * inv, and data
+ * and parity come out of the same pass over the survivors.
+ */
 int
-gib_cpu_recover_nc(void *buffers, int buf_size, int work_size,
-		   int *buf_ids, int recover_last,struct gib_context_t *c)
+gib_cpu_decode_rows(struct gib_context_t *c, int *buf_ids, int recover_last,
+		    unsigned char *rows)
 {
-	/* This is a noncontiguous implementation, which may be added
-	 * to Gibraltar eventually.
-	 */
-	int i, j;
-	int b, tmp;
-	int x, y, z;
-	unsigned char *c_buf = (unsigned char *)buffers;
+	int i, j, k;
 	int n = c->n;
 	int m = c->m;
-	unsigned char A[128*128], inv[128*128], modA[128*128];
-
-	for (i = n; i < n+recover_last; i++) {
-		if (buf_ids[i] >= n) {
-			/* Recovering a parity buffer is not a valid
-			 * operation. */
-			fprintf(stderr, "Attempting to recover a parity buffer, aborting.\n");
-			return GIB_ERR;
-		}
-	}
+	unsigned char *A, *inv, *modA;
 
-	gib_galois_gen_A(A, m+n, n);
+	/* (n+m) x n and two n x n matrices; too big for the stack when
+	 * n approaches 256.
+	 */
+	A = malloc((n + m + 2 * n) * n);
+	if (A == NULL)
+		return GIB_OOM;
+	inv = A + (n + m) * n;
+	modA = inv + n * n;
+
+	/* A is the identity over c->F */
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+			A[i*n+j] = (i == j);
+	memcpy(A + n*n, c->F, m*n);
 
 	/* Modify the matrix to have the failed drives reflected */
 	for (i = 0; i < n; i++) {
@@ -163,24 +304,212 @@ gib_cpu_recover_nc(void *buffers, int buf_size, int work_size,
 
 	gib_galois_gaussian_elim(modA, inv, n, n);
 
-	/* Copy row buf_ids[i] into row i */
-	for (i = n; i < n+recover_last; i++)
-		for (j = 0; j < n; j++)
-			modA[i*n+j] = inv[buf_ids[i]*n+j];
-
-	for (b = 0; b < work_size; b++) {
-		for (tmp = n; tmp < recover_last + n; ++tmp) {
-			c_buf[tmp*buf_size+b] = 0;
+	for (i = 0; i < recover_last; i++) {
+		int id = buf_ids[n+i];
+		if (id < n) {
+			/* Copy row buf_ids[n+i] into row i */
+			for (j = 0; j < n; j++)
+				rows[i*n+j] = inv[id*n+j];
+			continue;
 		}
-		for (j = n; j < n+recover_last; ++j) {
-			for (i = 0; i < n; ++i) {
-				z = j * buf_size + b;
-				x = modA[j * n + i];
-				y = c_buf[i * buf_size + b];
-				c_buf[z] ^= gib_gf_table[x][y];
-			}
+		/* Row n+p of A is F[p] */
+		for (j = 0; j < n; j++) {
+			unsigned char acc = 0;
+			for (k = 0; k < n; k++)
+				acc ^= gib_gf_table[A[id*n+k]][inv[k*n+j]];
+			rows[i*n+j] = acc;
 		}
 	}
 
+	free(A);
+	return 0;
+}
+
+int
+gib_cpu_recover_nc(void *buffers, int buf_size, int work_size,
+		   int *buf_ids, int recover_last,struct gib_context_t *c)
+{
+	int i, rc;
+	unsigned char *c_buf = (unsigned char *)buffers;
+	unsigned char *in[256], *out[256];
+	int n = c->n;
+	struct gib_plan *plan;
+
+	rc = gib_plan_get(c, buf_ids, recover_last, gib_cpu_plan_build,
+			  &plan);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < n; i++)
+		in[i] = c_buf + i * buf_size;
+	for (i = 0; i < recover_last; i++)
+		out[i] = c_buf + (n + i) * buf_size;
+
+	gib_cpu_tiled_dot(plan->priv, recover_last, n, in, out, work_size);
+	gib_plan_put(c, plan);
+
+	return 0;
+}
+
+int
+gib_cpu_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		       struct gib_context_t *c)
+{
+	return gib_recover_sparse_nc(buffers, buf_size, buf_size, failed_bufs,
+				     c);
+}
+
+/* Sparse recovery is the scatter/gather recovery with every pointer
+ * aimed at the buffer's own slot in the stripe.  The first n surviving
+ * buffers are read, so that lost parity alone decodes through identity
+ * rows.  This goes through the context's own gib_recover_iov, and so
+ * serves every backend.
+ */
+int
+gib_cpu_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+			  char *failed_bufs, struct gib_context_t *c)
+{
+	unsigned char *c_buf = buffers;
+	unsigned char *in[256], *out[256];
+	int buf_ids[256];
+	int i, nsurv = 0, nfail = 0;
+
+	for (i = 0; i < c->n + c->m; i++) {
+		if (failed_bufs[i])
+			buf_ids[c->n + nfail++] = i;
+		else if (nsurv < c->n)
+			buf_ids[nsurv++] = i;
+	}
+	if (nsurv < c->n)
+		return GIB_ERR;
+	if (nfail == 0)
+		return 0;
+
+	for (i = 0; i < c->n; i++)
+		in[i] = c_buf + buf_ids[i] * buf_size;
+	for (i = 0; i < nfail; i++)
+		out[i] = c_buf + buf_ids[c->n + i] * buf_size;
+
+	return gib_recover_iov(in, buf_ids, out, nfail, work_size, c);
+}
+
+/* Touches the start of each data buffer of the next stripe in a batch,
+ * so that its first tile is on its way while this one is coded.
+ */
+static void
+gib_cpu_prefetch_stripe(unsigned char *buf, int buf_size, int nbufs)
+{
+	int i, b;
+
+	for (i = 0; i < nbufs; i++)
+		for (b = 0; b < 256 && b < buf_size; b += 64)
+			__builtin_prefetch(buf + i * buf_size + b);
+}
+
+int
+gib_cpu_generate_batch(void **buffers, int *buf_sizes, int count,
+		       struct gib_context_t *c)
+{
+	unsigned char *in[256], *out[256];
+	int s, i;
+
+	for (s = 0; s < count; s++) {
+		unsigned char *c_buf = buffers[s];
+		if (s + 1 < count)
+			gib_cpu_prefetch_stripe(buffers[s+1], buf_sizes[s+1],
+						c->n);
+		for (i = 0; i < c->n; i++)
+			in[i] = c_buf + i * buf_sizes[s];
+		for (i = 0; i < c->m; i++)
+			out[i] = c_buf + (c->n + i) * buf_sizes[s];
+		gib_cpu_tiled_dot(c->F_rows, c->m, c->n, in, out, buf_sizes[s]);
+	}
+	return 0;
+}
+
+int
+gib_cpu_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+		      int *recover_last, int count, struct gib_context_t *c)
+{
+	unsigned char *in[256], *out[256];
+	struct gib_plan *plan;
+	int s, i, rc;
+	int n = c->n;
+
+	for (s = 0; s < count; s++) {
+		unsigned char *c_buf = buffers[s];
+		int r = recover_last[s];
+
+		rc = gib_plan_get(c, buf_ids[s], r, gib_cpu_plan_build,
+				  &plan);
+		if (rc)
+			return rc;
+		if (s + 1 < count)
+			gib_cpu_prefetch_stripe(buffers[s+1], buf_sizes[s+1],
+						n);
+		for (i = 0; i < n; i++)
+			in[i] = c_buf + i * buf_sizes[s];
+		for (i = 0; i < r; i++)
+			out[i] = c_buf + (n + i) * buf_sizes[s];
+		gib_cpu_tiled_dot(plan->priv, r, n, in, out, buf_sizes[s]);
+		gib_plan_put(c, plan);
+	}
+	return 0;
+}
+
+int
+gib_cpu_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		     struct gib_context_t *c)
+{
+	gib_cpu_tiled_dot(c->F_rows, c->m, c->n, data, parity, len);
+	return 0;
+}
+
+int
+gib_cpu_recover_iov(unsigned char **survivors, int *buf_ids,
+		    unsigned char **out, int recover_last, int len,
+		    struct gib_context_t *c)
+{
+	struct gib_plan *plan;
+	int rc;
+
+	rc = gib_plan_get(c, buf_ids, recover_last, gib_cpu_plan_build,
+			  &plan);
+	if (rc)
+		return rc;
+	gib_cpu_tiled_dot(plan->priv, recover_last, c->n, survivors, out,
+			  len);
+	gib_plan_put(c, plan);
+	return 0;
+}
+
+/* Bytes of old_data ^ new_data formed at a time by the update path. */
+#define GIB_CPU_UPDATE_CHUNK 4096
+
+int
+gib_cpu_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		    unsigned char **new_data, unsigned char **parity,
+		    int len, struct gib_context_t *c)
+{
+	unsigned char delta[GIB_CPU_UPDATE_CHUNK];
+	int t, i, j, b, end;
+
+	for (t = 0; t < len; t += GIB_CPU_UPDATE_CHUNK) {
+		end = (t + GIB_CPU_UPDATE_CHUNK < len) ?
+			t + GIB_CPU_UPDATE_CHUNK : len;
+		for (i = 0; i < ncols; i++) {
+			const unsigned char *o = old_data[i];
+			const unsigned char *x = new_data[i];
+			for (b = t; b < end; b++)
+				delta[b - t] = o[b] ^ x[b];
+			for (j = 0; j < c->m; j++) {
+				const unsigned char *row = c->F_rows +
+					(size_t)(j*c->n + data_ids[i]) * 256;
+				unsigned char *p = parity[j];
+				for (b = t; b < end; b++)
+					p[b] ^= row[delta[b - t]];
+			}
+		}
+	}
 	return 0;
 }
@@ -5,6 +5,8 @@
  * <mlcurry@sandia.gov>
  *
  * Changes:
+ * XOR-only coding when M is 1.
+ * Decoding rows have their own constant buffer.
  *
  */
 
@@ -12,6 +14,8 @@ typedef unsigned char byte;
 __device__ unsigned char gf_log_d[256];
 __device__ unsigned char gf_ilog_d[256];
 __constant__ byte F_d[M*N];
+/* The rows of the current decoding plan, so that F_d is loaded once */
+__constant__ byte R_d[M*N];
 __constant__ byte inv_d[N*N];
 
 /* The "fetch" datatype is the unit for performing data copies between areas of
@@ -76,13 +80,17 @@ __global__ void gib_recover_d(shmem_bytes *bufs, int buf_size,
   for (int i = 0; i < N; ++i) {
     /* Fetch the in-disk */
     in.f = bufs[rank+buf_size/SOF*i].f;
+#if M == 1
+    /* With one parity, every coefficient is 1. */
+    out[0].f ^= in.f;
+#else
     for (int j = 0; j < recover_last; ++j) {
       /* Unless this is due to a drive bug, this conditional really
 	 helps/helped on the 8000-series parts, but it hurts performance on 
 	 the 260+.
       */
       //if (F_d[j*N+i] != 0) {
-      int F_tmp = sh_log[F_d[j*N+i]]; /* No load conflicts */
+      int F_tmp = sh_log[R_d[j*N+i]]; /* No load conflicts */
       for (int b = 0; b < SOF; ++b) {
 	if (in.b[b] != 0) {
 	  int sum_log = F_tmp + sh_log[(in.b)[b]];
@@ -92,6 +100,7 @@ __global__ void gib_recover_d(shmem_bytes *bufs, int buf_size,
       }
       //}
     }
+#endif
   }
   /* This works as long as buf_size % blocksize == 0 
    * TODO:  Ensure that allocation does this. */
@@ -125,6 +134,9 @@ __global__ void gib_checksum_d(shmem_bytes *bufs, int buf_size) {
   for (int i = 0; i < N; ++i) {
     /* Fetch the in-disk */
     in.f = bufs[rank+buf_size/SOF*i].f;
+#if M == 1
+    out[0].f ^= in.f;
+#else
     for (int j = 0; j < M; ++j) {
       /* If I'm not hallucinating, this conditional really
 	 helps on the 8800 stuff, but it hurts on the 260.
@@ -140,6 +152,7 @@ __global__ void gib_checksum_d(shmem_bytes *bufs, int buf_size) {
       }
       //}
     }
+#endif
   }
   /* This works as long as buf_size % blocksize == 0 */
 #ifdef RAID6_FIX
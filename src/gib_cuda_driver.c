@@ -8,6 +8,8 @@
  * Changes:
  * Initial version, Matthew L. Curry
  * Dec 16, 2014, Rodrigo Sardinas; revised to enable dynamic use.
+ * The coding matrix is uploaded once, and decoding rows kept apart.
+ * Cached PTX is named for the kernel version.
  *
  */
 
@@ -22,6 +24,12 @@
 #define GIB_USE_MMAP 1
 #endif
 
+/* Cached PTX is named for this version of gib_cuda_checksum.cu, so that
+ * PTX left by an older library, which may lack symbols looked up below,
+ * is never loaded.  Change it whenever the kernels' symbols change.
+ */
+#define GIB_CUDA_PTX_VERSION 2
+
 /* Size of each GPU buffer; n+m will be allocated */
 #if !GIB_USE_MMAP
 int gib_buf_size = 1024*1024;
@@ -36,6 +44,7 @@ const char env_error_str[] =
 #include "../inc/gib_context.h"
 #include "../inc/gib_galois.h"
 #include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_plan_cache.h"
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -56,6 +65,7 @@ struct gpu_context_t {
 	CUfunction recover_sparse;
 	CUfunction recover;
 	CUdeviceptr buffers;
+	CUdeviceptr R_d; /* Rows of the decoding plan in use */
 };
 
 typedef struct gpu_context_t * gpu_context;
@@ -77,7 +87,7 @@ typedef struct gpu_context_t * gpu_context;
 /* Massive performance increases come from compiling the CUDA kernels
    specifically for the coding process at hand.  This does so with the
    following command line:
-      nvcc --ptx -DN=n -DM=m src/gib_cuda_checksum.cu -o gib_cuda_n+m.ptx
+      nvcc --ptx -DN=n -DM=m src/gib_cuda_checksum.cu -o gib_cuda_vV_n+m.ptx
    This is called in a separate process fork'd from the original.  This
    function should never return, and the parent process should wait on the
    return code from the compiler before resuming operation.
@@ -129,10 +139,10 @@ gib_init_cuda(int n, int m, gib_context *c)
 	/* Initializes the CPU and GPU runtimes. */
 	static CUcontext pCtx;
 	static CUdevice dev;
-	if (m < 2 || n < 2) {
+	if (n < 2) {
 		fprintf(stderr, "It makes little sense to use Reed-Solomon "
-			"coding when n or m is less than\ntwo. Use XOR or "
-			"replication instead.\n");
+			"coding when n is less than\ntwo. Use replication "
+			"instead.\n");
 		exit(1);
 	}
 	int rc_i = gib_cpu_init(n,m,c);
@@ -185,9 +195,11 @@ gib_init_cuda(int n, int m, gib_context *c)
 	 * new one.
 	 */
 	int filename_len = strlen(getenv("GIB_CACHE_DIR")) +
-		strlen("/gib_cuda_+.ptx") + log10(n)+1 + log10(m)+1 + 1;
+		strlen("/gib_cuda_v_+.ptx") + 3*sizeof(int) +
+		log10(n)+1 + log10(m)+1 + 1;
 	char *filename = (char *)malloc(filename_len);
-	sprintf(filename, "%s/gib_cuda_%i+%i.ptx", getenv("GIB_CACHE_DIR"), n, m);
+	sprintf(filename, "%s/gib_cuda_v%i_%i+%i.ptx", getenv("GIB_CACHE_DIR"),
+		GIB_CUDA_PTX_VERSION, n, m);
 
 	FILE *fp = fopen(filename, "r");
 	if (fp == NULL) {
@@ -232,9 +244,6 @@ gib_init_cuda(int n, int m, gib_context *c)
 
 	/* Initialize the math libraries */
 	gib_galois_init();
-	unsigned char F[256*256];
-	gib_galois_gen_F(F, m, n);
-
 	/* Initialize/Allocate GPU-side structures */
 	CUdeviceptr log_d, ilog_d, F_d;
 	ERROR_CHECK_FAIL(cuModuleGetGlobal(&log_d, NULL, gpu_c->module,
@@ -244,7 +253,10 @@ gib_init_cuda(int n, int m, gib_context *c)
 					   "gf_ilog_d"));
 	ERROR_CHECK_FAIL(cuMemcpyHtoD(ilog_d, gib_gf_ilog, 256));
 	ERROR_CHECK_FAIL(cuModuleGetGlobal(&F_d, NULL, gpu_c->module, "F_d"));
-	ERROR_CHECK_FAIL(cuMemcpyHtoD(F_d, F, m*n));
+	ERROR_CHECK_FAIL(cuMemcpyHtoD(F_d, (*c)->F, m*n));
+	/* F_d is never written again; recovery loads its rows here */
+	ERROR_CHECK_FAIL(cuModuleGetGlobal(&(gpu_c->R_d), NULL, gpu_c->module,
+					   "R_d"));
 #if !GIB_USE_MMAP
 	ERROR_CHECK_FAIL(cuMemAlloc(&(gpu_c->buffers), (n+m)*gib_buf_size));
 #endif
@@ -329,12 +341,6 @@ _gib_generate(void *buffers, int buf_size, gib_context c)
 	int nblocks = (buf_size + fetch_size - 1)/fetch_size;
 	gpu_context gpu_c = (gpu_context) c->acc_context;
 
-	unsigned char F[256*256];
-	gib_galois_gen_F(F, c->m, c->n);
-	CUdeviceptr F_d;
-	ERROR_CHECK_FAIL(cuModuleGetGlobal(&F_d, NULL, gpu_c->module, "F_d"));
-	ERROR_CHECK_FAIL(cuMemcpyHtoD(F_d, F, (c->m)*(c->n)));
-
 #if !GIB_USE_MMAP
 	/* Copy the buffers to memory */
 	ERROR_CHECK_FAIL(
@@ -393,39 +399,24 @@ _gib_recover(void *buffers, int buf_size, int *buf_ids, int recover_last,
 	}
 #endif
 
-	int i, j;
 	int n = c->n;
-	int m = c->m;
-	unsigned char A[128*128], inv[128*128], modA[128*128];
-	for (i = n; i < n+recover_last; i++)
-		if (buf_ids[i] >= n) {
-			fprintf(stderr, "Attempting to recover a parity "
-				"buffer, not allowed\n");
-			return GIB_ERR;
-		}
-
-	gib_galois_gen_A(A, m+n, n);
-
-	/* Modify the matrix to have the failed drives reflected */
-	for (i = 0; i < n; i++)
-		for (j = 0; j < n; j++)
-			modA[i*n+j] = A[buf_ids[i]*n+j];
-
-	gib_galois_gaussian_elim(modA, inv, n, n);
-
-	/* Copy row buf_ids[i] into row i */
-	for (i = n; i < n+recover_last; i++)
-		for (j = 0; j < n; j++)
-			modA[i*n+j] = inv[buf_ids[i]*n+j];
+	struct gib_plan *plan;
+	int rc = gib_plan_get(c, buf_ids, recover_last, gib_cpu_plan_build,
+			      &plan);
+	if (rc != GIB_SUC) {
+		ERROR_CHECK_FAIL(
+			cuCtxPopCurrent(
+				&((gpu_context)(c->acc_context))->pCtx));
+		return rc;
+	}
 
 	int nthreads_per_block = 128;
 	int fetch_size = sizeof(int)*nthreads_per_block;
 	int nblocks = (buf_size + fetch_size - 1)/fetch_size;
 	gpu_context gpu_c = (gpu_context) c->acc_context;
 
-	CUdeviceptr F_d;
-	ERROR_CHECK_FAIL(cuModuleGetGlobal(&F_d, NULL, gpu_c->module, "F_d"));
-	ERROR_CHECK_FAIL(cuMemcpyHtoD(F_d, modA+n*n, (c->m)*(c->n)));
+	ERROR_CHECK_FAIL(cuMemcpyHtoD(gpu_c->R_d, plan->rows, recover_last*n));
+	gib_plan_put(c, plan);
 
 #if !GIB_USE_MMAP
 	ERROR_CHECK_FAIL(cuMemcpyHtoD(gpu_c->buffers, buffers,
@@ -488,6 +479,49 @@ _gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
 				  recover_last, c);
 }
 
+/* Scattered host buffers cannot be mapped into the GPU without copying
+ * them, which is what this interface exists to avoid, so these run on
+ * the CPU in place.
+ */
+static int
+_gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		  gib_context c)
+{
+	return gib_cpu_generate_iov(data, parity, len, c);
+}
+
+static int
+_gib_recover_iov(unsigned char **survivors, int *buf_ids, unsigned char **out,
+		 int recover_last, int len, gib_context c)
+{
+	return gib_cpu_recover_iov(survivors, buf_ids, out, recover_last, len,
+				   c);
+}
+
+/* A small write touches too few bytes to repay a trip over the bus. */
+static int
+_gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		 unsigned char **new_data, unsigned char **parity, int len,
+		 gib_context c)
+{
+	return gib_cpu_update_cols(ncols, data_ids, old_data, new_data,
+				   parity, len, c);
+}
+
+static int
+_gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		    gib_context c)
+{
+	return gib_cpu_recover_sparse(buffers, buf_size, failed_bufs, c);
+}
+
+static int
+_gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+		       char *failed_bufs, gib_context c)
+{
+	return gib_cpu_recover_sparse_nc(buffers, buf_size, work_size,
+					 failed_bufs, c);
+}
 
 struct dynamic_fp cuda = {
 		.gib_alloc = &_gib_alloc,
@@ -497,5 +531,10 @@ struct dynamic_fp cuda = {
 		.gib_generate_nc = &_gib_generate_nc,
 		.gib_recover = &_gib_recover,
 		.gib_recover_nc = &_gib_recover_nc,
+		.gib_recover_sparse = &_gib_recover_sparse,
+		.gib_recover_sparse_nc = &_gib_recover_sparse_nc,
+		.gib_generate_iov = &_gib_generate_iov,
+		.gib_recover_iov = &_gib_recover_iov,
+		.gib_update_cols = &_gib_update_cols,
 };
 
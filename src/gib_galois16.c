@@ -0,0 +1,154 @@
+/* gib_galois16.c: GF(2^16) arithmetic operations
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+
+#include "../inc/gib_galois16.h"
+#include "../inc/gibraltar.h" /* For error codes */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+unsigned short gib_gf16_log[65536];
+unsigned short gib_gf16_ilog[65536];
+
+unsigned short
+gib_galois16_mul(unsigned short a, unsigned short b)
+{
+	int sum_log;
+
+	if (a == 0 || b == 0)
+		return 0;
+	sum_log = gib_gf16_log[a] + gib_gf16_log[b];
+	if (sum_log >= 65535)
+		sum_log -= 65535;
+	return gib_gf16_ilog[sum_log];
+}
+
+unsigned short
+gib_galois16_div(unsigned short a, unsigned short b)
+{
+	int diff_log;
+
+	if (a == 0)
+		return 0;
+	if (b == 0)
+		return -1;
+	diff_log = gib_gf16_log[a] - gib_gf16_log[b];
+	if (diff_log < 0)
+		diff_log += 65535;
+	return gib_gf16_ilog[diff_log];
+}
+
+static int
+gib_galois16_init_unsafe(void)
+{
+	int b, log;
+	/* x^16 + x^12 + x^3 + x + 1, the polynomial Jerasure uses for
+	 * w = 16.
+	 */
+	int prim_poly = 0210013;
+
+	b = 1;
+	for (log = 0; log < 65535; log++) {
+		gib_gf16_log[b] = (unsigned short) log;
+		gib_gf16_ilog[log] = (unsigned short) b;
+		b = b << 1;
+		if (b & 65536)
+			b = b ^ prim_poly;
+	}
+	return 0;
+}
+
+static struct {
+	int rcount;
+	pthread_mutex_t m;
+} _gib16_state = {
+	.rcount = 0,
+	.m = PTHREAD_MUTEX_INITIALIZER,
+};
+
+int
+gib_galois16_init(void)
+{
+	int rc = 0;
+	if (pthread_mutex_lock(&_gib16_state.m))
+		abort();
+	if (_gib16_state.rcount == 0)
+		rc = gib_galois16_init_unsafe();
+	if (rc == 0)
+		_gib16_state.rcount++;
+	if (pthread_mutex_unlock(&_gib16_state.m))
+		abort();
+	return rc;
+}
+
+/* F is the Cauchy matrix F[i][j] = 1 / (x_i + y_j) with x_i = i and
+ * y_j = rows + j.  Every square submatrix of a Cauchy matrix is
+ * invertible, so [I; F] is MDS without the elimination that
+ * gib_galois_gen_F performs, for any rows + cols <= 65536.  A single
+ * row is all ones, so that m = 1 is plain XOR as in GF(2^8).
+ */
+int
+gib_galois16_gen_F(unsigned short *mat, int rows, int cols)
+{
+	int i, j;
+
+	if (rows + cols > 65536)
+		return GIB_ERR;
+	for (i = 0; i < rows; i++)
+		for (j = 0; j < cols; j++)
+			mat[i*cols+j] = (rows == 1) ? 1 :
+				gib_galois16_div(1, i ^ (rows + j));
+	return 0;
+}
+
+/* Gauss-Jordan elimination with row pivoting; mat is destroyed. */
+int
+gib_galois16_invert(unsigned short *mat, unsigned short *inv, int n)
+{
+	int i, j, e, p;
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+			inv[i*n+j] = (i == j);
+
+	for (i = 0; i < n; i++) {
+		for (p = i; p < n && mat[p*n+i] == 0; p++)
+			;
+		if (p == n)
+			return GIB_ERR;
+		if (p != i) {
+			for (j = 0; j < n; j++) {
+				unsigned short tmp = mat[i*n+j];
+				mat[i*n+j] = mat[p*n+j];
+				mat[p*n+j] = tmp;
+				tmp = inv[i*n+j];
+				inv[i*n+j] = inv[p*n+j];
+				inv[p*n+j] = tmp;
+			}
+		}
+
+		unsigned short d = gib_galois16_div(1, mat[i*n+i]);
+		for (j = 0; j < n; j++) {
+			mat[i*n+j] = gib_galois16_mul(d, mat[i*n+j]);
+			inv[i*n+j] = gib_galois16_mul(d, inv[i*n+j]);
+		}
+
+		for (e = 0; e < n; e++) {
+			unsigned short x = mat[e*n+i];
+			if (e == i || x == 0)
+				continue;
+			for (j = 0; j < n; j++) {
+				mat[e*n+j] ^= gib_galois16_mul(x, mat[i*n+j]);
+				inv[e*n+j] ^= gib_galois16_mul(x, inv[i*n+j]);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,735 @@
+/* gib_jit_funcs.c: CPU kernels compiled at run time for one matrix.
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * The cache is checked before use, and plans compile in the background.
+ *
+ */
+
+/* As the CUDA backend compiles gib_cuda_checksum.cu for each (n, m),
+ * this backend writes C source for the exact coefficients of a matrix,
+ * builds it into a shared object with the local C compiler, and loads
+ * it with dlopen.  In the generated code, products by zero disappear,
+ * products by one are plain XORs, and every other coefficient's nibble
+ * tables (see gib_simd_funcs.c) are constants hoisted out of the loop,
+ * so the compiler can keep them in registers.
+ *
+ * Objects are cached in GIB_CACHE_DIR under a hash of their source and
+ * compiler command.  Each is compiled to a temporary name, then renamed
+ * into place; rename is atomic, so concurrent processes never load a
+ * partly written object, and at worst compile the same kernel twice.
+ * Nothing is ever removed from the cache.  GIB_JIT_CC names the
+ * compiler ("cc" by default).
+ */
+
+#define _GNU_SOURCE
+#include "../inc/gib_galois.h"
+#include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_simd_funcs.h"
+#include "../inc/gib_jit_funcs.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_plan_cache.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+struct gib_jit_context {
+	struct gib_jit_kernel gen; /* For c->F */
+	gib_simd_dot_fn simd; /* For plans whose kernel is not loaded yet */
+};
+
+/* A plan is coded by the SIMD kernels until its own kernel is loaded.
+ * When that is not cached, a thread of its own compiles it, so that the
+ * first recovery of an erasure pattern does not wait for the compiler.
+ * At most GIB_JIT_COMPILES compiles run at once, and a plan that finds
+ * none free tries again on its next use.
+ */
+#define GIB_JIT_COMPILES 2
+
+enum {
+	GIB_JIT_WAITING,
+	GIB_JIT_COMPILING,
+	GIB_JIT_READY,
+	GIB_JIT_FAILED
+};
+
+struct gib_jit_plan {
+	struct gib_jit_kernel k; /* Valid once state is GIB_JIT_READY */
+	int state;
+	int refs; /* The plan's, and its compiling thread's */
+	int slot; /* In gib_jit_children, while compiling */
+	int rows;
+	int cols;
+	struct gib_simd_tab *tabs;
+	unsigned char *mat; /* A copy of the rows, for the thread */
+};
+
+/* The compiles running in the background, each holding a slot with the
+ * process group of its compiler (-1 while it has none), so that exit
+ * can stop them before they leave temporary files behind.  0 marks a
+ * free slot.
+ */
+static pid_t gib_jit_children[GIB_JIT_COMPILES];
+static __thread pid_t *gib_jit_child;
+static pthread_once_t gib_jit_once = PTHREAD_ONCE_INIT;
+
+/* The instruction set the generated code is written for. */
+enum gib_jit_isa {
+	GIB_JIT_SCALAR,
+	GIB_JIT_SSSE3,
+	GIB_JIT_AVX2
+};
+
+struct gib_jit_vec {
+	int width;
+	const char *type;
+	const char *flag; /* Compiler flag enabling the intrinsics */
+	const char *load;
+	const char *store;
+	const char *tab;  /* Loads a 16-byte table into every lane */
+	const char *and;
+	const char *xor;
+	const char *srli;
+	const char *shuffle;
+	const char *set1;
+	const char *zero;
+};
+
+static const struct gib_jit_vec gib_jit_vecs[] = {
+	[GIB_JIT_SSSE3] = {
+		16, "__m128i", "-mssse3",
+		"_mm_loadu_si128((const __m128i *)(%s))",
+		"_mm_storeu_si128((__m128i *)(%s), %s);",
+		"_mm_loadu_si128((const __m128i *)%s)",
+		"_mm_and_si128", "_mm_xor_si128", "_mm_srli_epi64",
+		"_mm_shuffle_epi8", "_mm_set1_epi8", "_mm_setzero_si128()",
+	},
+	[GIB_JIT_AVX2] = {
+		32, "__m256i", "-mavx2",
+		"_mm256_loadu_si256((const __m256i *)(%s))",
+		"_mm256_storeu_si256((__m256i *)(%s), %s);",
+		"_mm256_broadcastsi128_si256(_mm_loadu_si128("
+		"(const __m128i *)%s))",
+		"_mm256_and_si256", "_mm256_xor_si256", "_mm256_srli_epi64",
+		"_mm256_shuffle_epi8", "_mm256_set1_epi8",
+		"_mm256_setzero_si256()",
+	},
+};
+
+static int
+gib_jit_isa(void)
+{
+	int isa = gib_simd_detect();
+
+	if (isa >= GIB_SIMD_AVX2)
+		return GIB_JIT_AVX2;
+	if (isa == GIB_SIMD_SSSE3)
+		return GIB_JIT_SSSE3;
+	return GIB_JIT_SCALAR;
+}
+
+/* Writes the nibble tables of every coefficient other than 0 and 1. */
+static void
+gib_jit_emit_tables(FILE *f, const unsigned char *mat, int rows, int cols)
+{
+	int r, i, k;
+
+	for (r = 0; r < rows; r++) {
+		for (i = 0; i < cols; i++) {
+			unsigned char coef = mat[r*cols + i];
+			if (coef < 2)
+				continue;
+			fprintf(f, "static const unsigned char "
+				"lo%d_%d[16] = {", r, i);
+			for (k = 0; k < 16; k++)
+				fprintf(f, "%s%d", k ? "," : "",
+					gib_gf_table[coef][k]);
+			fprintf(f, "};\nstatic const unsigned char "
+				"hi%d_%d[16] = {", r, i);
+			for (k = 0; k < 16; k++)
+				fprintf(f, "%s%d", k ? "," : "",
+					gib_gf_table[coef][k << 4]);
+			fprintf(f, "};\n");
+		}
+	}
+}
+
+/* One byte of output row r, as a C expression over x<i>. */
+static void
+gib_jit_emit_scalar_row(FILE *f, const unsigned char *mat, int r,
+			int cols)
+{
+	int i, terms = 0;
+
+	for (i = 0; i < cols; i++) {
+		unsigned char coef = mat[r*cols + i];
+		if (coef == 0)
+			continue;
+		fprintf(f, "%s", terms++ ? " ^ " : "");
+		if (coef == 1)
+			fprintf(f, "x%d", i);
+		else
+			fprintf(f, "lo%d_%d[x%d & 15] ^ "
+				"hi%d_%d[x%d >> 4]", r, i, i, r, i, i);
+	}
+	if (terms == 0)
+		fprintf(f, "0");
+}
+
+static void
+gib_jit_emit(FILE *f, const unsigned char *mat, int rows, int cols,
+	     int isa)
+{
+	const struct gib_jit_vec *v = &gib_jit_vecs[isa];
+	char used[256] = { 0 }, split[256] = { 0 };
+	char arg[64], val[128];
+	int r, i;
+
+	for (r = 0; r < rows; r++) {
+		for (i = 0; i < cols; i++) {
+			used[i] |= (mat[r*cols + i] != 0);
+			split[i] |= (mat[r*cols + i] > 1);
+		}
+	}
+
+	fprintf(f, "/* Generated by Gibraltar for a %d x %d matrix. */\n",
+		rows, cols);
+	if (isa != GIB_JIT_SCALAR)
+		fprintf(f, "#include <immintrin.h>\n");
+	gib_jit_emit_tables(f, mat, rows, cols);
+	fprintf(f, "void\ngib_jit_dot(unsigned char **in, "
+		"unsigned char **out, int len)\n{\n\tint b = 0;\n");
+	for (i = 0; i < cols; i++)
+		if (used[i])
+			fprintf(f, "\tunsigned char *i%d = in[%d];\n", i,
+				i);
+	for (r = 0; r < rows; r++)
+		fprintf(f, "\tunsigned char *o%d = out[%d];\n", r, r);
+
+	if (isa != GIB_JIT_SCALAR) {
+		fprintf(f, "\tconst %s mask = %s(0x0f);\n", v->type,
+			v->set1);
+		for (r = 0; r < rows; r++) {
+			for (i = 0; i < cols; i++) {
+				if (mat[r*cols + i] < 2)
+					continue;
+				snprintf(arg, sizeof(arg), "lo%d_%d", r, i);
+				fprintf(f, "\tconst %s L%d_%d = ", v->type, r,
+					i);
+				fprintf(f, v->tab, arg);
+				snprintf(arg, sizeof(arg), "hi%d_%d", r, i);
+				fprintf(f, ";\n\tconst %s H%d_%d = ", v->type,
+					r, i);
+				fprintf(f, v->tab, arg);
+				fprintf(f, ";\n");
+			}
+		}
+
+		fprintf(f, "\tfor (; b + %d <= len; b += %d) {\n", v->width,
+			v->width);
+		/* Every input is loaded before any output is stored */
+		for (i = 0; i < cols; i++) {
+			if (!used[i])
+				continue;
+			snprintf(arg, sizeof(arg), "i%d + b", i);
+			fprintf(f, "\t\t%s x%d = ", v->type, i);
+			fprintf(f, v->load, arg);
+			fprintf(f, ";\n");
+			if (!split[i])
+				continue;
+			fprintf(f, "\t\t%s l%d = %s(x%d, mask);\n", v->type,
+				i, v->and, i);
+			fprintf(f, "\t\t%s h%d = %s(%s(x%d, 4), mask);\n",
+				v->type, i, v->and, v->srli, i);
+		}
+		for (r = 0; r < rows; r++) {
+			int terms = 0;
+			fprintf(f, "\t\t{\n\t\t\t%s a = %s;\n", v->type,
+				v->zero);
+			for (i = 0; i < cols; i++) {
+				unsigned char coef = mat[r*cols + i];
+				if (coef == 0)
+					continue;
+				if (coef == 1)
+					snprintf(val, sizeof(val), "x%d",
+						 i);
+				else
+					snprintf(val, sizeof(val),
+						 "%s(%s(L%d_%d, l%d), "
+						 "%s(H%d_%d, h%d))",
+						 v->xor, v->shuffle, r, i,
+						 i, v->shuffle, r, i, i);
+				if (terms++ == 0)
+					fprintf(f, "\t\t\ta = %s;\n",
+						val);
+				else
+					fprintf(f, "\t\t\ta = %s(a, %s);"
+						"\n", v->xor, val);
+			}
+			snprintf(arg, sizeof(arg), "o%d + b", r);
+			fprintf(f, "\t\t\t");
+			fprintf(f, v->store, arg, "a");
+			fprintf(f, "\n\t\t}\n");
+		}
+		fprintf(f, "\t}\n");
+	}
+
+	/* The tail, or everything for scalar code */
+	fprintf(f, "\tfor (; b < len; b++) {\n");
+	for (i = 0; i < cols; i++)
+		if (used[i])
+			fprintf(f, "\t\tunsigned char x%d = i%d[b];\n", i,
+				i);
+	for (r = 0; r < rows; r++) {
+		fprintf(f, "\t\to%d[b] = ", r);
+		gib_jit_emit_scalar_row(f, mat, r, cols);
+		fprintf(f, ";\n");
+	}
+	fprintf(f, "\t}\n}\n");
+}
+
+/* FNV-1a */
+static unsigned long long
+gib_jit_hash(const char *s, size_t len, unsigned long long h)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* Runs cc -O2 -fPIC -shared [flag] -o obj src, and waits for it. */
+static int
+gib_jit_run_cc(const char *cc, const char *flag, const char *src,
+	       const char *obj)
+{
+	char *argv[9];
+	int argc = 0, status;
+	pid_t pid;
+
+	argv[argc++] = (char *)cc;
+	argv[argc++] = "-O2";
+	argv[argc++] = "-fPIC";
+	argv[argc++] = "-shared";
+	if (flag != NULL)
+		argv[argc++] = (char *)flag;
+	argv[argc++] = "-o";
+	argv[argc++] = (char *)obj;
+	argv[argc++] = (char *)src;
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid == -1)
+		return GIB_ERR;
+	if (pid == 0) {
+		setpgid(0, 0);
+		execvp(argv[0], argv);
+		perror("execvp(GIB_JIT_CC)");
+		_exit(127);
+	}
+	if (gib_jit_child != NULL)
+		__atomic_store_n(gib_jit_child, pid, __ATOMIC_RELEASE);
+	status = (waitpid(pid, &status, 0) == pid) ? status : -1;
+	if (gib_jit_child != NULL)
+		__atomic_store_n(gib_jit_child, -1, __ATOMIC_RELEASE);
+	return (status != -1 && WIFEXITED(status) &&
+		WEXITSTATUS(status) == 0) ? GIB_SUC : GIB_ERR;
+}
+
+/* The objects in the cache are loaded into the process, so the
+ * directory must belong to this user and be writable by no one else,
+ * and so must each object, which is checked through a descriptor
+ * before it is loaded.  As no one else can rename or create files in
+ * the directory, the object cannot be swapped for another in between.
+ * gib_jit_load returns GIB_BUSY if the object is not there.
+ */
+static int
+gib_jit_dir_ok(const char *dir)
+{
+	struct stat st;
+
+	if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode) ||
+	    st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)))
+		return 0;
+	return 1;
+}
+
+static int
+gib_jit_load(const char *obj, struct gib_jit_kernel *k)
+{
+	struct stat st;
+	int fd, rc = GIB_ERR;
+
+	fd = open(obj, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return (errno == ENOENT) ? GIB_BUSY : GIB_ERR;
+	do {
+		if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+		    st.st_uid != geteuid() ||
+		    (st.st_mode & (S_IWGRP | S_IWOTH)))
+			break;
+		k->handle = dlopen(obj, RTLD_NOW | RTLD_LOCAL);
+		if (k->handle == NULL)
+			break;
+		*(void **)&k->dot = dlsym(k->handle, "gib_jit_dot");
+		if (k->dot == NULL) {
+			dlclose(k->handle);
+			break;
+		}
+		rc = GIB_SUC;
+	} while (0);
+	close(fd);
+	return rc;
+}
+
+/* Compiles code into obj by way of temporary files made with mkstemps,
+ * so no other name in the directory is ever opened for writing.
+ */
+static int
+gib_jit_build(const char *dir, const char *cc, const char *flag,
+	      const char *code, size_t code_len, const char *obj)
+{
+	char *tmp_src = NULL, *tmp_obj = NULL;
+	int fd, rc = GIB_ERR;
+
+	do {
+		if (asprintf(&tmp_src, "%s/gib_jit_XXXXXX.c", dir) < 0) {
+			tmp_src = NULL;
+			break;
+		}
+		if (asprintf(&tmp_obj, "%s/gib_jit_XXXXXX.so", dir) < 0) {
+			tmp_obj = NULL;
+			break;
+		}
+		fd = mkstemps(tmp_src, 2);
+		if (fd < 0) {
+			free(tmp_src);
+			tmp_src = NULL;
+			break;
+		}
+		if (write(fd, code, code_len) != (ssize_t)code_len) {
+			close(fd);
+			break;
+		}
+		close(fd);
+		fd = mkstemps(tmp_obj, 3);
+		if (fd < 0) {
+			free(tmp_obj);
+			tmp_obj = NULL;
+			break;
+		}
+		close(fd);
+		rc = gib_jit_run_cc(cc, flag, tmp_src, tmp_obj);
+		if (rc == GIB_SUC && rename(tmp_obj, obj) != 0)
+			rc = GIB_ERR;
+	} while (0);
+
+	if (tmp_src != NULL)
+		unlink(tmp_src);
+	if (tmp_obj != NULL && rc != GIB_SUC)
+		unlink(tmp_obj);
+	free(tmp_src);
+	free(tmp_obj);
+	return rc;
+}
+
+int
+gib_jit_compile(const unsigned char *mat, int rows, int cols, int build,
+		struct gib_jit_kernel *k)
+{
+	char *dir = getenv("GIB_CACHE_DIR");
+	char *cc = getenv("GIB_JIT_CC");
+	int isa = gib_jit_isa();
+	const char *flag = (isa == GIB_JIT_SCALAR) ? NULL :
+		gib_jit_vecs[isa].flag;
+	char *code = NULL, *obj = NULL;
+	size_t code_len = 0;
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	FILE *f;
+	int rc;
+
+	if (dir == NULL || !gib_jit_dir_ok(dir))
+		return GIB_ERR;
+	if (cc == NULL)
+		cc = "cc";
+
+	f = open_memstream(&code, &code_len);
+	if (f == NULL)
+		return GIB_OOM;
+	gib_jit_emit(f, mat, rows, cols, isa);
+	fclose(f);
+	h = gib_jit_hash(code, code_len, h);
+	h = gib_jit_hash(cc, strlen(cc) + 1, h);
+	if (flag != NULL)
+		h = gib_jit_hash(flag, strlen(flag), h);
+
+	if (asprintf(&obj, "%s/gib_jit_%016llx.so", dir, h) < 0) {
+		free(code);
+		return GIB_OOM;
+	}
+	rc = gib_jit_load(obj, k);
+	if (rc == GIB_BUSY && build) {
+		rc = gib_jit_build(dir, cc, flag, code, code_len, obj);
+		if (rc == GIB_SUC)
+			rc = gib_jit_load(obj, k);
+	}
+	free(code);
+	free(obj);
+	return rc;
+}
+
+void
+gib_jit_release(struct gib_jit_kernel *k)
+{
+	dlclose(k->handle);
+}
+
+int
+gib_jit_init(int n, int m, struct gib_context_t **c)
+{
+	struct gib_jit_context *jc;
+	int rc;
+
+	rc = gib_cpu_init(n, m, c);
+	if (rc != GIB_SUC)
+		return rc;
+
+	jc = malloc(sizeof(struct gib_jit_context));
+	if (jc == NULL) {
+		gib_cpu_destroy(*c);
+		return GIB_OOM;
+	}
+	jc->simd = gib_simd_get_dot(gib_simd_detect());
+	rc = gib_jit_compile((*c)->F, m, n, 1, &jc->gen);
+	if (rc != GIB_SUC) {
+		free(jc);
+		gib_cpu_destroy(*c);
+		return rc;
+	}
+	(*c)->acc_context = jc;
+	return GIB_SUC;
+}
+
+int
+gib_jit_destroy(struct gib_context_t *c)
+{
+	struct gib_jit_context *jc = c->acc_context;
+
+	gib_jit_release(&jc->gen);
+	free(jc);
+	return gib_cpu_destroy(c);
+}
+
+static void
+gib_jit_plan_put(struct gib_jit_plan *jp)
+{
+	if (__sync_sub_and_fetch(&jp->refs, 1) != 0)
+		return;
+	if (jp->state == GIB_JIT_READY)
+		gib_jit_release(&jp->k);
+	free(jp);
+}
+
+static void
+gib_jit_plan_free(void *priv)
+{
+	gib_jit_plan_put(priv);
+}
+
+/* Kills the compilers still running, and waits for their threads to
+ * clean up after them.
+ */
+static void
+gib_jit_exit(void)
+{
+	pid_t pid;
+	int i;
+
+	for (i = 0; i < GIB_JIT_COMPILES; i++) {
+		while ((pid = __atomic_load_n(&gib_jit_children[i],
+					      __ATOMIC_ACQUIRE)) != 0) {
+			if (pid > 0)
+				kill(-pid, SIGKILL);
+			usleep(1000);
+		}
+	}
+}
+
+static void
+gib_jit_atexit(void)
+{
+	atexit(gib_jit_exit);
+}
+
+static void *
+gib_jit_plan_compile(void *arg)
+{
+	struct gib_jit_plan *jp = arg;
+	struct gib_jit_kernel k;
+
+	gib_jit_child = &gib_jit_children[jp->slot];
+	if (gib_jit_compile(jp->mat, jp->rows, jp->cols, 1, &k) == GIB_SUC) {
+		jp->k = k;
+		__atomic_store_n(&jp->state, GIB_JIT_READY, __ATOMIC_RELEASE);
+	} else {
+		__atomic_store_n(&jp->state, GIB_JIT_FAILED, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(gib_jit_child, 0, __ATOMIC_RELEASE);
+	gib_jit_plan_put(jp);
+	return NULL;
+}
+
+static void
+gib_jit_plan_start(struct gib_jit_plan *jp)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+	int i, rc;
+
+	for (i = 0; i < GIB_JIT_COMPILES; i++)
+		if (__sync_bool_compare_and_swap(&gib_jit_children[i], 0, -1))
+			break;
+	if (i == GIB_JIT_COMPILES)
+		return;
+	if (!__sync_bool_compare_and_swap(&jp->state, GIB_JIT_WAITING,
+					  GIB_JIT_COMPILING)) {
+		__atomic_store_n(&gib_jit_children[i], 0, __ATOMIC_RELEASE);
+		return;
+	}
+	pthread_once(&gib_jit_once, gib_jit_atexit);
+	jp->slot = i;
+	__sync_fetch_and_add(&jp->refs, 1);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	rc = pthread_create(&tid, &attr, gib_jit_plan_compile, jp);
+	pthread_attr_destroy(&attr);
+	if (rc != 0) {
+		__sync_fetch_and_sub(&jp->refs, 1);
+		__atomic_store_n(&jp->state, GIB_JIT_WAITING, __ATOMIC_RELEASE);
+		__atomic_store_n(&gib_jit_children[i], 0, __ATOMIC_RELEASE);
+	}
+}
+
+/* Plans carry a kernel compiled for their decoding rows, if it is
+ * already cached, and otherwise the SIMD tables for them.
+ */
+static int
+gib_jit_plan_build(struct gib_context_t *c, int *buf_ids,
+		   struct gib_plan *plan)
+{
+	struct gib_jit_plan *jp;
+	int i, rc, len = plan->recover_last * c->n;
+	unsigned long bytes;
+
+	rc = gib_plan_build_rows(c, buf_ids, plan);
+	if (rc)
+		return rc;
+	bytes = sizeof(struct gib_jit_plan) +
+		len * (sizeof(struct gib_simd_tab) + 1);
+	jp = malloc(bytes);
+	if (jp == NULL)
+		return GIB_OOM;
+	jp->tabs = (struct gib_simd_tab *)(jp + 1);
+	jp->mat = (unsigned char *)(jp->tabs + len);
+	memcpy(jp->mat, plan->rows, len);
+	jp->rows = plan->recover_last;
+	jp->cols = c->n;
+	jp->refs = 1;
+	plan->priv = jp;
+	plan->priv_free = gib_jit_plan_free;
+	plan->bytes += bytes;
+
+	if (gib_jit_compile(jp->mat, jp->rows, jp->cols, 0, &jp->k) ==
+	    GIB_SUC) {
+		jp->state = GIB_JIT_READY;
+		return GIB_SUC;
+	}
+	for (i = 0; i < len; i++)
+		gib_simd_tab_init(&jp->tabs[i], jp->mat[i]);
+	jp->state = GIB_JIT_WAITING;
+	gib_jit_plan_start(jp);
+	return GIB_SUC;
+}
+
+int
+gib_jit_generate_nc(void *buffers, int buf_size, int work_size,
+		    struct gib_context_t *c)
+{
+	unsigned char *c_buf = buffers;
+	unsigned char *in[256], *out[256];
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		in[i] = c_buf + i * buf_size;
+	for (i = 0; i < c->m; i++)
+		out[i] = c_buf + (c->n + i) * buf_size;
+	return gib_jit_generate_iov(in, out, work_size, c);
+}
+
+int
+gib_jit_recover_nc(void *buffers, int buf_size, int work_size,
+		   int *buf_ids, int recover_last, struct gib_context_t *c)
+{
+	unsigned char *c_buf = buffers;
+	unsigned char *in[256], *out[256];
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		in[i] = c_buf + i * buf_size;
+	for (i = 0; i < recover_last; i++)
+		out[i] = c_buf + (c->n + i) * buf_size;
+	return gib_jit_recover_iov(in, buf_ids, out, recover_last, work_size,
+				   c);
+}
+
+int
+gib_jit_generate_iov(unsigned char **data, unsigned char **parity,
+		     int len, struct gib_context_t *c)
+{
+	struct gib_jit_context *jc = c->acc_context;
+
+	jc->gen.dot(data, parity, len);
+	return GIB_SUC;
+}
+
+int
+gib_jit_recover_iov(unsigned char **survivors, int *buf_ids,
+		    unsigned char **out, int recover_last, int len,
+		    struct gib_context_t *c)
+{
+	struct gib_jit_context *jc = c->acc_context;
+	struct gib_jit_plan *jp;
+	struct gib_plan *plan;
+	int rc, state;
+
+	rc = gib_plan_get(c, buf_ids, recover_last, gib_jit_plan_build,
+			  &plan);
+	if (rc)
+		return rc;
+	jp = plan->priv;
+	state = __atomic_load_n(&jp->state, __ATOMIC_ACQUIRE);
+	if (state == GIB_JIT_READY) {
+		jp->k.dot(survivors, out, len);
+	} else {
+		if (state == GIB_JIT_WAITING)
+			gib_jit_plan_start(jp);
+		jc->simd(jp->tabs, recover_last, c->n, survivors, out, len);
+	}
+	gib_plan_put(c, plan);
+	return GIB_SUC;
+}
@@ -0,0 +1,160 @@
+/* gib_numa.c: Internal view of the machine's NUMA topology
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ *
+ */
+
+/* The topology is read once from sysfs, so that no NUMA library is
+ * needed.  Where it cannot be read, the machine is one node.  On a
+ * one-node machine, GIB_NUMA_NODES splits the processors into that
+ * many pretend nodes, which exercises the NUMA paths without the
+ * hardware.
+ */
+
+#define _GNU_SOURCE
+#include "../inc/gibraltar.h"
+#include "../inc/gib_numa.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_once_t gib_numa_once = PTHREAD_ONCE_INIT;
+static int gib_numa_count = 1;
+static int gib_numa_ids[GIB_NUMA_MAX_NODES];
+static cpu_set_t gib_numa_cpus[GIB_NUMA_MAX_NODES];
+static signed char gib_numa_cpu_node[CPU_SETSIZE];
+
+/* Reads a list such as "0-3,8-11" from path into set */
+static int
+gib_numa_read_list(const char *path, cpu_set_t *set)
+{
+	char buf[4096], *p;
+	FILE *fp;
+	long lo, hi;
+
+	CPU_ZERO(set);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return GIB_ERR;
+	p = fgets(buf, sizeof(buf), fp);
+	fclose(fp);
+	if (p == NULL)
+		return GIB_ERR;
+
+	while (*p >= '0' && *p <= '9') {
+		lo = hi = strtol(p, &p, 10);
+		if (*p == '-')
+			hi = strtol(p + 1, &p, 10);
+		for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+			CPU_SET(lo, set);
+		if (*p == ',')
+			p++;
+	}
+	return GIB_SUC;
+}
+
+static void
+gib_numa_emulate(int count)
+{
+	cpu_set_t all = gib_numa_cpus[0];
+	int cpu, node, ncpus = CPU_COUNT(&all), seen = 0;
+
+	for (node = 0; node < count; node++) {
+		CPU_ZERO(&gib_numa_cpus[node]);
+		gib_numa_ids[node] = gib_numa_ids[0];
+	}
+	/* Deal the processors out; with too few, nodes share them */
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &all))
+			continue;
+		for (node = seen % count; node < count; node += ncpus)
+			CPU_SET(cpu, &gib_numa_cpus[node]);
+		gib_numa_cpu_node[cpu] = seen % count;
+		seen++;
+	}
+	gib_numa_count = count;
+}
+
+static void
+gib_numa_init(void)
+{
+	char path[64];
+	cpu_set_t online;
+	int id, cpu, count = 0;
+	char *env;
+
+	memset(gib_numa_cpu_node, 0, sizeof(gib_numa_cpu_node));
+	if (gib_numa_read_list("/sys/devices/system/node/online", &online))
+		return;
+
+	for (id = 0; id < CPU_SETSIZE && count < GIB_NUMA_MAX_NODES; id++) {
+		if (!CPU_ISSET(id, &online))
+			continue;
+		sprintf(path, "/sys/devices/system/node/node%i/cpulist", id);
+		/* Memory-only nodes have no threads to run */
+		if (gib_numa_read_list(path, &gib_numa_cpus[count]) ||
+		    CPU_COUNT(&gib_numa_cpus[count]) == 0)
+			continue;
+		for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &gib_numa_cpus[count]))
+				gib_numa_cpu_node[cpu] = count;
+		gib_numa_ids[count++] = id;
+	}
+	if (count > 0)
+		gib_numa_count = count;
+
+	env = getenv("GIB_NUMA_NODES");
+	if (count == 1 && env != NULL && atoi(env) > 1)
+		gib_numa_emulate(atoi(env) < GIB_NUMA_MAX_NODES ?
+				 atoi(env) : GIB_NUMA_MAX_NODES);
+}
+
+int
+gib_numa_nodes(void)
+{
+	pthread_once(&gib_numa_once, gib_numa_init);
+	return gib_numa_count;
+}
+
+int
+gib_numa_id(int node)
+{
+	pthread_once(&gib_numa_once, gib_numa_init);
+	if (node < 0 || node >= gib_numa_count || gib_numa_count == 1)
+		return 0;
+	return gib_numa_ids[node];
+}
+
+int
+gib_numa_bind_thread(int node)
+{
+	pthread_once(&gib_numa_once, gib_numa_init);
+	if (gib_numa_count == 1)
+		return GIB_SUC;
+	if (node < 0 || node >= gib_numa_count)
+		return GIB_ERR;
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+				   &gib_numa_cpus[node]))
+		return GIB_ERR;
+	return GIB_SUC;
+}
+
+int
+gib_numa_current(void)
+{
+	int cpu;
+
+	pthread_once(&gib_numa_once, gib_numa_init);
+	if (gib_numa_count == 1)
+		return 0;
+	cpu = sched_getcpu();
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return 0;
+	return gib_numa_cpu_node[cpu];
+}
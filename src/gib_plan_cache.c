@@ -0,0 +1,238 @@
+/* gib_plan_cache.c: Per-context cache of prepared decoding plans
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Plans account for the memory they hold.
+ *
+ */
+
+/* Inverting the survivor matrix costs O(n^3) per recovery, which
+ * dominates small recoveries.  A rebuild recovers the same erasure
+ * pattern over and over, so each context keeps the most recently used
+ * plans, keyed by buf_ids, in a small LRU list.  Plans are reference
+ * counted, so one evicted while in use is freed by its last user.
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_plan_cache.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct gib_plan_cache {
+	pthread_mutex_t lock;
+	int capacity;
+	int size;
+	struct gib_plan *head; /* Most recently used */
+	struct gib_plan *tail;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long bytes;
+};
+
+int
+gib_plan_cache_create(int capacity, struct gib_plan_cache **pc)
+{
+	char *env = getenv("GIB_PLAN_CACHE_SIZE");
+
+	if (env != NULL)
+		capacity = atoi(env);
+	if (capacity < 0)
+		capacity = 0;
+
+	*pc = calloc(1, sizeof(struct gib_plan_cache));
+	if (*pc == NULL)
+		return GIB_OOM;
+	pthread_mutex_init(&(*pc)->lock, NULL);
+	(*pc)->capacity = capacity;
+	return GIB_SUC;
+}
+
+static void
+gib_plan_free(struct gib_plan *plan)
+{
+	if (plan->priv_free != NULL)
+		plan->priv_free(plan->priv);
+	free(plan->rows);
+	free(plan->key);
+	free(plan);
+}
+
+void
+gib_plan_cache_destroy(struct gib_plan_cache *pc)
+{
+	struct gib_plan *plan, *next;
+
+	for (plan = pc->head; plan != NULL; plan = next) {
+		next = plan->next;
+		gib_plan_free(plan);
+	}
+	pthread_mutex_destroy(&pc->lock);
+	free(pc);
+}
+
+static unsigned long
+gib_plan_hash(int *key, int len)
+{
+	unsigned long h = 14695981039346656037UL;
+	int i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned)key[i]) * 1099511628211UL;
+	return h;
+}
+
+static void
+gib_plan_unlink(struct gib_plan_cache *pc, struct gib_plan *plan)
+{
+	if (plan->prev != NULL)
+		plan->prev->next = plan->next;
+	else
+		pc->head = plan->next;
+	if (plan->next != NULL)
+		plan->next->prev = plan->prev;
+	else
+		pc->tail = plan->prev;
+	plan->prev = plan->next = NULL;
+}
+
+static void
+gib_plan_push_front(struct gib_plan_cache *pc, struct gib_plan *plan)
+{
+	plan->prev = NULL;
+	plan->next = pc->head;
+	if (pc->head != NULL)
+		pc->head->prev = plan;
+	pc->head = plan;
+	if (pc->tail == NULL)
+		pc->tail = plan;
+}
+
+int
+gib_plan_get(struct gib_context_t *c, int *buf_ids, int recover_last,
+	     gib_plan_build_fn build, struct gib_plan **plan)
+{
+	struct gib_plan_cache *pc = c->plans;
+	struct gib_plan *p;
+	int len = c->n + recover_last;
+	unsigned long hash = gib_plan_hash(buf_ids, len);
+	int rc;
+
+	pthread_mutex_lock(&pc->lock);
+	for (p = pc->head; p != NULL; p = p->next) {
+		if (p->hash == hash && p->recover_last == recover_last &&
+		    memcmp(p->key, buf_ids, len * sizeof(int)) == 0) {
+			pc->hits++;
+			p->refs++;
+			gib_plan_unlink(pc, p);
+			gib_plan_push_front(pc, p);
+			pthread_mutex_unlock(&pc->lock);
+			*plan = p;
+			return GIB_SUC;
+		}
+	}
+	pc->misses++;
+	pthread_mutex_unlock(&pc->lock);
+
+	/* Built outside the lock, so that other patterns are not held
+	 * up.  Two threads missing on the same pattern both build it,
+	 * and both copies are cached until one ages out.
+	 */
+	p = calloc(1, sizeof(struct gib_plan));
+	if (p == NULL)
+		return GIB_OOM;
+	p->key = malloc(len * sizeof(int));
+	if (p->key == NULL) {
+		free(p);
+		return GIB_OOM;
+	}
+	memcpy(p->key, buf_ids, len * sizeof(int));
+	p->hash = hash;
+	p->recover_last = recover_last;
+	rc = build(c, buf_ids, p);
+	if (rc != GIB_SUC) {
+		gib_plan_free(p);
+		return rc;
+	}
+	p->refs = 1;
+
+	pthread_mutex_lock(&pc->lock);
+	if (pc->capacity > 0) {
+		p->refs++; /* The cache's reference */
+		gib_plan_push_front(pc, p);
+		pc->size++;
+		pc->bytes += p->bytes;
+		while (pc->size > pc->capacity) {
+			struct gib_plan *old = pc->tail;
+			gib_plan_unlink(pc, old);
+			pc->size--;
+			pc->bytes -= old->bytes;
+			if (--old->refs == 0)
+				gib_plan_free(old);
+		}
+	}
+	pthread_mutex_unlock(&pc->lock);
+
+	*plan = p;
+	return GIB_SUC;
+}
+
+void
+gib_plan_put(struct gib_context_t *c, struct gib_plan *plan)
+{
+	struct gib_plan_cache *pc = c->plans;
+	int refs;
+
+	pthread_mutex_lock(&pc->lock);
+	refs = --plan->refs;
+	pthread_mutex_unlock(&pc->lock);
+	if (refs == 0)
+		gib_plan_free(plan);
+}
+
+int
+gib_plan_build_rows(struct gib_context_t *c, int *buf_ids,
+		    struct gib_plan *plan)
+{
+	plan->rows = malloc(plan->recover_last * c->n);
+	if (plan->rows == NULL)
+		return GIB_OOM;
+	plan->bytes += plan->recover_last * c->n;
+	return gib_cpu_decode_rows(c, buf_ids, plan->recover_last, plan->rows);
+}
+
+int
+gib_plan_stats(struct gib_context_t *c, unsigned long *hits,
+	       unsigned long *misses)
+{
+	struct gib_plan_cache *pc = c->plans;
+
+	if (pc == NULL)
+		return GIB_ERR;
+	pthread_mutex_lock(&pc->lock);
+	*hits = pc->hits;
+	*misses = pc->misses;
+	pthread_mutex_unlock(&pc->lock);
+	return GIB_SUC;
+}
+
+int
+gib_table_footprint(struct gib_context_t *c, unsigned long *context_bytes,
+		    unsigned long *plan_bytes)
+{
+	struct gib_plan_cache *pc = c->plans;
+
+	*context_bytes = c->table_bytes;
+	*plan_bytes = 0;
+	if (pc != NULL) {
+		pthread_mutex_lock(&pc->lock);
+		*plan_bytes = pc->bytes;
+		pthread_mutex_unlock(&pc->lock);
+	}
+	return GIB_SUC;
+}
@@ -0,0 +1,328 @@
+/* gib_ring.c: Internal bounded lock-free rings and futex waiting
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Rings and events may live in memory shared between processes.
+ * Events may be waited on with a timeout.
+ *
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_ring.h"
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/* Spin budget of an eventcount, in polls of its condition */
+#define GIB_SPIN_MIN 16
+#define GIB_SPIN_MAX 4096
+
+static unsigned long
+gib_ring_depth(unsigned long depth)
+{
+	unsigned long d = 2;
+
+	while (d < depth)
+		d <<= 1;
+	return d;
+}
+
+static struct gib_ring_slot *
+gib_ring_slots(unsigned long depth)
+{
+	void *slots;
+
+	if (posix_memalign(&slots, GIB_RING_LINE,
+			   depth * sizeof(struct gib_ring_slot)))
+		return NULL;
+	return slots;
+}
+
+int
+gib_spsc_init(struct gib_spsc *r, unsigned long depth)
+{
+	depth = gib_ring_depth(depth);
+	r->slots = gib_ring_slots(depth);
+	if (r->slots == NULL)
+		return GIB_OOM;
+	r->mask = depth - 1;
+	r->head = r->tail = 0;
+	r->head_cache = r->tail_cache = 0;
+	return GIB_SUC;
+}
+
+void
+gib_spsc_destroy(struct gib_spsc *r)
+{
+	free(r->slots);
+}
+
+int
+gib_spsc_push(struct gib_spsc *r, void *ptr, long val)
+{
+	unsigned long tail = r->tail;
+	struct gib_ring_slot *s;
+
+	if (tail - r->head_cache > r->mask) {
+		r->head_cache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (tail - r->head_cache > r->mask)
+			return GIB_BUSY;
+	}
+	s = &r->slots[tail & r->mask];
+	s->ptr = ptr;
+	s->val = val;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return GIB_SUC;
+}
+
+int
+gib_spsc_pop(struct gib_spsc *r, void **ptr, long *val)
+{
+	unsigned long head = r->head;
+	struct gib_ring_slot *s;
+
+	if (head == r->tail_cache) {
+		r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		if (head == r->tail_cache)
+			return GIB_BUSY;
+	}
+	s = &r->slots[head & r->mask];
+	*ptr = s->ptr;
+	*val = s->val;
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return GIB_SUC;
+}
+
+unsigned long
+gib_spsc_count(struct gib_spsc *r)
+{
+	unsigned long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - head;
+}
+
+void
+gib_mpmc_init_in(struct gib_mpmc *r, struct gib_ring_slot *slots,
+		 unsigned long depth)
+{
+	unsigned long i;
+
+	for (i = 0; i < depth; i++)
+		slots[i].seq = i;
+	r->slots = slots;
+	r->mask = depth - 1;
+	r->head = r->tail = 0;
+}
+
+int
+gib_mpmc_init(struct gib_mpmc *r, unsigned long depth)
+{
+	struct gib_ring_slot *slots;
+
+	depth = gib_ring_depth(depth);
+	slots = gib_ring_slots(depth);
+	if (slots == NULL)
+		return GIB_OOM;
+	gib_mpmc_init_in(r, slots, depth);
+	return GIB_SUC;
+}
+
+void
+gib_mpmc_destroy(struct gib_mpmc *r)
+{
+	free(r->slots);
+}
+
+/* A slot at position pos is free for writing when its seq is pos, and
+ * holds an item for reading when its seq is pos + 1.  Reading it sets
+ * seq to the position it will have one lap later.
+ */
+int
+gib_mpmc_push_in(struct gib_mpmc *r, struct gib_ring_slot *slots,
+		 unsigned long depth, void *ptr, long val)
+{
+	unsigned long pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	struct gib_ring_slot *s;
+	long dif;
+
+	for (;;) {
+		s = &slots[pos & (depth - 1)];
+		dif = (long)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1,
+							1, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return GIB_BUSY;
+		} else {
+			pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+		}
+	}
+	s->ptr = ptr;
+	s->val = val;
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+	return GIB_SUC;
+}
+
+/* Each retry means another consumer took the slot first, so with tries
+ * nonzero, running out of them means the ring is damaged.
+ */
+static int
+gib_mpmc_take(struct gib_mpmc *r, struct gib_ring_slot *slots,
+	      unsigned long depth, void **ptr, long *val, int tries)
+{
+	unsigned long pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	struct gib_ring_slot *s;
+	long dif;
+
+	for (;;) {
+		s = &slots[pos & (depth - 1)];
+		dif = (long)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) -
+			     (pos + 1));
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1,
+							1, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return GIB_BUSY;
+		} else {
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		}
+		if (tries > 0 && --tries == 0)
+			return GIB_ERR;
+	}
+	*ptr = s->ptr;
+	*val = s->val;
+	__atomic_store_n(&s->seq, pos + depth, __ATOMIC_RELEASE);
+	return GIB_SUC;
+}
+
+int
+gib_mpmc_pop_in(struct gib_mpmc *r, struct gib_ring_slot *slots,
+		unsigned long depth, void **ptr, long *val)
+{
+	return gib_mpmc_take(r, slots, depth, ptr, val, GIB_RING_TRIES);
+}
+
+int
+gib_mpmc_push(struct gib_mpmc *r, void *ptr, long val)
+{
+	return gib_mpmc_push_in(r, r->slots, r->mask + 1, ptr, val);
+}
+
+int
+gib_mpmc_pop(struct gib_mpmc *r, void **ptr, long *val)
+{
+	return gib_mpmc_take(r, r->slots, r->mask + 1, ptr, val, 0);
+}
+
+unsigned long
+gib_mpmc_count(struct gib_mpmc *r)
+{
+	unsigned long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	unsigned long tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	return (tail > head) ? tail - head : 0;
+}
+
+static void
+gib_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/* Sleeps for at most ms milliseconds, or for good if ms is negative */
+static void
+gib_futex_wait(int *addr, int val, int shared, int ms)
+{
+#ifdef __linux__
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+	syscall(SYS_futex, addr, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE,
+		val, ms < 0 ? NULL : &ts, NULL, 0);
+#else
+	sched_yield();
+#endif
+}
+
+static void
+gib_futex_wake(int *addr, int count, int shared)
+{
+#ifdef __linux__
+	syscall(SYS_futex, addr, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE,
+		count, NULL, NULL, 0);
+#endif
+}
+
+/* The waiter announces itself before its last look at the condition,
+ * and the notifier fences between making the condition true and
+ * looking for waiters, so at least one of them sees the other.  A
+ * notification between the waiter reading seq and sleeping changes
+ * seq, and the futex then refuses to sleep.
+ */
+int
+gib_event_await_for(struct gib_event *ev, int (*ready)(void *), void *arg,
+		    int ms)
+{
+	int i, seq, spin = __atomic_load_n(&ev->spin, __ATOMIC_RELAXED);
+
+	if (spin < GIB_SPIN_MIN)
+		spin = GIB_SPIN_MIN;
+	for (;;) {
+		for (i = 0; i < spin; i++) {
+			if (ready(arg)) {
+				if (i > 0 && spin < GIB_SPIN_MAX)
+					__atomic_store_n(&ev->spin, spin * 2,
+							 __ATOMIC_RELAXED);
+				return 1;
+			}
+			gib_cpu_relax();
+		}
+
+		__sync_fetch_and_add(&ev->waiters, 1);
+		seq = __atomic_load_n(&ev->seq, __ATOMIC_SEQ_CST);
+		if (ready(arg)) {
+			__sync_fetch_and_sub(&ev->waiters, 1);
+			return 1;
+		}
+		__sync_fetch_and_add(&ev->sleeps, 1);
+		gib_futex_wait(&ev->seq, seq, ev->shared, ms);
+		__sync_fetch_and_sub(&ev->waiters, 1);
+
+		if (spin > GIB_SPIN_MIN)
+			spin /= 2;
+		__atomic_store_n(&ev->spin, spin, __ATOMIC_RELAXED);
+		if (ms >= 0)
+			return ready(arg);
+	}
+}
+
+void
+gib_event_await(struct gib_event *ev, int (*ready)(void *), void *arg)
+{
+	gib_event_await_for(ev, ready, arg, -1);
+}
+
+void
+gib_event_notify(struct gib_event *ev, int all)
+{
+	__sync_synchronize();
+	if (__atomic_load_n(&ev->waiters, __ATOMIC_RELAXED) == 0)
+		return;
+	__sync_fetch_and_add(&ev->seq, 1);
+	__sync_fetch_and_add(&ev->wakeups, 1);
+	gib_futex_wake(&ev->seq, all ? INT_MAX : 1, ev->shared);
+}
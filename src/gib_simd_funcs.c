@@ -0,0 +1,725 @@
+/* gib_simd_funcs.c: Vectorized CPU implementation of the Gibraltar API.
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version; split-table kernels with runtime ISA dispatch.
+ * Added GF2P8AFFINEQB kernels for processors with GFNI.
+ * Added the parity update path for small writes.
+ * Added XOR kernels for m = 1.
+ * Plans and contexts account for their expanded tables.
+ * Buffers come from the aligned stripe allocator.
+ *
+ */
+
+/* Every product c*x in GF(2^8) is computed as lo[x & 0xf] ^ hi[x >> 4],
+ * where lo and hi are the products of c with all low and high nibbles.
+ * Each table is 16 bytes, so PSHUFB performs 16, 32 or 64 of these
+ * lookups at once.  The arithmetic is exact, so the results are
+ * bit-identical to the gib_gf_table based CPU implementation.
+ *
+ * Multiplication by a constant is also linear over GF(2), so on
+ * processors with GFNI it is a single GF2P8AFFINEQB against the 8x8
+ * bit matrix of the constant.
+ */
+
+#include "../inc/gib_galois.h"
+#include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_simd_funcs.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_plan_cache.h"
+#include "../inc/gib_alloc.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GIB_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define GIB_SIMD_X86 0
+#endif
+
+struct gib_simd_context {
+	int isa;
+	gib_simd_dot_fn dot;
+	struct gib_simd_tab *F_tabs; /* m*n tables, row-major like F */
+};
+
+static const char *isa_names[GIB_SIMD_NISA] = {
+	"scalar", "ssse3", "avx2", "avx512", "gfni-avx2", "gfni-avx512"
+};
+
+const char *
+gib_simd_isa_name(int isa)
+{
+	if (isa < 0 || isa >= GIB_SIMD_NISA)
+		return "unknown";
+	return isa_names[isa];
+}
+
+void
+gib_simd_tab_init(struct gib_simd_tab *t, unsigned char coef)
+{
+	int x, i;
+
+	for (x = 0; x < 16; x++) {
+		t->lo[x] = gib_gf_table[coef][x];
+		t->hi[x] = gib_gf_table[coef][x << 4];
+	}
+
+	/* Bit i of the affine result is the parity of x masked by byte
+	 * 7-i of the matrix, so that byte holds bit i of coef*2^j in its
+	 * position j.
+	 */
+	t->affine = 0;
+	for (i = 0; i < 8; i++) {
+		unsigned long long row = 0;
+		for (x = 0; x < 8; x++)
+			if (gib_gf_table[coef][1 << x] & (1 << i))
+				row |= 1 << x;
+		t->affine |= row << (8 * (7 - i));
+	}
+}
+
+/* Handles bytes [start, len), and is the whole kernel when no vector
+ * instructions are available.
+ */
+static void
+dot_scalar_range(const struct gib_simd_tab *tabs, int rows, int cols,
+		 unsigned char **in, unsigned char **out, int start, int len)
+{
+	int r, i, b;
+
+	for (r = 0; r < rows; r++) {
+		const struct gib_simd_tab *t = tabs + r * cols;
+		for (b = start; b < len; b++) {
+			unsigned char acc = 0;
+			for (i = 0; i < cols; i++) {
+				unsigned char x = in[i][b];
+				acc ^= t[i].lo[x & 0xf] ^ t[i].hi[x >> 4];
+			}
+			out[r][b] = acc;
+		}
+	}
+}
+
+static void
+dot_scalar(const struct gib_simd_tab *tabs, int rows, int cols,
+	   unsigned char **in, unsigned char **out, int len)
+{
+	dot_scalar_range(tabs, rows, cols, in, out, 0, len);
+}
+
+/* With m = 1 every coefficient is 1, and these plain XOR kernels take
+ * the place of the dot kernels; tabs is ignored.
+ */
+static void
+xor_scalar_range(unsigned char **in, int rows, int cols, unsigned char **out,
+		 int start, int len)
+{
+	int r, i, b;
+
+	for (r = 0; r < rows; r++) {
+		for (b = start; b < len; b++) {
+			unsigned char acc = 0;
+			for (i = 0; i < cols; i++)
+				acc ^= in[i][b];
+			out[r][b] = acc;
+		}
+	}
+}
+
+static void
+xor_word(const struct gib_simd_tab *tabs, int rows, int cols,
+	 unsigned char **in, unsigned char **out, int len)
+{
+	int off, r, i;
+
+	for (off = 0; off + 8 <= len; off += 8) {
+		for (r = 0; r < rows; r++) {
+			unsigned long long acc = 0, x;
+			for (i = 0; i < cols; i++) {
+				memcpy(&x, in[i] + off, 8);
+				acc ^= x;
+			}
+			memcpy(out[r] + off, &acc, 8);
+		}
+	}
+	xor_scalar_range(in, rows, cols, out, off, len);
+}
+
+#if GIB_SIMD_X86
+__attribute__((target("ssse3"))) static void
+dot_ssse3(const struct gib_simd_tab *tabs, int rows, int cols,
+	  unsigned char **in, unsigned char **out, int len)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	int off, r, i;
+
+	for (off = 0; off + 16 <= len; off += 16) {
+		for (r = 0; r < rows; r++) {
+			const struct gib_simd_tab *t = tabs + r * cols;
+			__m128i acc = _mm_setzero_si128();
+			for (i = 0; i < cols; i++) {
+				__m128i x, lo, hi;
+				x = _mm_loadu_si128((const __m128i *)
+						    (in[i] + off));
+				lo = _mm_loadu_si128((const __m128i *)t[i].lo);
+				hi = _mm_loadu_si128((const __m128i *)t[i].hi);
+				lo = _mm_shuffle_epi8(lo, _mm_and_si128(x, mask));
+				x = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+				hi = _mm_shuffle_epi8(hi, x);
+				acc = _mm_xor_si128(acc, _mm_xor_si128(lo, hi));
+			}
+			_mm_storeu_si128((__m128i *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range(tabs, rows, cols, in, out, off, len);
+}
+
+__attribute__((target("avx2"))) static void
+dot_avx2(const struct gib_simd_tab *tabs, int rows, int cols,
+	 unsigned char **in, unsigned char **out, int len)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	int off, r, i;
+
+	for (off = 0; off + 32 <= len; off += 32) {
+		for (r = 0; r < rows; r++) {
+			const struct gib_simd_tab *t = tabs + r * cols;
+			__m256i acc = _mm256_setzero_si256();
+			for (i = 0; i < cols; i++) {
+				__m256i x, lo, hi;
+				x = _mm256_loadu_si256((const __m256i *)
+						       (in[i] + off));
+				lo = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128((const __m128i *)
+							t[i].lo));
+				hi = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128((const __m128i *)
+							t[i].hi));
+				lo = _mm256_shuffle_epi8(
+					lo, _mm256_and_si256(x, mask));
+				x = _mm256_and_si256(_mm256_srli_epi64(x, 4),
+						     mask);
+				hi = _mm256_shuffle_epi8(hi, x);
+				acc = _mm256_xor_si256(
+					acc, _mm256_xor_si256(lo, hi));
+			}
+			_mm256_storeu_si256((__m256i *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range(tabs, rows, cols, in, out, off, len);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+dot_avx512(const struct gib_simd_tab *tabs, int rows, int cols,
+	   unsigned char **in, unsigned char **out, int len)
+{
+	const __m512i mask = _mm512_set1_epi8(0x0f);
+	int off, r, i;
+
+	for (off = 0; off + 64 <= len; off += 64) {
+		for (r = 0; r < rows; r++) {
+			const struct gib_simd_tab *t = tabs + r * cols;
+			__m512i acc = _mm512_setzero_si512();
+			for (i = 0; i < cols; i++) {
+				__m512i x, lo, hi;
+				x = _mm512_loadu_si512((const void *)
+						       (in[i] + off));
+				lo = _mm512_broadcast_i32x4(
+					_mm_loadu_si128((const __m128i *)
+							t[i].lo));
+				hi = _mm512_broadcast_i32x4(
+					_mm_loadu_si128((const __m128i *)
+							t[i].hi));
+				lo = _mm512_shuffle_epi8(
+					lo, _mm512_and_si512(x, mask));
+				x = _mm512_and_si512(_mm512_srli_epi64(x, 4),
+						     mask);
+				hi = _mm512_shuffle_epi8(hi, x);
+				acc = _mm512_xor_si512(
+					acc, _mm512_xor_si512(lo, hi));
+			}
+			_mm512_storeu_si512((void *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range(tabs, rows, cols, in, out, off, len);
+}
+
+__attribute__((target("avx2,gfni"))) static void
+dot_gfni_avx2(const struct gib_simd_tab *tabs, int rows, int cols,
+	      unsigned char **in, unsigned char **out, int len)
+{
+	int off, r, i;
+
+	for (off = 0; off + 32 <= len; off += 32) {
+		for (r = 0; r < rows; r++) {
+			const struct gib_simd_tab *t = tabs + r * cols;
+			__m256i acc = _mm256_setzero_si256();
+			for (i = 0; i < cols; i++) {
+				__m256i x, a;
+				x = _mm256_loadu_si256((const __m256i *)
+						       (in[i] + off));
+				a = _mm256_set1_epi64x(t[i].affine);
+				x = _mm256_gf2p8affine_epi64_epi8(x, a, 0);
+				acc = _mm256_xor_si256(acc, x);
+			}
+			_mm256_storeu_si256((__m256i *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range(tabs, rows, cols, in, out, off, len);
+}
+
+__attribute__((target("avx512f,avx512bw,gfni"))) static void
+dot_gfni_avx512(const struct gib_simd_tab *tabs, int rows, int cols,
+		unsigned char **in, unsigned char **out, int len)
+{
+	int off, r, i;
+
+	for (off = 0; off + 64 <= len; off += 64) {
+		for (r = 0; r < rows; r++) {
+			const struct gib_simd_tab *t = tabs + r * cols;
+			__m512i acc = _mm512_setzero_si512();
+			for (i = 0; i < cols; i++) {
+				__m512i x, a;
+				x = _mm512_loadu_si512((const void *)
+						       (in[i] + off));
+				a = _mm512_set1_epi64(t[i].affine);
+				x = _mm512_gf2p8affine_epi64_epi8(x, a, 0);
+				acc = _mm512_xor_si512(acc, x);
+			}
+			_mm512_storeu_si512((void *)(out[r] + off), acc);
+		}
+	}
+	dot_scalar_range(tabs, rows, cols, in, out, off, len);
+}
+
+__attribute__((target("sse2"))) static void
+xor_sse2(const struct gib_simd_tab *tabs, int rows, int cols,
+	 unsigned char **in, unsigned char **out, int len)
+{
+	int off, r, i;
+
+	for (off = 0; off + 16 <= len; off += 16) {
+		for (r = 0; r < rows; r++) {
+			__m128i acc = _mm_setzero_si128();
+			for (i = 0; i < cols; i++)
+				acc = _mm_xor_si128(acc, _mm_loadu_si128(
+					(const __m128i *)(in[i] + off)));
+			_mm_storeu_si128((__m128i *)(out[r] + off), acc);
+		}
+	}
+	xor_scalar_range(in, rows, cols, out, off, len);
+}
+
+__attribute__((target("avx2"))) static void
+xor_avx2(const struct gib_simd_tab *tabs, int rows, int cols,
+	 unsigned char **in, unsigned char **out, int len)
+{
+	int off, r, i;
+
+	for (off = 0; off + 32 <= len; off += 32) {
+		for (r = 0; r < rows; r++) {
+			__m256i acc = _mm256_setzero_si256();
+			for (i = 0; i < cols; i++)
+				acc = _mm256_xor_si256(acc, _mm256_loadu_si256(
+					(const __m256i *)(in[i] + off)));
+			_mm256_storeu_si256((__m256i *)(out[r] + off), acc);
+		}
+	}
+	xor_scalar_range(in, rows, cols, out, off, len);
+}
+
+__attribute__((target("avx512f"))) static void
+xor_avx512(const struct gib_simd_tab *tabs, int rows, int cols,
+	   unsigned char **in, unsigned char **out, int len)
+{
+	int off, r, i;
+
+	for (off = 0; off + 64 <= len; off += 64) {
+		for (r = 0; r < rows; r++) {
+			__m512i acc = _mm512_setzero_si512();
+			for (i = 0; i < cols; i++)
+				acc = _mm512_xor_si512(acc, _mm512_loadu_si512(
+					(const void *)(in[i] + off)));
+			_mm512_storeu_si512((void *)(out[r] + off), acc);
+		}
+	}
+	xor_scalar_range(in, rows, cols, out, off, len);
+}
+#endif
+
+static int
+gib_simd_supported(int isa)
+{
+#if GIB_SIMD_X86
+	__builtin_cpu_init();
+	switch (isa) {
+	case GIB_SIMD_SCALAR:
+		return 1;
+	case GIB_SIMD_SSSE3:
+		return __builtin_cpu_supports("ssse3");
+	case GIB_SIMD_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case GIB_SIMD_AVX512:
+		return __builtin_cpu_supports("avx512f") &&
+			__builtin_cpu_supports("avx512bw");
+	case GIB_SIMD_GFNI_AVX2:
+		return __builtin_cpu_supports("gfni") &&
+			__builtin_cpu_supports("avx2");
+	case GIB_SIMD_GFNI_AVX512:
+		return __builtin_cpu_supports("gfni") &&
+			__builtin_cpu_supports("avx512f") &&
+			__builtin_cpu_supports("avx512bw");
+	}
+	return 0;
+#else
+	return isa == GIB_SIMD_SCALAR;
+#endif
+}
+
+/* Picks the widest instruction set the processor supports.  Setting
+ * GIB_SIMD_ISA to one of the names in isa_names caps the choice, which
+ * is useful for comparing the kernels against each other.
+ */
+int
+gib_simd_detect(void)
+{
+	int isa, cap = GIB_SIMD_NISA - 1;
+	char *env = getenv("GIB_SIMD_ISA");
+
+	if (env != NULL) {
+		for (isa = 0; isa < GIB_SIMD_NISA; isa++)
+			if (strcmp(env, isa_names[isa]) == 0)
+				cap = isa;
+	}
+
+	for (isa = cap; isa > GIB_SIMD_SCALAR; isa--)
+		if (gib_simd_supported(isa))
+			break;
+	return isa;
+}
+
+gib_simd_dot_fn
+gib_simd_get_dot(int isa)
+{
+	switch (isa) {
+#if GIB_SIMD_X86
+	case GIB_SIMD_SSSE3:
+		return &dot_ssse3;
+	case GIB_SIMD_AVX2:
+		return &dot_avx2;
+	case GIB_SIMD_AVX512:
+		return &dot_avx512;
+	case GIB_SIMD_GFNI_AVX2:
+		return &dot_gfni_avx2;
+	case GIB_SIMD_GFNI_AVX512:
+		return &dot_gfni_avx512;
+#endif
+	default:
+		return &dot_scalar;
+	}
+}
+
+gib_simd_dot_fn
+gib_simd_get_xor(int isa)
+{
+	switch (isa) {
+#if GIB_SIMD_X86
+	case GIB_SIMD_SSSE3:
+		return &xor_sse2;
+	case GIB_SIMD_AVX2:
+	case GIB_SIMD_GFNI_AVX2:
+		return &xor_avx2;
+	case GIB_SIMD_AVX512:
+	case GIB_SIMD_GFNI_AVX512:
+		return &xor_avx512;
+#endif
+	default:
+		return &xor_word;
+	}
+}
+
+const char *
+gib_simd_path(struct gib_context_t *c)
+{
+	struct gib_simd_context *sc;
+
+	if (c == NULL)
+		return gib_simd_isa_name(gib_simd_detect());
+	if (c->strategy != &simd)
+		return "none";
+	sc = c->acc_context;
+	return gib_simd_isa_name(sc->isa);
+}
+
+int
+gib_simd_init(int n, int m, struct gib_context_t **c)
+{
+	struct gib_simd_context *sc;
+	int i, rc;
+
+	rc = gib_cpu_init(n, m, c);
+	if (rc != GIB_SUC)
+		return rc;
+
+	sc = malloc(sizeof(struct gib_simd_context));
+	if (sc == NULL) {
+		gib_cpu_destroy(*c);
+		return GIB_OOM;
+	}
+	sc->F_tabs = malloc(m * n * sizeof(struct gib_simd_tab));
+	if (sc->F_tabs == NULL) {
+		free(sc);
+		gib_cpu_destroy(*c);
+		return GIB_OOM;
+	}
+	for (i = 0; i < m * n; i++)
+		gib_simd_tab_init(&sc->F_tabs[i], (*c)->F[i]);
+	/* The nibble tables replace the CPU kernels' 256-byte rows. */
+	free((*c)->F_rows);
+	(*c)->F_rows = NULL;
+	(*c)->table_bytes = m * n * sizeof(struct gib_simd_tab);
+
+	sc->isa = gib_simd_detect();
+	if (m == 1)
+		sc->dot = gib_simd_get_xor(sc->isa);
+	else
+		sc->dot = gib_simd_get_dot(sc->isa);
+	(*c)->acc_context = sc;
+	return GIB_SUC;
+}
+
+int
+gib_simd_destroy(struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+
+	free(sc->F_tabs);
+	free(sc);
+	return gib_cpu_destroy(c);
+}
+
+int
+gib_simd_alloc(void **buffers, int buf_size, int *ld, struct gib_context_t *c)
+{
+	/* Unlike the reference implementation, every buffer begins on a
+	 * cache line, so no vector access straddles two lines.
+	 */
+	return gib_stripe_alloc(c->n + c->m, buf_size, 1, buffers, ld);
+}
+
+int
+gib_simd_free(void *buffers)
+{
+	gib_stripe_free(buffers);
+	return 0;
+}
+
+int
+gib_simd_generate_nc(void *buffers, int buf_size, int work_size,
+		     struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+	unsigned char *c_buf = buffers;
+	unsigned char *in[256], *out[256];
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		in[i] = c_buf + i * buf_size;
+	for (i = 0; i < c->m; i++)
+		out[i] = c_buf + (c->n + i) * buf_size;
+
+	sc->dot(sc->F_tabs, c->m, c->n, in, out, work_size);
+	return 0;
+}
+
+static void
+gib_simd_plan_free(void *priv)
+{
+	free(priv);
+}
+
+/* Plans for SIMD contexts carry the expanded tables of their rows. */
+static int
+gib_simd_plan_build(struct gib_context_t *c, int *buf_ids,
+		    struct gib_plan *plan)
+{
+	struct gib_simd_tab *tabs;
+	int i, rc, len = plan->recover_last * c->n;
+
+	rc = gib_plan_build_rows(c, buf_ids, plan);
+	if (rc)
+		return rc;
+
+	tabs = malloc(len * sizeof(struct gib_simd_tab));
+	if (tabs == NULL)
+		return GIB_OOM;
+	for (i = 0; i < len; i++)
+		gib_simd_tab_init(&tabs[i], plan->rows[i]);
+	plan->priv = tabs;
+	plan->priv_free = gib_simd_plan_free;
+	plan->bytes += len * sizeof(struct gib_simd_tab);
+	return 0;
+}
+
+int
+gib_simd_recover_nc(void *buffers, int buf_size, int work_size,
+		    int *buf_ids, int recover_last, struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+	unsigned char *c_buf = buffers;
+	unsigned char *in[256], *out[256];
+	struct gib_plan *plan;
+	int i, rc;
+
+	rc = gib_plan_get(c, buf_ids, recover_last, gib_simd_plan_build,
+			  &plan);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < c->n; i++)
+		in[i] = c_buf + i * buf_size;
+	for (i = 0; i < recover_last; i++)
+		out[i] = c_buf + (c->n + i) * buf_size;
+
+	sc->dot(plan->priv, recover_last, c->n, in, out, work_size);
+	gib_plan_put(c, plan);
+	return 0;
+}
+
+static void
+gib_simd_prefetch_stripe(unsigned char *buf, int buf_size, int nbufs)
+{
+	int i, b;
+
+	for (i = 0; i < nbufs; i++)
+		for (b = 0; b < 256 && b < buf_size; b += 64)
+			__builtin_prefetch(buf + i * buf_size + b);
+}
+
+int
+gib_simd_generate_batch(void **buffers, int *buf_sizes, int count,
+			struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+	unsigned char *in[256], *out[256];
+	int s, i;
+
+	for (s = 0; s < count; s++) {
+		unsigned char *c_buf = buffers[s];
+		if (s + 1 < count)
+			gib_simd_prefetch_stripe(buffers[s+1],
+						 buf_sizes[s+1], c->n);
+		for (i = 0; i < c->n; i++)
+			in[i] = c_buf + i * buf_sizes[s];
+		for (i = 0; i < c->m; i++)
+			out[i] = c_buf + (c->n + i) * buf_sizes[s];
+		sc->dot(sc->F_tabs, c->m, c->n, in, out, buf_sizes[s]);
+	}
+	return 0;
+}
+
+int
+gib_simd_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+		       int *recover_last, int count, struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+	unsigned char *in[256], *out[256];
+	struct gib_plan *plan;
+	int s, i, rc;
+	int n = c->n;
+
+	for (s = 0; s < count; s++) {
+		unsigned char *c_buf = buffers[s];
+		int r = recover_last[s];
+
+		rc = gib_plan_get(c, buf_ids[s], r, gib_simd_plan_build,
+				  &plan);
+		if (rc)
+			return rc;
+		if (s + 1 < count)
+			gib_simd_prefetch_stripe(buffers[s+1],
+						 buf_sizes[s+1], n);
+		for (i = 0; i < n; i++)
+			in[i] = c_buf + i * buf_sizes[s];
+		for (i = 0; i < r; i++)
+			out[i] = c_buf + (n + i) * buf_sizes[s];
+		sc->dot(plan->priv, r, n, in, out, buf_sizes[s]);
+		gib_plan_put(c, plan);
+	}
+	return 0;
+}
+
+int
+gib_simd_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		      struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+
+	sc->dot(sc->F_tabs, c->m, c->n, data, parity, len);
+	return 0;
+}
+
+int
+gib_simd_recover_iov(unsigned char **survivors, int *buf_ids,
+		     unsigned char **out, int recover_last, int len,
+		     struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+	struct gib_plan *plan;
+	int rc;
+
+	rc = gib_plan_get(c, buf_ids, recover_last, gib_simd_plan_build,
+			  &plan);
+	if (rc)
+		return rc;
+	sc->dot(plan->priv, recover_last, c->n, survivors, out, len);
+	gib_plan_put(c, plan);
+	return 0;
+}
+
+/* Bytes of each buffer handled per pass of the update path, so that the
+ * old and new data stay in L1 while every parity buffer is visited.
+ */
+#define GIB_SIMD_UPDATE_CHUNK 4096
+
+/* The update is run through the dot kernels one parity at a time, as
+ *   p = F[j][d_0]*old_0 + F[j][d_0]*new_0 + ... + 1*p
+ * which avoids a scratch buffer for old ^ new.  Every kernel loads all
+ * of its inputs at an offset before storing its output there, so p may
+ * be both the last input and the output.
+ */
+int
+gib_simd_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		     unsigned char **new_data, unsigned char **parity,
+		     int len, struct gib_context_t *c)
+{
+	struct gib_simd_context *sc = c->acc_context;
+	struct gib_simd_tab tabs[2*256 + 1];
+	unsigned char *in[2*256 + 1], *out[1];
+	int cols = 2 * ncols + 1;
+	int t, i, j, chunk;
+
+	gib_simd_tab_init(&tabs[2 * ncols], 1);
+	for (t = 0; t < len; t += GIB_SIMD_UPDATE_CHUNK) {
+		chunk = (len - t < GIB_SIMD_UPDATE_CHUNK) ?
+			len - t : GIB_SIMD_UPDATE_CHUNK;
+		for (i = 0; i < ncols; i++) {
+			in[2*i] = old_data[i] + t;
+			in[2*i + 1] = new_data[i] + t;
+		}
+		for (j = 0; j < c->m; j++) {
+			for (i = 0; i < ncols; i++) {
+				tabs[2*i] = sc->F_tabs[j*c->n + data_ids[i]];
+				tabs[2*i + 1] = tabs[2*i];
+			}
+			in[2 * ncols] = out[0] = parity[j] + t;
+			sc->dot(tabs, 1, cols, in, out, chunk);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,257 @@
+/* gib_thread_pool.c: Persistent worker threads for the parallel backend
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Workers can be pinned to NUMA nodes and take jobs from their own.
+ *
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_thread_pool.h"
+#include "../inc/gib_numa.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Jobs [next, end) of one node, claimed by atomically advancing next */
+struct gib_pool_queue {
+	int next;
+	int end;
+	char pad[56];
+};
+
+struct gib_pool_worker {
+	struct gib_pool *pool;
+	int node;
+};
+
+/* Node of each worker thread, or -1 for threads outside any pool */
+static __thread int gib_pool_node = -1;
+
+struct gib_pool {
+	int nthreads; /* Total, including the thread calling gib_pool_run */
+	int nnodes;
+	pthread_t *threads;
+	struct gib_pool_worker *workers;
+	struct gib_pool_queue *queues;
+	pthread_mutex_t run_lock; /* Serializes gib_pool_run */
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	unsigned long generation;
+	int shutdown;
+	int active; /* Workers that have not finished this generation */
+
+	gib_pool_fn fn;
+	void *arg;
+	int local; /* Threads only run their own node's jobs */
+};
+
+static void
+gib_pool_drain(struct gib_pool *pool, int node)
+{
+	struct gib_pool_queue *q;
+	int i, job;
+
+	for (i = 0; i < pool->nnodes; i++) {
+		q = &pool->queues[(node + i) % pool->nnodes];
+		while ((job = __sync_fetch_and_add(&q->next, 1)) < q->end)
+			pool->fn(pool->arg, job);
+		if (pool->local)
+			break;
+	}
+}
+
+static void *
+gib_pool_worker(void *arg)
+{
+	struct gib_pool_worker *w = arg;
+	struct gib_pool *pool = w->pool;
+	unsigned long seen = 0;
+
+	if (pool->nnodes > 1)
+		gib_numa_bind_thread(w->node);
+	gib_pool_node = w->node;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->generation == seen && !pool->shutdown)
+			pthread_cond_wait(&pool->work_cv, &pool->lock);
+		if (pool->shutdown) {
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		gib_pool_drain(pool, w->node);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->active == 0)
+			pthread_cond_signal(&pool->done_cv);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+int
+gib_pool_create(int nthreads, struct gib_pool **pool)
+{
+	return gib_pool_create_numa(nthreads, 1, pool);
+}
+
+int
+gib_pool_create_numa(int nthreads, int nodes, struct gib_pool **pool)
+{
+	struct gib_pool *p;
+	int i;
+
+	if (nthreads < 1 || nodes < 1 || nodes > GIB_NUMA_MAX_NODES)
+		return GIB_ERR;
+
+	p = calloc(1, sizeof(struct gib_pool));
+	if (p == NULL)
+		return GIB_OOM;
+	p->nthreads = nthreads;
+	p->nnodes = nodes;
+	pthread_mutex_init(&p->run_lock, NULL);
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work_cv, NULL);
+	pthread_cond_init(&p->done_cv, NULL);
+
+	p->threads = malloc(nthreads * sizeof(pthread_t));
+	p->workers = malloc(nthreads * sizeof(struct gib_pool_worker));
+	p->queues = calloc(nodes, sizeof(struct gib_pool_queue));
+	if (p->threads == NULL || p->workers == NULL || p->queues == NULL) {
+		free(p->queues);
+		free(p->workers);
+		free(p->threads);
+		free(p);
+		return GIB_OOM;
+	}
+	for (i = 0; i < nthreads - 1; i++) {
+		/* Thread 0, the caller, is counted on node 0 */
+		p->workers[i].pool = p;
+		p->workers[i].node = (i + 1) % nodes;
+		if (pthread_create(&p->threads[i], NULL, gib_pool_worker,
+				   &p->workers[i])) {
+			p->nthreads = i + 1;
+			gib_pool_destroy(p);
+			return GIB_ERR;
+		}
+	}
+
+	*pool = p;
+	return GIB_SUC;
+}
+
+int
+gib_pool_destroy(struct gib_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->nthreads - 1; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cv);
+	pthread_cond_destroy(&pool->work_cv);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_mutex_destroy(&pool->run_lock);
+	free(pool->queues);
+	free(pool->workers);
+	free(pool->threads);
+	free(pool);
+	return GIB_SUC;
+}
+
+int
+gib_pool_size(struct gib_pool *pool)
+{
+	return pool->nthreads;
+}
+
+int
+gib_pool_nodes(struct gib_pool *pool)
+{
+	return pool->nnodes;
+}
+
+int
+gib_pool_node_size(struct gib_pool *pool, int node)
+{
+	if (node < 0 || node >= pool->nnodes)
+		return 0;
+	return (pool->nthreads - node + pool->nnodes - 1) / pool->nnodes;
+}
+
+int
+gib_pool_current_node(struct gib_pool *pool)
+{
+	if (pool->nnodes == 1)
+		return 0;
+	/* Workers of any pool know their node, not just this one's */
+	if (gib_pool_node >= 0)
+		return gib_pool_node % pool->nnodes;
+	return gib_numa_current() % pool->nnodes;
+}
+
+int
+gib_pool_run(struct gib_pool *pool, int njobs, gib_pool_fn fn, void *arg)
+{
+	int node_jobs[GIB_NUMA_MAX_NODES];
+	int i;
+
+	/* Every thread starts on the first queue */
+	for (i = 0; i < pool->nnodes; i++)
+		node_jobs[i] = 0;
+	node_jobs[0] = njobs;
+	return gib_pool_run_nodes(pool, node_jobs, 0, fn, arg);
+}
+
+int
+gib_pool_run_nodes(struct gib_pool *pool, const int *node_jobs, int local,
+		   gib_pool_fn fn, void *arg)
+{
+	int i, njobs = 0;
+
+	for (i = 0; i < pool->nnodes; i++)
+		njobs += node_jobs[i];
+
+	pthread_mutex_lock(&pool->run_lock);
+	if (njobs == 1 || pool->nthreads == 1) {
+		int job;
+		for (job = 0; job < njobs; job++)
+			fn(arg, job);
+		pthread_mutex_unlock(&pool->run_lock);
+		return GIB_SUC;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->local = local;
+	for (i = 0, njobs = 0; i < pool->nnodes; i++) {
+		pool->queues[i].next = njobs;
+		njobs += node_jobs[i];
+		pool->queues[i].end = njobs;
+	}
+	pool->active = pool->nthreads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+
+	gib_pool_drain(pool, gib_pool_current_node(pool));
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->active != 0)
+		pthread_cond_wait(&pool->done_cv, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_unlock(&pool->run_lock);
+	return GIB_SUC;
+}
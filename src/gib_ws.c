@@ -0,0 +1,303 @@
+/* gib_ws.c: Work-stealing execution of batches of independent stripes
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Splits stripes at multiples of their context's block size.
+ *
+ */
+
+/* A batch is cut into tasks of roughly grain bytes of input: stripes
+ * much larger than that are split into byte ranges through the
+ * noncontiguous entry points, at multiples of the cache line and of the
+ * context's block size, and runs of small stripes are grouped
+ * into one task.  Tasks are dealt out to the workers' deques in
+ * contiguous blocks.  Each worker pops from the bottom of its own
+ * deque, and when that is empty, steals from the top of another's.
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_thread_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define GIB_WS_GRAIN (256*1024)
+
+struct gib_ws_task {
+	int first;  /* First stripe of the task */
+	int count;  /* Number of whole stripes, or 0 for a byte range */
+	int off;    /* Byte range of stripe first, if count == 0 */
+	int len;
+};
+
+struct gib_ws_deque {
+	pthread_spinlock_t lock;
+	int top;    /* Thieves take from here */
+	int bottom; /* The owner pushes and pops here */
+	int *items;
+	struct gib_ws_stats stats;
+	char pad[64];
+};
+
+struct gib_ws {
+	struct gib_pool *pool;
+	int nworkers;
+	int grain;
+	struct gib_ws_deque *deques;
+
+	/* State of the batch being run */
+	struct gib_stripe *stripes;
+	struct gib_ws_task *tasks;
+	int ntasks;
+	int remaining;
+};
+
+int
+gib_ws_create(int nthreads, int grain, struct gib_ws **ws)
+{
+	struct gib_ws *w;
+	int i, rc;
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	if (grain <= 0)
+		grain = GIB_WS_GRAIN;
+
+	w = calloc(1, sizeof(struct gib_ws));
+	if (w == NULL)
+		return GIB_OOM;
+	w->deques = calloc(nthreads, sizeof(struct gib_ws_deque));
+	if (w->deques == NULL) {
+		free(w);
+		return GIB_OOM;
+	}
+	rc = gib_pool_create(nthreads, &w->pool);
+	if (rc != GIB_SUC) {
+		free(w->deques);
+		free(w);
+		return rc;
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_spin_init(&w->deques[i].lock, PTHREAD_PROCESS_PRIVATE);
+	w->nworkers = nthreads;
+	w->grain = grain;
+	*ws = w;
+	return GIB_SUC;
+}
+
+int
+gib_ws_destroy(struct gib_ws *ws)
+{
+	int i;
+
+	gib_pool_destroy(ws->pool);
+	for (i = 0; i < ws->nworkers; i++) {
+		pthread_spin_destroy(&ws->deques[i].lock);
+		free(ws->deques[i].items);
+	}
+	free(ws->deques);
+	free(ws);
+	return GIB_SUC;
+}
+
+int
+gib_ws_stats(struct gib_ws *ws, int worker, struct gib_ws_stats *stats)
+{
+	if (worker < 0 || worker >= ws->nworkers)
+		return GIB_ERR;
+	*stats = ws->deques[worker].stats;
+	return GIB_SUC;
+}
+
+int
+gib_ws_nworkers(struct gib_ws *ws)
+{
+	return ws->nworkers;
+}
+
+static int
+gib_ws_pop(struct gib_ws_deque *d)
+{
+	int item = -1;
+
+	pthread_spin_lock(&d->lock);
+	if (d->bottom > d->top)
+		item = d->items[--d->bottom];
+	pthread_spin_unlock(&d->lock);
+	return item;
+}
+
+static int
+gib_ws_steal(struct gib_ws_deque *d)
+{
+	int item = -1;
+
+	if (pthread_spin_trylock(&d->lock))
+		return -1;
+	if (d->bottom > d->top)
+		item = d->items[d->top++];
+	pthread_spin_unlock(&d->lock);
+	return item;
+}
+
+static int
+gib_ws_execute(struct gib_ws *ws, struct gib_ws_task *t)
+{
+	struct gib_stripe *s;
+	int i, rc = GIB_SUC;
+
+	if (t->count == 0) {
+		s = &ws->stripes[t->first];
+		unsigned char *buf = (unsigned char *)s->buffers + t->off;
+		if (s->buf_ids == NULL)
+			rc = gib_generate_nc(buf, s->buf_size, t->len, s->c);
+		else
+			rc = gib_recover_nc(buf, s->buf_size, t->len,
+					    s->buf_ids, s->recover_last, s->c);
+		if (rc != GIB_SUC)
+			s->rc = rc;
+		return t->len * s->c->n;
+	}
+
+	rc = 0;
+	for (i = t->first; i < t->first + t->count; i++) {
+		s = &ws->stripes[i];
+		if (s->buf_ids == NULL && s->work_size == s->buf_size)
+			s->rc = gib_generate(s->buffers, s->buf_size, s->c);
+		else if (s->buf_ids == NULL)
+			s->rc = gib_generate_nc(s->buffers, s->buf_size,
+						s->work_size, s->c);
+		else if (s->work_size == s->buf_size)
+			s->rc = gib_recover(s->buffers, s->buf_size,
+					    s->buf_ids, s->recover_last, s->c);
+		else
+			s->rc = gib_recover_nc(s->buffers, s->buf_size,
+					       s->work_size, s->buf_ids,
+					       s->recover_last, s->c);
+		rc += s->work_size * s->c->n;
+	}
+	return rc;
+}
+
+static void
+gib_ws_worker(void *arg, int self)
+{
+	struct gib_ws *ws = arg;
+	struct gib_ws_deque *own = &ws->deques[self];
+	unsigned int seed = self + 1;
+	int item, victim, i;
+
+	while (__sync_add_and_fetch(&ws->remaining, 0) > 0) {
+		item = gib_ws_pop(own);
+		if (item < 0) {
+			victim = rand_r(&seed) % ws->nworkers;
+			for (i = 0; i < ws->nworkers && item < 0; i++) {
+				int v = (victim + i) % ws->nworkers;
+				if (v != self)
+					item = gib_ws_steal(&ws->deques[v]);
+			}
+			if (item < 0) {
+				own->stats.failed_steals++;
+				sched_yield();
+				continue;
+			}
+			own->stats.steals++;
+		}
+		own->stats.bytes += gib_ws_execute(ws, &ws->tasks[item]);
+		own->stats.tasks++;
+		__sync_sub_and_fetch(&ws->remaining, 1);
+	}
+}
+
+/* Cuts the batch into tasks, returning how many there are. */
+static int
+gib_ws_plan(struct gib_ws *ws, struct gib_stripe *stripes, int count)
+{
+	int i, ntasks = 0, group = -1, group_bytes = 0;
+
+	for (i = 0; i < count; i++) {
+		struct gib_stripe *s = &stripes[i];
+		int bytes = s->work_size * s->c->n;
+		int nc = (s->buf_ids == NULL) ?
+			(s->c->strategy->gib_generate_nc != NULL) :
+			(s->c->strategy->gib_recover_nc != NULL);
+
+		s->rc = GIB_SUC;
+		if (bytes >= 2 * ws->grain && nc) {
+			int chunk = gib_context_round(s->c,
+						      ws->grain / s->c->n, 64);
+			int off;
+			for (off = 0; off < s->work_size; off += chunk) {
+				struct gib_ws_task *t = &ws->tasks[ntasks++];
+				t->first = i;
+				t->count = 0;
+				t->off = off;
+				t->len = (s->work_size - off < chunk) ?
+					s->work_size - off : chunk;
+			}
+			group = -1;
+			continue;
+		}
+
+		if (group < 0 || group_bytes + bytes > ws->grain) {
+			group = ntasks++;
+			ws->tasks[group].first = i;
+			ws->tasks[group].count = 0;
+			group_bytes = 0;
+		}
+		ws->tasks[group].count++;
+		group_bytes += bytes;
+	}
+	return ntasks;
+}
+
+int
+gib_ws_run(struct gib_ws *ws, struct gib_stripe *stripes, int count)
+{
+	int i, ntasks, per, rc = GIB_SUC;
+
+	/* A task never covers less than a cache line of one stripe */
+	ntasks = 0;
+	for (i = 0; i < count; i++)
+		ntasks += stripes[i].work_size / 64 + 1;
+	ws->tasks = malloc(ntasks * sizeof(struct gib_ws_task));
+	if (ws->tasks == NULL)
+		return GIB_OOM;
+	ws->stripes = stripes;
+	ws->ntasks = gib_ws_plan(ws, stripes, count);
+
+	per = (ws->ntasks + ws->nworkers - 1) / ws->nworkers;
+	for (i = 0; i < ws->nworkers; i++) {
+		struct gib_ws_deque *d = &ws->deques[i];
+		int j, first = i * per;
+		int last = (first + per < ws->ntasks) ? first + per : ws->ntasks;
+
+		free(d->items);
+		d->items = malloc((ws->ntasks + 1) * sizeof(int));
+		if (d->items == NULL)
+			rc = GIB_OOM;
+		d->top = d->bottom = 0;
+		/* Pushed in reverse, so the owner works front to back */
+		for (j = last - 1; d->items != NULL && j >= first; j--)
+			d->items[d->bottom++] = j;
+	}
+	if (rc == GIB_SUC) {
+		ws->remaining = ws->ntasks;
+		gib_pool_run(ws->pool, ws->nworkers, gib_ws_worker, ws);
+		for (i = 0; i < count; i++)
+			if (stripes[i].rc != GIB_SUC)
+				rc = stripes[i].rc;
+	}
+
+	free(ws->tasks);
+	ws->tasks = NULL;
+	return rc;
+}
@@ -14,6 +14,7 @@
 #include "../inc/gibraltar.h"
 #include "../inc/gib_context.h"
 #include "../inc/dynamic_fp.h"
+#include <stdlib.h>
 
 /* Functions */
 
@@ -45,6 +46,13 @@ int
 gib_generate_nc(void *buffers, int buf_size, int work_size,
 		    gib_context c)
 {
+	/* Backends without noncontiguous support can still do the
+	 * whole stripe.
+	 */
+	if (c->strategy->gib_generate_nc == NULL)
+		return (work_size == buf_size) ?
+			c->strategy->gib_generate(buffers, buf_size, c) :
+			GIB_ERR;
 	return c->strategy->gib_generate_nc(buffers, buf_size, work_size, c);
 }
 
@@ -60,6 +68,101 @@ int
 gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
 		   int recover_last, gib_context c)
 {
+	if (c->strategy->gib_recover_nc == NULL)
+		return (work_size == buf_size) ?
+			c->strategy->gib_recover(buffers, buf_size, buf_ids,
+						 recover_last, c) :
+			GIB_ERR;
 	return c->strategy->gib_recover_nc(buffers, buf_size, work_size,
 					   buf_ids, recover_last, c);
 }
+
+int
+gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		   gib_context c)
+{
+	return c->strategy->gib_recover_sparse(buffers, buf_size, failed_bufs,
+					       c);
+}
+
+int
+gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+		      char *failed_bufs, gib_context c)
+{
+	return c->strategy->gib_recover_sparse_nc(buffers, buf_size, work_size,
+						  failed_bufs, c);
+}
+
+int
+gib_generate_batch(void **buffers, int *buf_sizes, int count, gib_context c)
+{
+	int i, rc;
+
+	if (c->strategy->gib_generate_batch != NULL)
+		return c->strategy->gib_generate_batch(buffers, buf_sizes,
+						       count, c);
+	for (i = 0; i < count; i++) {
+		rc = c->strategy->gib_generate(buffers[i], buf_sizes[i], c);
+		if (rc)
+			return rc;
+	}
+	return GIB_SUC;
+}
+
+int
+gib_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+		  int *recover_last, int count, gib_context c)
+{
+	int i, rc;
+
+	if (c->strategy->gib_recover_batch != NULL)
+		return c->strategy->gib_recover_batch(buffers, buf_sizes,
+						      buf_ids, recover_last,
+						      count, c);
+	for (i = 0; i < count; i++) {
+		rc = c->strategy->gib_recover(buffers[i], buf_sizes[i],
+					      buf_ids[i], recover_last[i], c);
+		if (rc)
+			return rc;
+	}
+	return GIB_SUC;
+}
+
+int
+gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		 gib_context c)
+{
+	return c->strategy->gib_generate_iov(data, parity, len, c);
+}
+
+int
+gib_recover_iov(unsigned char **survivors, int *buf_ids, unsigned char **out,
+		int recover_last, int len, gib_context c)
+{
+	return c->strategy->gib_recover_iov(survivors, buf_ids, out,
+					    recover_last, len, c);
+}
+
+int
+gib_update(int data_index, unsigned char *old_data, unsigned char *new_data,
+	   unsigned char **parity, int len, gib_context c)
+{
+	return gib_update_cols(1, &data_index, &old_data, &new_data, parity,
+			       len, c);
+}
+
+int
+gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		unsigned char **new_data, unsigned char **parity, int len,
+		gib_context c)
+{
+	int i;
+
+	if (ncols < 0 || ncols > c->n)
+		return GIB_ERR;
+	for (i = 0; i < ncols; i++)
+		if (data_ids[i] < 0 || data_ids[i] >= c->n)
+			return GIB_ERR;
+	return c->strategy->gib_update_cols(ncols, data_ids, old_data,
+					    new_data, parity, len, c);
+}
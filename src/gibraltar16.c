@@ -0,0 +1,443 @@
+/* gibraltar16.c: Reed-Solomon coding over GF(2^16) for wide stripes.
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Buffers come from the aligned stripe allocator.
+ *
+ */
+
+/* GF(2^8) codes are limited to 256 buffers.  This codec works on 16-bit
+ * little-endian symbols, which allows n + m up to 65536, e.g. 200+40
+ * archival stripes.
+ *
+ * A product c*x is split by the four nibbles of x,
+ *   c*x = T0[x & 0xf] ^ T1[(x >> 4) & 0xf] ^ T2[(x >> 8) & 0xf]
+ *	   ^ T3[x >> 12],
+ * where Tk[v] = c * (v << 4k) is 16 bits wide.  PSHUFB looks up one byte
+ * per byte lane, so the low and high bytes of each Tk are separate
+ * 16-entry tables.  The nibble indices are spread to both bytes of their
+ * symbol; the low byte tables are accumulated into one register and
+ * the high byte tables into another, and the two are merged by taking
+ * even bytes of the first and odd bytes of the second.
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_galois16.h"
+#include "../inc/gib_simd_funcs.h"
+#include "../inc/gib_plan_cache.h"
+#include "../inc/gib_alloc.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GIB16_X86 1
+#include <immintrin.h>
+#else
+#define GIB16_X86 0
+#endif
+
+struct gib16_tab {
+	unsigned char lo[4][16];
+	unsigned char hi[4][16];
+	unsigned short coef;
+};
+
+typedef void (*gib16_dot_fn)(const struct gib16_tab *tabs, int rows,
+			     int cols, unsigned char **in,
+			     unsigned char **out, int len);
+
+/* The plan cache is keyed on a struct gib_context_t, so one is embedded
+ * first; only its n, m and plans are used.
+ */
+struct gib16_context_t {
+	struct gib_context_t base;
+	unsigned short *F;
+	struct gib16_tab *F_tabs; /* m*n tables, row-major like F */
+	gib16_dot_fn dot;
+};
+
+static void
+gib16_tab_init(struct gib16_tab *t, unsigned short coef)
+{
+	int k, v;
+
+	t->coef = coef;
+	for (k = 0; k < 4; k++) {
+		for (v = 0; v < 16; v++) {
+			unsigned short p = gib_galois16_mul(coef, v << (4*k));
+			t->lo[k][v] = p & 0xff;
+			t->hi[k][v] = p >> 8;
+		}
+	}
+}
+
+/* Handles bytes [start, len), and is the whole kernel when no vector
+ * instructions are available.
+ */
+static void
+dot16_scalar_range(const struct gib16_tab *tabs, int rows, int cols,
+		   unsigned char **in, unsigned char **out, int start,
+		   int len)
+{
+	int r, i, b, k;
+
+	for (r = 0; r < rows; r++) {
+		const struct gib16_tab *t = tabs + r * cols;
+		for (b = start; b + 2 <= len; b += 2) {
+			unsigned lo = 0, hi = 0;
+			for (i = 0; i < cols; i++) {
+				unsigned x = in[i][b] | (in[i][b+1] << 8);
+				for (k = 0; k < 4; k++) {
+					unsigned v = (x >> (4*k)) & 0xf;
+					lo ^= t[i].lo[k][v];
+					hi ^= t[i].hi[k][v];
+				}
+			}
+			out[r][b] = lo;
+			out[r][b+1] = hi;
+		}
+	}
+}
+
+static void
+dot16_scalar(const struct gib16_tab *tabs, int rows, int cols,
+	     unsigned char **in, unsigned char **out, int len)
+{
+	dot16_scalar_range(tabs, rows, cols, in, out, 0, len);
+}
+
+#if GIB16_X86
+__attribute__((target("ssse3"))) static void
+dot16_ssse3(const struct gib16_tab *tabs, int rows, int cols,
+	    unsigned char **in, unsigned char **out, int len)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i even = _mm_set1_epi16(0x00ff);
+	const __m128i dup_lo = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6,
+					     8, 8, 10, 10, 12, 12, 14, 14);
+	const __m128i dup_hi = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7,
+					     9, 9, 11, 11, 13, 13, 15, 15);
+	int off, r, i, k;
+
+	for (off = 0; off + 16 <= len; off += 16) {
+		for (r = 0; r < rows; r++) {
+			const struct gib16_tab *t = tabs + r * cols;
+			__m128i lo = _mm_setzero_si128();
+			__m128i hi = _mm_setzero_si128();
+			for (i = 0; i < cols; i++) {
+				__m128i x, n02, n13, idx[4];
+				if (t[i].coef == 0)
+					continue;
+				x = _mm_loadu_si128((const __m128i *)
+						    (in[i] + off));
+				if (t[i].coef == 1) {
+					lo = _mm_xor_si128(lo, x);
+					hi = _mm_xor_si128(hi, x);
+					continue;
+				}
+				n02 = _mm_and_si128(x, mask);
+				n13 = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+				idx[0] = _mm_shuffle_epi8(n02, dup_lo);
+				idx[1] = _mm_shuffle_epi8(n13, dup_lo);
+				idx[2] = _mm_shuffle_epi8(n02, dup_hi);
+				idx[3] = _mm_shuffle_epi8(n13, dup_hi);
+				for (k = 0; k < 4; k++) {
+					__m128i tl, th;
+					tl = _mm_loadu_si128((const __m128i *)
+							     t[i].lo[k]);
+					th = _mm_loadu_si128((const __m128i *)
+							     t[i].hi[k]);
+					lo = _mm_xor_si128(lo,
+						_mm_shuffle_epi8(tl, idx[k]));
+					hi = _mm_xor_si128(hi,
+						_mm_shuffle_epi8(th, idx[k]));
+				}
+			}
+			lo = _mm_or_si128(_mm_and_si128(lo, even),
+					  _mm_andnot_si128(even, hi));
+			_mm_storeu_si128((__m128i *)(out[r] + off), lo);
+		}
+	}
+	dot16_scalar_range(tabs, rows, cols, in, out, off, len);
+}
+
+__attribute__((target("avx2"))) static void
+dot16_avx2(const struct gib16_tab *tabs, int rows, int cols,
+	   unsigned char **in, unsigned char **out, int len)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	const __m256i even = _mm256_set1_epi16(0x00ff);
+	const __m256i dup_lo = _mm256_setr_epi8(
+		0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14,
+		0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14);
+	const __m256i dup_hi = _mm256_setr_epi8(
+		1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15,
+		1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15);
+	int off, r, i, k;
+
+	for (off = 0; off + 32 <= len; off += 32) {
+		for (r = 0; r < rows; r++) {
+			const struct gib16_tab *t = tabs + r * cols;
+			__m256i lo = _mm256_setzero_si256();
+			__m256i hi = _mm256_setzero_si256();
+			for (i = 0; i < cols; i++) {
+				__m256i x, n02, n13, idx[4];
+				if (t[i].coef == 0)
+					continue;
+				x = _mm256_loadu_si256((const __m256i *)
+						       (in[i] + off));
+				if (t[i].coef == 1) {
+					lo = _mm256_xor_si256(lo, x);
+					hi = _mm256_xor_si256(hi, x);
+					continue;
+				}
+				n02 = _mm256_and_si256(x, mask);
+				n13 = _mm256_and_si256(
+					_mm256_srli_epi16(x, 4), mask);
+				idx[0] = _mm256_shuffle_epi8(n02, dup_lo);
+				idx[1] = _mm256_shuffle_epi8(n13, dup_lo);
+				idx[2] = _mm256_shuffle_epi8(n02, dup_hi);
+				idx[3] = _mm256_shuffle_epi8(n13, dup_hi);
+				for (k = 0; k < 4; k++) {
+					__m256i tl, th;
+					tl = _mm256_broadcastsi128_si256(
+						_mm_loadu_si128(
+							(const __m128i *)
+							t[i].lo[k]));
+					th = _mm256_broadcastsi128_si256(
+						_mm_loadu_si128(
+							(const __m128i *)
+							t[i].hi[k]));
+					lo = _mm256_xor_si256(lo,
+						_mm256_shuffle_epi8(tl,
+								    idx[k]));
+					hi = _mm256_xor_si256(hi,
+						_mm256_shuffle_epi8(th,
+								    idx[k]));
+				}
+			}
+			lo = _mm256_or_si256(_mm256_and_si256(lo, even),
+					     _mm256_andnot_si256(even, hi));
+			_mm256_storeu_si256((__m256i *)(out[r] + off), lo);
+		}
+	}
+	dot16_scalar_range(tabs, rows, cols, in, out, off, len);
+}
+#endif
+
+static gib16_dot_fn
+gib16_get_dot(int isa)
+{
+#if GIB16_X86
+	if (isa >= GIB_SIMD_AVX2)
+		return &dot16_avx2;
+	if (isa == GIB_SIMD_SSSE3)
+		return &dot16_ssse3;
+#endif
+	return &dot16_scalar;
+}
+
+int
+gib16_init(int n, int m, struct gib16_context_t **c)
+{
+	int i, rc;
+
+	if (n < 1 || m < 1 || n + m > 65536)
+		return GIB_ERR;
+	if (gib_galois16_init())
+		return GIB_ERR;
+
+	*c = calloc(1, sizeof(struct gib16_context_t));
+	if (*c == NULL)
+		return GIB_OOM;
+	(*c)->base.n = n;
+	(*c)->base.m = m;
+	do {
+		rc = GIB_OOM;
+		(*c)->F = malloc((size_t)m * n * sizeof(unsigned short));
+		(*c)->F_tabs = malloc((size_t)m * n *
+				      sizeof(struct gib16_tab));
+		if ((*c)->F == NULL || (*c)->F_tabs == NULL)
+			break;
+		rc = gib_plan_cache_create(GIB_PLAN_CACHE_SIZE,
+					   &(*c)->base.plans);
+		if (rc)
+			break;
+		rc = gib_galois16_gen_F((*c)->F, m, n);
+		if (rc)
+			break;
+		for (i = 0; i < m * n; i++)
+			gib16_tab_init(&(*c)->F_tabs[i], (*c)->F[i]);
+		(*c)->base.table_bytes = (unsigned long)m * n *
+			sizeof(struct gib16_tab);
+		(*c)->dot = gib16_get_dot(gib_simd_detect());
+		return GIB_SUC;
+	} while (0);
+
+	gib16_destroy(*c);
+	return rc;
+}
+
+int
+gib16_destroy(struct gib16_context_t *c)
+{
+	if (c->base.plans != NULL)
+		gib_plan_cache_destroy(c->base.plans);
+	free(c->F);
+	free(c->F_tabs);
+	free(c);
+	return GIB_SUC;
+}
+
+int
+gib16_alloc(void **buffers, int buf_size, int *ld, struct gib16_context_t *c)
+{
+	/* Strides stay even, as whole cache lines */
+	return gib_stripe_alloc(c->base.n + c->base.m, buf_size, 1, buffers,
+				ld);
+}
+
+int
+gib16_free(void *buffers, struct gib16_context_t *c)
+{
+	gib_stripe_free(buffers);
+	return GIB_SUC;
+}
+
+int
+gib16_generate(void *buffers, int buf_size, struct gib16_context_t *c)
+{
+	return gib16_generate_nc(buffers, buf_size, buf_size, c);
+}
+
+int
+gib16_generate_nc(void *buffers, int buf_size, int work_size,
+		  struct gib16_context_t *c)
+{
+	unsigned char *c_buf = buffers;
+	unsigned char **ptrs;
+	int n = c->base.n, m = c->base.m;
+	int i;
+
+	if (work_size % 2)
+		return GIB_ERR;
+	ptrs = malloc((n + m) * sizeof(unsigned char *));
+	if (ptrs == NULL)
+		return GIB_OOM;
+	for (i = 0; i < n + m; i++)
+		ptrs[i] = c_buf + (size_t)i * buf_size;
+	c->dot(c->F_tabs, m, n, ptrs, ptrs + n, work_size);
+	free(ptrs);
+	return GIB_SUC;
+}
+
+static void
+gib16_plan_free(void *priv)
+{
+	free(priv);
+}
+
+/* As gib_cpu_decode_rows, over GF(2^16): invert the survivors' rows of
+ * [I; F], and take F[p] * inv for a lost parity p.  The matrices are
+ * n x n, so they live on the heap.  Plans hold the expanded tables of
+ * the rows.
+ */
+static int
+gib16_plan_build(struct gib_context_t *base, int *buf_ids,
+		 struct gib_plan *plan)
+{
+	struct gib16_context_t *c = (struct gib16_context_t *)base;
+	int n = base->n, m = base->m, r = plan->recover_last;
+	unsigned short *a, *inv;
+	struct gib16_tab *tabs;
+	int i, j, k, rc;
+
+	for (i = 0; i < n + r; i++)
+		if (buf_ids[i] < 0 || buf_ids[i] >= n + m)
+			return GIB_ERR;
+
+	a = malloc(2 * (size_t)n * n * sizeof(unsigned short));
+	tabs = malloc((size_t)r * n * sizeof(struct gib16_tab));
+	if (a == NULL || tabs == NULL) {
+		free(a);
+		free(tabs);
+		return GIB_OOM;
+	}
+	inv = a + (size_t)n * n;
+
+	for (i = 0; i < n; i++) {
+		int id = buf_ids[i];
+		for (j = 0; j < n; j++)
+			a[i*n+j] = (id < n) ? (id == j) : c->F[(id-n)*n+j];
+	}
+	rc = gib_galois16_invert(a, inv, n);
+	if (rc) {
+		free(a);
+		free(tabs);
+		return rc;
+	}
+
+	for (i = 0; i < r; i++) {
+		int id = buf_ids[n+i];
+		for (j = 0; j < n; j++) {
+			unsigned short acc = 0;
+			if (id < n) {
+				acc = inv[id*n+j];
+			} else {
+				/* Row id of [I; F] is F[id - n] */
+				for (k = 0; k < n; k++)
+					acc ^= gib_galois16_mul(
+						c->F[(id-n)*n+k], inv[k*n+j]);
+			}
+			gib16_tab_init(&tabs[i*n+j], acc);
+		}
+	}
+	free(a);
+
+	plan->priv = tabs;
+	plan->priv_free = gib16_plan_free;
+	plan->bytes += (unsigned long)r * n * sizeof(struct gib16_tab);
+	return GIB_SUC;
+}
+
+int
+gib16_recover(void *buffers, int buf_size, int *buf_ids, int recover_last,
+	      struct gib16_context_t *c)
+{
+	return gib16_recover_nc(buffers, buf_size, buf_size, buf_ids,
+				recover_last, c);
+}
+
+int
+gib16_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
+		 int recover_last, struct gib16_context_t *c)
+{
+	unsigned char *c_buf = buffers;
+	unsigned char **ptrs;
+	struct gib_plan *plan;
+	int n = c->base.n;
+	int i, rc;
+
+	if (work_size % 2 || recover_last < 0 || recover_last > c->base.m)
+		return GIB_ERR;
+	rc = gib_plan_get(&c->base, buf_ids, recover_last, gib16_plan_build,
+			  &plan);
+	if (rc)
+		return rc;
+	ptrs = malloc((n + recover_last) * sizeof(unsigned char *));
+	if (ptrs == NULL) {
+		gib_plan_put(&c->base, plan);
+		return GIB_OOM;
+	}
+	for (i = 0; i < n + recover_last; i++)
+		ptrs[i] = c_buf + (size_t)i * buf_size;
+	c->dot(plan->priv, recover_last, n, ptrs, ptrs + n, work_size);
+	free(ptrs);
+	gib_plan_put(&c->base, plan);
+	return GIB_SUC;
+}
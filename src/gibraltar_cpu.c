@@ -74,6 +74,59 @@ _gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
 				  recover_last, c);
 }
 
+static int
+_gib_generate_batch(void **buffers, int *buf_sizes, int count, gib_context c)
+{
+	return gib_cpu_generate_batch(buffers, buf_sizes, count, c);
+}
+
+static int
+_gib_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+		   int *recover_last, int count, gib_context c)
+{
+	return gib_cpu_recover_batch(buffers, buf_sizes, buf_ids, recover_last,
+				     count, c);
+}
+
+static int
+_gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		  gib_context c)
+{
+	return gib_cpu_generate_iov(data, parity, len, c);
+}
+
+static int
+_gib_recover_iov(unsigned char **survivors, int *buf_ids, unsigned char **out,
+		 int recover_last, int len, gib_context c)
+{
+	return gib_cpu_recover_iov(survivors, buf_ids, out, recover_last, len,
+				   c);
+}
+
+static int
+_gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		 unsigned char **new_data, unsigned char **parity, int len,
+		 gib_context c)
+{
+	return gib_cpu_update_cols(ncols, data_ids, old_data, new_data,
+				   parity, len, c);
+}
+
+static int
+_gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		    gib_context c)
+{
+	return gib_cpu_recover_sparse(buffers, buf_size, failed_bufs, c);
+}
+
+static int
+_gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+		       char *failed_bufs, gib_context c)
+{
+	return gib_cpu_recover_sparse_nc(buffers, buf_size, work_size,
+					 failed_bufs, c);
+}
+
 struct dynamic_fp cpu = {
 		.gib_alloc = &_gib_alloc,
 		.gib_destroy = &_gib_destroy,
@@ -82,5 +135,12 @@ struct dynamic_fp cpu = {
 		.gib_generate_nc = &_gib_generate_nc,
 		.gib_recover = &_gib_recover,
 		.gib_recover_nc = &_gib_recover_nc,
+		.gib_recover_sparse = &_gib_recover_sparse,
+		.gib_recover_sparse_nc = &_gib_recover_sparse_nc,
+		.gib_generate_batch = &_gib_generate_batch,
+		.gib_recover_batch = &_gib_recover_batch,
+		.gib_generate_iov = &_gib_generate_iov,
+		.gib_recover_iov = &_gib_recover_iov,
+		.gib_update_cols = &_gib_update_cols,
 };
 
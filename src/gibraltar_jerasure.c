@@ -8,23 +8,45 @@
  * Changes:
  * Initial version, Matthew L. Curry
  * Dec 16, 2014, Rodrigo Sardinas; revised to enable dynamic use.
+ * Added batched generate and recover, and scatter/gather variants.
+ * Recovery uses cached plans instead of jerasure_matrix_decode.
+ * Added the parity update path for small writes.
+ * Implemented the noncontiguous entry points.
+ * Added the Cauchy bitmatrix variant.
+ * Contexts and plans account for the tables they hold.
+ * Buffers are aligned, with a stride that avoids cache aliasing.
+ * Sizes that are not a multiple of sizeof(long) are coded in full.
  *
  */
 
 #include "../inc/gibraltar.h"
 #include "../inc/gib_context.h"
+#include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_plan_cache.h"
+#include "../inc/gib_alloc.h"
 #include "../lib/Jerasure-1.2/jerasure.h"
 #include "../lib/Jerasure-1.2/reed_sol.h"
+#include "../lib/Jerasure-1.2/galois.h"
+#include "../lib/Jerasure-1.2/cauchy.h"
+#include <stdlib.h>
 
 int
 gib_init_jerasure(int n, int m, gib_context *c)
 {
 	int *intF;
 	*c = (gib_context) malloc(sizeof(struct gib_context_t));
-	if (c == NULL)
+	if (*c == NULL)
 		return GIB_OOM;
+	if (gib_plan_cache_create(GIB_PLAN_CACHE_SIZE, &(*c)->plans)) {
+		free(*c);
+		return GIB_OOM;
+	}
 	(*c)->n = n;
 	(*c)->m = m;
+	/* Products come from Jerasure's own global tables. */
+	(*c)->F_rows = NULL;
+	(*c)->table_bytes = 0;
+	(*c)->block = 1;
 	/* Jerasure uses an integer matrix, while Gibraltar uses an
 	 * unsigned char matrix.  Pick the lesser of two evils, and
 	 * just put it where it doesn't belong.
@@ -32,6 +54,7 @@ gib_init_jerasure(int n, int m, gib_context *c)
 	intF = reed_sol_vandermonde_coding_matrix(n, m, 8);
 	(*c)->F = (unsigned char *)intF;
 	if (intF == NULL) {
+		gib_plan_cache_destroy((*c)->plans);
 		free(*c);
 		return GIB_OOM;
 	}
@@ -42,6 +65,7 @@ gib_init_jerasure(int n, int m, gib_context *c)
 static int
 _gib_destroy(gib_context c)
 {
+	gib_plan_cache_destroy(c->plans);
 	free(c->F);
 	free(c);
 
@@ -51,22 +75,63 @@ _gib_destroy(gib_context c)
 static int
 _gib_alloc(void **buffers, int buf_size, int *ld, gib_context c)
 {
-	*ld = buf_size;
-	*buffers = malloc((c->n+c->m)*buf_size);
-	if (*buffers == NULL)
-		return GIB_OOM;
-	return 0;
+	/* The cache-line stride is also a multiple of sizeof(long) */
+	return gib_stripe_alloc(c->n + c->m, buf_size, 1, buffers, ld);
 }
 
 static int
 _gib_free(void *buffers, gib_context c)
 {
-	free(buffers);
+	gib_stripe_free(buffers);
 	return 0;
 }
 
+/* Jerasure's region operations work a long at a time, and would read
+ * and write past the end of a size that is not a multiple of
+ * sizeof(long).  They are given the largest multiple, and the few bytes
+ * after it are coded here one at a time: dst[b] is the dot product of
+ * row with srcs[0..k)[b].
+ */
+#define GIB_JERASURE_BODY(len) ((len) & ~(int)(sizeof(long) - 1))
+
+static void
+_gib_dotprod_tail(int k, int *row, char **srcs, char *dst, int len)
+{
+	int x, b, sum;
+
+	for (b = 0; b < len; b++) {
+		sum = 0;
+		for (x = 0; x < k; x++)
+			sum ^= galois_single_multiply(row[x],
+						      (unsigned char)srcs[x][b],
+						      8);
+		dst[b] = sum;
+	}
+}
+
+static void
+_gib_encode(char **data, char **coding, int len, gib_context c)
+{
+	int body = GIB_JERASURE_BODY(len);
+	char *srcs[256];
+	int i, j;
+
+	jerasure_matrix_encode(c->n, c->m, 8, (int *)(c->F), data, coding,
+			       body);
+	if (body == len)
+		return;
+	for (i = 0; i < c->n; i++)
+		srcs[i] = data[i] + body;
+	for (j = 0; j < c->m; j++)
+		_gib_dotprod_tail(c->n, (int *)(c->F) + j*c->n, srcs,
+				  coding[j] + body, len - body);
+}
+
+/* Only the first work_size bytes of each buffer are coded, in place at
+ * stride buf_size, and nothing after them is touched.
+ */
 static int
-_gib_generate(void *buffers, int buf_size, gib_context c)
+_gib_generate_nc(void *buffers, int buf_size, int work_size, gib_context c)
 {
 	char *data[256];
 	char *coding[256];
@@ -78,75 +143,583 @@ _gib_generate(void *buffers, int buf_size, gib_context c)
 	for (i = 0; i < (c->m); i++) {
 		coding[i] = ((char *)buffers) + (i+(c->n))*buf_size;
 	}
-	jerasure_matrix_encode(c->n, c->m, 8, (int *)(c->F), data, coding,
-			       buf_size);
+	_gib_encode(data, coding, work_size, c);
 
 	return 0;
 }
 
+static int
+_gib_generate(void *buffers, int buf_size, gib_context c)
+{
+	return _gib_generate_nc(buffers, buf_size, buf_size, c);
+}
+
+struct gib_jerasure_plan {
+	int *ids;	/* The k survivors, in the order rows uses them */
+	int *rows;	/* recover_last x k, over GF(2^8) */
+	int **schedule;	/* Cauchy contexts only; rows as XORs of packets */
+};
+
+static void
+_gib_plan_free(void *priv)
+{
+	struct gib_jerasure_plan *jp = priv;
+
+	if (jp->schedule != NULL)
+		jerasure_free_schedule(jp->schedule);
+	free(jp);
+}
+
+/* Jerasure's own decoder rebuilds its decoding matrix on every call,
+ * and writes every missing buffer, including ones Gibraltar did not
+ * ask for.  Instead, a plan holds one row per requested buffer over
+ * the survivors listed in its first k entries.  A lost parity buffer
+ * gets the product of its coding row with the decoding matrix, so it
+ * too is computed from the survivors alone.
+ */
+static int
+_gib_plan_build(gib_context c, int *buf_ids, struct gib_plan *plan)
+{
+	int erased[256];
+	int *matrix = (int *)c->F;
+	int *decoding_matrix = NULL;
+	struct gib_jerasure_plan *jp;
+	int *ids, *rows;
+	int k = c->n;
+	int i, j, x, t, ndata = 0;
+
+	jp = malloc(sizeof(*jp) + (k + plan->recover_last*k) * sizeof(int));
+	if (jp == NULL)
+		return GIB_OOM;
+	ids = jp->ids = (int *)(jp + 1);
+	rows = jp->rows = ids + k;
+	jp->schedule = NULL;
+	plan->priv = jp;
+	plan->priv_free = _gib_plan_free;
+	plan->bytes += sizeof(*jp) + (k + plan->recover_last*k) * sizeof(int);
+
+	for (i = 0; i < k+c->m; i++)
+		erased[i] = 1;
+	for (i = 0; i < k; i++)
+		erased[buf_ids[i]] = 0;
+	for (i = 0; i < k; i++) {
+		ids[i] = i;
+		ndata += erased[i];
+	}
+
+	if (ndata > 0) {
+		decoding_matrix = malloc(k*k*sizeof(int));
+		if (decoding_matrix == NULL)
+			return GIB_OOM;
+		if (jerasure_make_decoding_matrix(k, c->m, 8, matrix, erased,
+						  decoding_matrix, ids) < 0) {
+			free(decoding_matrix);
+			return GIB_ERR;
+		}
+	}
+
+	for (j = 0; j < plan->recover_last; j++) {
+		int *row = rows + j*k;
+
+		t = buf_ids[k+j];
+		if (t < k) {
+			for (x = 0; x < k; x++)
+				row[x] = decoding_matrix[t*k+x];
+			continue;
+		}
+
+		/* row[x] is the coefficient of survivor ids[x] */
+		for (x = 0; x < k; x++)
+			row[x] = 0;
+		for (i = 0; i < k; i++) {
+			int coef = matrix[(t-k)*k+i];
+			if (!erased[i]) {
+				for (x = 0; x < k; x++)
+					if (ids[x] == i)
+						row[x] ^= coef;
+			} else {
+				for (x = 0; x < k; x++)
+					row[x] ^= galois_single_multiply(
+						coef, decoding_matrix[i*k+x],
+						8);
+			}
+		}
+	}
+
+	free(decoding_matrix);
+	return 0;
+}
+
+static int
+_gib_recover_iov(unsigned char **survivors, int *buf_ids, unsigned char **out,
+		 int recover_last, int len, gib_context c)
+{
+	char *data[256];
+	char *coding[256];
+	struct gib_plan *plan;
+	struct gib_jerasure_plan *jp;
+	char *srcs[256];
+	int body = GIB_JERASURE_BODY(len);
+	int k = c->n;
+	int i, j, t, rc;
+
+	rc = gib_plan_get(c, buf_ids, recover_last, _gib_plan_build, &plan);
+	if (rc)
+		return rc;
+	jp = plan->priv;
+
+	for (i = 0; i < k; i++) {
+		if (buf_ids[i] < k)
+			data[buf_ids[i]] = (char *)survivors[i];
+		else
+			coding[buf_ids[i]-k] = (char *)survivors[i];
+	}
+	for (j = 0; j < recover_last; j++) {
+		t = buf_ids[k+j];
+		if (t < k)
+			data[t] = (char *)out[j];
+		else
+			coding[t-k] = (char *)out[j];
+		jerasure_matrix_dotprod(k, 8, jp->rows + j*k, jp->ids, t, data,
+					coding, body);
+	}
+	if (body != len) {
+		for (i = 0; i < k; i++)
+			srcs[i] = (jp->ids[i] < k ? data[jp->ids[i]] :
+				   coding[jp->ids[i]-k]) + body;
+		for (j = 0; j < recover_last; j++)
+			_gib_dotprod_tail(k, jp->rows + j*k, srcs,
+					  (char *)out[j] + body, len - body);
+	}
+
+	gib_plan_put(c, plan);
+	return 0;
+}
+
+static int
+_gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
+		int recover_last, gib_context c)
+{
+	unsigned char *survivors[256];
+	unsigned char *out[256];
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		survivors[i] = (unsigned char *)buffers + i*buf_size;
+	for (i = 0; i < recover_last; i++)
+		out[i] = (unsigned char *)buffers + (c->n+i)*buf_size;
+	return _gib_recover_iov(survivors, buf_ids, out, recover_last,
+				work_size, c);
+}
+
 static int
 _gib_recover(void *buffers, int buf_size, int *buf_ids, int recover_last,
 	    gib_context c)
 {
-	/* Gibraltar does not want to necessarily recover ALL of the
-	 * lost buffers, as sometimes this is not necessary or
-	 * convenient.  However, Jerasure does want to recover all
-	 * buffers, and will reference any intact buffers that it
-	 * pleases.  The bulk of the logic below is to address this
-	 * difference.
-	 */
+	return _gib_recover_nc(buffers, buf_size, buf_size, buf_ids,
+			       recover_last, c);
+}
+
+static int
+_gib_generate_batch(void **buffers, int *buf_sizes, int count, gib_context c)
+{
 	char *data[256];
 	char *coding[256];
-	int erasures[256];
-	int missing[256];
-	int i, counter, offset;
-
-	for (i = 0; i < c->n+c->m; i++)
-		missing[i] = 1;
-
-	for (i = 0; i < c->n+recover_last; i++) {
-		if (buf_ids[i] < c->n) {
-			data[buf_ids[i]] = (char *)buffers + i*buf_size;
-			missing[buf_ids[i]] = 0;
-		} else {
-			coding[buf_ids[i] - c->n] = (char *)buffers +
-				i * buf_size;
-			missing[buf_ids[i]] = 0;
-		}
+	int s, i;
+
+	for (s = 0; s < count; s++) {
+		for (i = 0; i < c->n; i++)
+			data[i] = (char *)buffers[s] + i*buf_sizes[s];
+		for (i = 0; i < c->m; i++)
+			coding[i] = (char *)buffers[s] +
+				(i+c->n)*buf_sizes[s];
+		_gib_encode(data, coding, buf_sizes[s], c);
 	}
+	return 0;
+}
+
+static int
+_gib_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+		   int *recover_last, int count, gib_context c)
+{
+	int s, rc;
 
-	counter = 0;
-	for (i = c->n; i < c->n+recover_last; i++) {
-		erasures[counter] = buf_ids[i];
-		counter++;
+	for (s = 0; s < count; s++) {
+		rc = _gib_recover(buffers[s], buf_sizes[s], buf_ids[s],
+				  recover_last[s], c);
+		if (rc)
+			return rc;
 	}
+	return 0;
+}
 
-	offset = c->n+recover_last;
-	for (i = 0; i < c->n+c->m; i++) {
-		if (missing[i]) {
-			erasures[counter] = i;
-			counter++;
-			if (i < c->n)
-				data[i] = (char *)buffers + offset*buf_size;
-			else
-				coding[i - c->n] = (char *)buffers +
-					offset * buf_size;
-			offset++;
+static int
+_gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		  gib_context c)
+{
+	_gib_encode((char **)data, (char **)parity, len, c);
+	return 0;
+}
+
+/* Only the last chunk can have a tail that is not a whole long, and it
+ * is added to the parity one byte at a time.
+ */
+static int
+_gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		 unsigned char **new_data, unsigned char **parity, int len,
+		 gib_context c)
+{
+	int *F = (int *)(c->F);
+	char delta[4096];
+	int t, i, j, b, chunk, body, coef;
+
+	for (t = 0; t < len; t += sizeof(delta)) {
+		chunk = (len - t < (int)sizeof(delta)) ?
+			len - t : (int)sizeof(delta);
+		body = GIB_JERASURE_BODY(chunk);
+		for (i = 0; i < ncols; i++) {
+			for (b = 0; b < chunk; b++)
+				delta[b] = old_data[i][t + b] ^
+					new_data[i][t + b];
+			for (j = 0; j < c->m; j++) {
+				coef = F[j*c->n + data_ids[i]];
+				galois_w08_region_multiply(
+					delta, coef, body,
+					(char *)parity[j] + t, 1);
+				for (b = body; b < chunk; b++)
+					parity[j][t + b] ^=
+						galois_single_multiply(
+							coef,
+							(unsigned char)delta[b],
+							8);
+			}
 		}
 	}
-	erasures[counter] = -1;
-	jerasure_matrix_decode(c->n, c->m, 8, (int *)(c->F), 0, erasures,
-			       data, coding, buf_size);
 	return 0;
 }
 
+static int
+_gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		    gib_context c)
+{
+	return gib_cpu_recover_sparse(buffers, buf_size, failed_bufs, c);
+}
+
+static int
+_gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+		       char *failed_bufs, gib_context c)
+{
+	return gib_cpu_recover_sparse_nc(buffers, buf_size, work_size,
+					 failed_bufs, c);
+}
+
 struct dynamic_fp jerasure = {
 		.gib_alloc = &_gib_alloc,
 		.gib_destroy = &_gib_destroy,
 		.gib_free = &_gib_free,
 		.gib_generate = &_gib_generate,
-		.gib_generate_nc = NULL,
+		.gib_generate_nc = &_gib_generate_nc,
 		.gib_recover = &_gib_recover,
-		.gib_recover_nc = NULL,
+		.gib_recover_nc = &_gib_recover_nc,
+		.gib_recover_sparse = &_gib_recover_sparse,
+		.gib_recover_sparse_nc = &_gib_recover_sparse_nc,
+		.gib_generate_batch = &_gib_generate_batch,
+		.gib_recover_batch = &_gib_recover_batch,
+		.gib_generate_iov = &_gib_generate_iov,
+		.gib_recover_iov = &_gib_recover_iov,
+		.gib_update_cols = &_gib_update_cols,
 };
 
+
+/* The Cauchy variant codes with a Cauchy matrix in bitmatrix form, as
+ * XORs of whole packets, with no multiplications.  Each buffer is cut
+ * into blocks of 8 packets, so every size given to it must be a
+ * multiple of 8*packetsize, and buffers coded with one packet size can
+ * only be decoded with the same one.  The encoding schedule is built
+ * once per context, and each erasure pattern gets its decoding
+ * schedule from the plan cache.
+ */
+struct gib_jerasure_cauchy {
+	int *bitmatrix;
+	int **schedule;
+	int packetsize;
+};
+
+/* Packet size of new Cauchy contexts, unless GIB_JERASURE_PACKETSIZE
+ * gives another multiple of sizeof(long).
+ */
+#define GIB_JERASURE_PACKETSIZE 2048
+
+/* Size of a schedule, which is a list of five-int operations ending in
+ * one whose first entry is -1.
+ */
+static unsigned long
+_gib_schedule_bytes(int **schedule)
+{
+	unsigned long ops = 0;
+
+	while (schedule[ops][0] >= 0)
+		ops++;
+	return (ops + 1) * (sizeof(int *) + 5 * sizeof(int));
+}
+
+int
+gib_init_jerasure_cauchy(int n, int m, gib_context *c)
+{
+	struct gib_jerasure_cauchy *jc;
+	char *env = getenv("GIB_JERASURE_PACKETSIZE");
+	int rc = GIB_OOM;
+
+	*c = (gib_context) malloc(sizeof(struct gib_context_t));
+	if (*c == NULL)
+		return GIB_OOM;
+	jc = malloc(sizeof(struct gib_jerasure_cauchy));
+	(*c)->acc_context = jc;
+	(*c)->F = NULL;
+	(*c)->F_rows = NULL;
+	(*c)->plans = NULL;
+	do {
+		if (jc == NULL)
+			break;
+		jc->bitmatrix = NULL;
+		jc->schedule = NULL;
+		jc->packetsize = GIB_JERASURE_PACKETSIZE;
+		if (env != NULL && atoi(env) > 0) {
+			jc->packetsize = atoi(env);
+			if (jc->packetsize % sizeof(long)) {
+				rc = GIB_ERR;
+				break;
+			}
+		}
+		if (gib_plan_cache_create(GIB_PLAN_CACHE_SIZE, &(*c)->plans))
+			break;
+		(*c)->n = n;
+		(*c)->m = m;
+		(*c)->block = 8 * jc->packetsize;
+		(*c)->F = (unsigned char *)
+			cauchy_good_general_coding_matrix(n, m, 8);
+		if ((*c)->F == NULL)
+			break;
+		jc->bitmatrix = jerasure_matrix_to_bitmatrix(n, m, 8,
+							     (int *)(*c)->F);
+		if (jc->bitmatrix == NULL)
+			break;
+		jc->schedule = jerasure_smart_bitmatrix_to_schedule(
+			n, m, 8, jc->bitmatrix);
+		if (jc->schedule == NULL)
+			break;
+		(*c)->table_bytes = n*m*64*sizeof(int) +
+			_gib_schedule_bytes(jc->schedule);
+		(*c)->strategy = &jerasure_cauchy;
+		return GIB_SUC;
+	} while (0);
+
+	if (jc != NULL) {
+		free(jc->bitmatrix);
+		free(jc);
+	}
+	if ((*c)->plans != NULL)
+		gib_plan_cache_destroy((*c)->plans);
+	free((*c)->F);
+	free(*c);
+	return rc;
+}
+
+static int
+_gib_cauchy_destroy(gib_context c)
+{
+	struct gib_jerasure_cauchy *jc = c->acc_context;
+
+	jerasure_free_schedule(jc->schedule);
+	free(jc->bitmatrix);
+	free(jc);
+	return _gib_destroy(c);
+}
+
+/* Rounds the stride up to a whole number of blocks, so that the
+ * buffers from gib_alloc can always be coded whole.
+ */
+static int
+_gib_cauchy_alloc(void **buffers, int buf_size, int *ld, gib_context c)
+{
+	struct gib_jerasure_cauchy *jc = c->acc_context;
+	int block = 8 * jc->packetsize;
+
+	return gib_stripe_alloc(c->n + c->m, buf_size, block, buffers, ld);
+}
+
+static int
+_gib_cauchy_generate_iov(unsigned char **data, unsigned char **parity,
+			 int len, gib_context c)
+{
+	struct gib_jerasure_cauchy *jc = c->acc_context;
+
+	if (len % (8 * jc->packetsize))
+		return GIB_ERR;
+	jerasure_schedule_encode(c->n, c->m, 8, jc->schedule, (char **)data,
+				 (char **)parity, len, jc->packetsize);
+	return 0;
+}
+
+static int
+_gib_cauchy_generate_nc(void *buffers, int buf_size, int work_size,
+			gib_context c)
+{
+	unsigned char *data[256];
+	unsigned char *coding[256];
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		data[i] = (unsigned char *)buffers + i*buf_size;
+	for (i = 0; i < c->m; i++)
+		coding[i] = (unsigned char *)buffers + (i+c->n)*buf_size;
+	return _gib_cauchy_generate_iov(data, coding, work_size, c);
+}
+
+static int
+_gib_cauchy_generate(void *buffers, int buf_size, gib_context c)
+{
+	return _gib_cauchy_generate_nc(buffers, buf_size, buf_size, c);
+}
+
+/* The decoding rows over GF(2^8) map to a bitmatrix just as the coding
+ * matrix does, so the survivors are "encoded" into the lost buffers by
+ * a smart schedule of that bitmatrix.
+ */
+static int
+_gib_cauchy_plan_build(gib_context c, int *buf_ids, struct gib_plan *plan)
+{
+	struct gib_jerasure_plan *jp;
+	int *bitmatrix;
+	int rc;
+
+	rc = _gib_plan_build(c, buf_ids, plan);
+	if (rc)
+		return rc;
+	jp = plan->priv;
+	bitmatrix = jerasure_matrix_to_bitmatrix(c->n, plan->recover_last, 8,
+						 jp->rows);
+	if (bitmatrix == NULL)
+		return GIB_OOM;
+	jp->schedule = jerasure_smart_bitmatrix_to_schedule(
+		c->n, plan->recover_last, 8, bitmatrix);
+	free(bitmatrix);
+	if (jp->schedule == NULL)
+		return GIB_OOM;
+	plan->bytes += _gib_schedule_bytes(jp->schedule);
+	return 0;
+}
+
+static int
+_gib_cauchy_recover_iov(unsigned char **survivors, int *buf_ids,
+			unsigned char **out, int recover_last, int len,
+			gib_context c)
+{
+	struct gib_jerasure_cauchy *jc = c->acc_context;
+	struct gib_jerasure_plan *jp;
+	struct gib_plan *plan;
+	char *bufs[256], *srcs[256];
+	int i, rc;
+
+	if (len % (8 * jc->packetsize))
+		return GIB_ERR;
+	rc = gib_plan_get(c, buf_ids, recover_last, _gib_cauchy_plan_build,
+			  &plan);
+	if (rc)
+		return rc;
+	jp = plan->priv;
+
+	for (i = 0; i < c->n; i++)
+		bufs[buf_ids[i]] = (char *)survivors[i];
+	for (i = 0; i < c->n; i++)
+		srcs[i] = bufs[jp->ids[i]];
+	jerasure_schedule_encode(c->n, recover_last, 8, jp->schedule, srcs,
+				 (char **)out, len, jc->packetsize);
+
+	gib_plan_put(c, plan);
+	return 0;
+}
+
+static int
+_gib_cauchy_recover_nc(void *buffers, int buf_size, int work_size,
+		       int *buf_ids, int recover_last, gib_context c)
+{
+	unsigned char *survivors[256];
+	unsigned char *out[256];
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		survivors[i] = (unsigned char *)buffers + i*buf_size;
+	for (i = 0; i < recover_last; i++)
+		out[i] = (unsigned char *)buffers + (c->n+i)*buf_size;
+	return _gib_cauchy_recover_iov(survivors, buf_ids, out, recover_last,
+				       work_size, c);
+}
+
+static int
+_gib_cauchy_recover(void *buffers, int buf_size, int *buf_ids,
+		    int recover_last, gib_context c)
+{
+	return _gib_cauchy_recover_nc(buffers, buf_size, buf_size, buf_ids,
+				      recover_last, c);
+}
+
+/* Packet r of each block of a parity gets packet b of the delta's
+ * block wherever its bitmatrix block for the column has bit (r, b).
+ */
+static int
+_gib_cauchy_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+			unsigned char **new_data, unsigned char **parity,
+			int len, gib_context c)
+{
+	struct gib_jerasure_cauchy *jc = c->acc_context;
+	int ps = jc->packetsize;
+	int k = c->n;
+	int t, i, j, r, b, x;
+	char *delta;
+
+	if (len % (8 * ps))
+		return GIB_ERR;
+	delta = malloc(8 * ps);
+	if (delta == NULL)
+		return GIB_OOM;
+
+	for (t = 0; t < len; t += 8 * ps) {
+		for (i = 0; i < ncols; i++) {
+			for (x = 0; x < 8 * ps; x++)
+				delta[x] = old_data[i][t + x] ^
+					new_data[i][t + x];
+			for (j = 0; j < c->m; j++) {
+				for (r = 0; r < 8; r++) {
+					int *bits = jc->bitmatrix +
+						(j*8 + r) * k*8 +
+						data_ids[i] * 8;
+					char *p = (char *)parity[j] + t +
+						r * ps;
+					for (b = 0; b < 8; b++)
+						if (bits[b])
+							galois_region_xor(
+								delta + b * ps,
+								p, p, ps);
+				}
+			}
+		}
+	}
+	free(delta);
+	return 0;
+}
+
+struct dynamic_fp jerasure_cauchy = {
+		.gib_alloc = &_gib_cauchy_alloc,
+		.gib_destroy = &_gib_cauchy_destroy,
+		.gib_free = &_gib_free,
+		.gib_generate = &_gib_cauchy_generate,
+		.gib_generate_nc = &_gib_cauchy_generate_nc,
+		.gib_recover = &_gib_cauchy_recover,
+		.gib_recover_nc = &_gib_cauchy_recover_nc,
+		.gib_recover_sparse = &_gib_recover_sparse,
+		.gib_recover_sparse_nc = &_gib_recover_sparse_nc,
+		.gib_generate_iov = &_gib_cauchy_generate_iov,
+		.gib_recover_iov = &_gib_cauchy_recover_iov,
+		.gib_update_cols = &_gib_cauchy_update_cols,
+};
@@ -0,0 +1,534 @@
+/* gibraltar_parallel.c: Multithreaded decorator over any backend.
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Shares the inner context's expanded tables.
+ * Places threads and byte ranges on NUMA nodes, with per-node counters.
+ * Cuts calls at multiples of the inner context's block size.
+ *
+ */
+
+/* A parallel context owns another ("inner") context, and splits each
+ * generate or recover call into byte ranges that are handed to the
+ * inner backend's noncontiguous entry points on a persistent thread
+ * pool.  Byte ranges are independent in Reed-Solomon coding, so the
+ * result is identical to a single call on the inner context.
+ *
+ * On a machine with several NUMA nodes, the pool's threads are pinned
+ * to the nodes, and buffers of buf_size bytes are cut into one part per
+ * node: bytes [k * part, (k + 1) * part) of every buffer belong to node
+ * k.  gib_alloc places each part on its node by touching it first from
+ * there, and generate and recover hand each part to its own node's
+ * threads, so the data crosses the interconnect only when a node has
+ * run out of work and helps another.
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_thread_pool.h"
+#include "../inc/gib_numa.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Below this many bytes per buffer, a call stays on one thread. */
+#define GIB_PARALLEL_MIN_CHUNK (64*1024)
+
+/* Node parts are whole pages, so first touch can place them */
+#define GIB_PARALLEL_PAGE 4096
+
+struct gib_parallel_node {
+	struct gib_node_stats stats;
+	char pad[64];
+};
+
+struct gib_parallel_context {
+	struct gib_context_t *inner;
+	struct gib_pool *pool;
+	int min_chunk;
+	int nnodes;
+	struct gib_parallel_node *nodes;
+};
+
+struct gib_parallel_job {
+	struct gib_parallel_context *pc;
+	struct gib_context_t *inner;
+	unsigned char *buffers;
+	unsigned char **in;  /* For the scatter/gather calls */
+	unsigned char **out;
+	int buf_size;
+	int work_size;
+	int chunk;
+	int *buf_ids;
+	int recover_last;
+	int rc;
+
+	/* Node k runs jobs [first[k], first[k + 1]), which cover bytes
+	 * [k * part, (k + 1) * part) of each buffer.
+	 */
+	int nnodes;
+	int part;
+	int first[GIB_NUMA_MAX_NODES + 1];
+	int node_jobs[GIB_NUMA_MAX_NODES];
+};
+
+int
+gib_init_parallel(struct gib_context_t *inner, int nthreads, int min_chunk,
+		  gib_context *c)
+{
+	struct gib_parallel_context *pc;
+	int rc, nnodes;
+	char *env;
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	if (min_chunk <= 0)
+		min_chunk = GIB_PARALLEL_MIN_CHUNK;
+
+	/* Every node needs a worker of its own besides the caller */
+	nnodes = gib_numa_nodes();
+	env = getenv("GIB_PARALLEL_NUMA");
+	if ((env != NULL && atoi(env) == 0) || nthreads <= nnodes)
+		nnodes = 1;
+
+	*c = (gib_context) malloc(sizeof(struct gib_context_t));
+	if (*c == NULL)
+		return GIB_OOM;
+	pc = malloc(sizeof(struct gib_parallel_context));
+	if (pc == NULL) {
+		free(*c);
+		return GIB_OOM;
+	}
+	pc->nodes = calloc(nnodes, sizeof(struct gib_parallel_node));
+	if (pc->nodes == NULL) {
+		free(pc);
+		free(*c);
+		return GIB_OOM;
+	}
+	rc = gib_pool_create_numa(nthreads, nnodes, &pc->pool);
+	if (rc != GIB_SUC) {
+		free(pc->nodes);
+		free(pc);
+		free(*c);
+		return rc;
+	}
+	pc->inner = inner;
+	pc->min_chunk = gib_context_round(inner, min_chunk, 64);
+	pc->nnodes = nnodes;
+
+	(*c)->n = inner->n;
+	(*c)->m = inner->m;
+	(*c)->F = inner->F;
+	(*c)->F_rows = inner->F_rows;
+	(*c)->table_bytes = inner->table_bytes;
+	(*c)->block = inner->block;
+	(*c)->plans = inner->plans;
+	(*c)->acc_context = pc;
+	(*c)->strategy = &parallel;
+	return GIB_SUC;
+}
+
+int
+gib_parallel_nodes(struct gib_context_t *c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+
+	if (c->strategy != &parallel)
+		return 0;
+	return pc->nnodes;
+}
+
+int
+gib_parallel_node_stats(struct gib_context_t *c, int node,
+			struct gib_node_stats *stats)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+
+	if (c->strategy != &parallel || node < 0 || node >= pc->nnodes)
+		return GIB_ERR;
+	*stats = pc->nodes[node].stats;
+	return GIB_SUC;
+}
+
+/* Size of each node's part of a buffer of buf_size bytes */
+static int
+gib_parallel_part(struct gib_parallel_context *pc, int buf_size)
+{
+	int part = (buf_size + pc->nnodes - 1) / pc->nnodes;
+
+	return gib_context_round(pc->inner, part, GIB_PARALLEL_PAGE);
+}
+
+/* Splits the first work_size bytes of buffers of buf_size bytes into
+ * jobs, returning how many there are.  Jobs are a multiple of the
+ * cache line size, so that threads never write the same line, and of
+ * the inner context's block size, which it may not split.  The
+ * scatter/gather calls pass a buf_size of 0, as nothing is known about
+ * where their buffers lie, and any thread may take any of their jobs.
+ */
+static int
+gib_parallel_split(struct gib_parallel_context *pc, int buf_size,
+		   int work_size, struct gib_parallel_job *pj)
+{
+	int nthreads = gib_pool_size(pc->pool);
+	int k, start, end;
+
+	pj->pc = pc;
+	pj->work_size = work_size;
+	pj->nnodes = 1;
+	pj->part = work_size;
+	if (pc->nnodes > 1 && buf_size > 0) {
+		pj->nnodes = pc->nnodes;
+		pj->part = gib_parallel_part(pc, buf_size);
+		nthreads /= pc->nnodes;
+	}
+
+	pj->chunk = (pj->part + nthreads - 1) / nthreads;
+	pj->chunk = gib_context_round(pc->inner, pj->chunk, 64);
+	if (pj->chunk < pc->min_chunk)
+		pj->chunk = pc->min_chunk;
+
+	pj->first[0] = 0;
+	for (k = 0; k < pj->nnodes; k++) {
+		start = k * pj->part;
+		end = (start + pj->part < work_size) ?
+			start + pj->part : work_size;
+		pj->node_jobs[k] = (end > start) ?
+			(end - start + pj->chunk - 1) / pj->chunk : 0;
+		pj->first[k + 1] = pj->first[k] + pj->node_jobs[k];
+	}
+	for (; k < pc->nnodes; k++)
+		pj->node_jobs[k] = 0;
+	return pj->first[pj->nnodes];
+}
+
+static void
+gib_parallel_run(struct gib_parallel_job *pj, gib_pool_fn fn)
+{
+	gib_pool_run_nodes(pj->pc->pool, pj->node_jobs, 0, fn, pj);
+}
+
+/* Finds the bytes [*off, *off + len) of job, returning len */
+static int
+gib_parallel_range(struct gib_parallel_job *pj, int job, int *node,
+		   int *off)
+{
+	int k = 0, end;
+
+	while (job >= pj->first[k + 1])
+		k++;
+	*node = k;
+	*off = k * pj->part + (job - pj->first[k]) * pj->chunk;
+	end = (k + 1) * pj->part;
+	if (end > pj->work_size)
+		end = pj->work_size;
+	return (end - *off < pj->chunk) ? end - *off : pj->chunk;
+}
+
+static unsigned long long
+gib_parallel_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Charges len bytes of each data buffer, from the part of node, to the
+ * node of the calling thread.
+ */
+static void
+gib_parallel_account(struct gib_parallel_context *pc, int node, int len,
+		     unsigned long long start)
+{
+	struct gib_node_stats *s;
+	unsigned long bytes = (unsigned long)len * pc->inner->n;
+	int self = gib_pool_current_node(pc->pool);
+
+	s = &pc->nodes[self].stats;
+	__sync_fetch_and_add(&s->bytes, bytes);
+	if (node >= 0 && node != self)
+		__sync_fetch_and_add(&s->remote_bytes, bytes);
+	__sync_fetch_and_add(&s->ns, gib_parallel_clock() - start);
+}
+
+static void
+gib_parallel_generate_job(void *arg, int job)
+{
+	struct gib_parallel_job *pj = arg;
+	unsigned long long start = gib_parallel_clock();
+	int node, off, len, rc;
+
+	len = gib_parallel_range(pj, job, &node, &off);
+	rc = pj->inner->strategy->gib_generate_nc(pj->buffers + off,
+						  pj->buf_size, len,
+						  pj->inner);
+	if (rc != GIB_SUC)
+		pj->rc = rc;
+	gib_parallel_account(pj->pc, node, len, start);
+}
+
+static void
+gib_parallel_recover_job(void *arg, int job)
+{
+	struct gib_parallel_job *pj = arg;
+	unsigned long long start = gib_parallel_clock();
+	int node, off, len, rc;
+
+	len = gib_parallel_range(pj, job, &node, &off);
+	rc = pj->inner->strategy->gib_recover_nc(pj->buffers + off,
+						 pj->buf_size, len,
+						 pj->buf_ids,
+						 pj->recover_last,
+						 pj->inner);
+	if (rc != GIB_SUC)
+		pj->rc = rc;
+	gib_parallel_account(pj->pc, node, len, start);
+}
+
+static void
+gib_parallel_iov_job(void *arg, int job)
+{
+	struct gib_parallel_job *pj = arg;
+	struct gib_context_t *c = pj->inner;
+	unsigned long long start = gib_parallel_clock();
+	unsigned char *in[256], *out[256];
+	int nout = (pj->buf_ids == NULL) ? c->m : pj->recover_last;
+	int node, off, len, i, rc;
+
+	len = gib_parallel_range(pj, job, &node, &off);
+	for (i = 0; i < c->n; i++)
+		in[i] = pj->in[i] + off;
+	for (i = 0; i < nout; i++)
+		out[i] = pj->out[i] + off;
+	if (pj->buf_ids == NULL)
+		rc = gib_generate_iov(in, out, len, c);
+	else
+		rc = gib_recover_iov(in, pj->buf_ids, out, pj->recover_last,
+				     len, c);
+	if (rc != GIB_SUC)
+		pj->rc = rc;
+	gib_parallel_account(pj->pc, -1, len, start);
+}
+
+/* Zeroes node's part of every buffer from one of its threads, so that
+ * the kernel places the part's pages on that node.
+ */
+static void
+gib_parallel_touch_job(void *arg, int node)
+{
+	struct gib_parallel_job *pj = arg;
+	int off = node * pj->part;
+	int len = pj->buf_size - off;
+	int i, nbufs = pj->inner->n + pj->inner->m;
+
+	if (len > pj->part)
+		len = pj->part;
+	for (i = 0; len > 0 && i < nbufs; i++)
+		memset(pj->buffers + i * pj->buf_size + off, 0, len);
+}
+
+static int
+_gib_destroy(gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	int rc;
+
+	gib_pool_destroy(pc->pool);
+	rc = gib_destroy(pc->inner);
+	free(pc->nodes);
+	free(pc);
+	free(c);
+	return rc;
+}
+
+static int
+_gib_alloc(void **buffers, int buf_size, int *ld, gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	struct gib_parallel_job pj;
+	int k, rc;
+
+	rc = gib_alloc(buffers, buf_size, &pj.buf_size, pc->inner);
+	if (ld != NULL)
+		*ld = pj.buf_size;
+	if (rc != GIB_SUC || pc->nnodes == 1)
+		return rc;
+
+	/* Only the node's own threads may touch its part */
+	pj.inner = pc->inner;
+	pj.buffers = *buffers;
+	pj.part = gib_parallel_part(pc, pj.buf_size);
+	for (k = 0; k < pc->nnodes; k++)
+		pj.node_jobs[k] = 1;
+	gib_pool_run_nodes(pc->pool, pj.node_jobs, 1,
+			   gib_parallel_touch_job, &pj);
+	return GIB_SUC;
+}
+
+static int
+_gib_free(void *buffers, gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	return gib_free(buffers, pc->inner);
+}
+
+static int
+_gib_generate_nc(void *buffers, int buf_size, int work_size,
+		gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	struct gib_parallel_job pj;
+	int njobs;
+
+	njobs = gib_parallel_split(pc, buf_size, work_size, &pj);
+	if (njobs <= 1 || pc->inner->strategy->gib_generate_nc == NULL) {
+		unsigned long long start = gib_parallel_clock();
+		int rc;
+
+		if (work_size == buf_size)
+			rc = gib_generate(buffers, buf_size, pc->inner);
+		else
+			rc = gib_generate_nc(buffers, buf_size, work_size,
+					     pc->inner);
+		gib_parallel_account(pc, -1, work_size, start);
+		return rc;
+	}
+
+	pj.inner = pc->inner;
+	pj.buffers = buffers;
+	pj.buf_size = buf_size;
+	pj.rc = GIB_SUC;
+	gib_parallel_run(&pj, gib_parallel_generate_job);
+	return pj.rc;
+}
+
+static int
+_gib_generate(void *buffers, int buf_size, gib_context c)
+{
+	return _gib_generate_nc(buffers, buf_size, buf_size, c);
+}
+
+static int
+_gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
+	       int recover_last, gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	struct gib_parallel_job pj;
+	int njobs;
+
+	njobs = gib_parallel_split(pc, buf_size, work_size, &pj);
+	if (njobs <= 1 || pc->inner->strategy->gib_recover_nc == NULL) {
+		unsigned long long start = gib_parallel_clock();
+		int rc;
+
+		if (work_size == buf_size)
+			rc = gib_recover(buffers, buf_size, buf_ids,
+					 recover_last, pc->inner);
+		else
+			rc = gib_recover_nc(buffers, buf_size, work_size,
+					    buf_ids, recover_last, pc->inner);
+		gib_parallel_account(pc, -1, work_size, start);
+		return rc;
+	}
+
+	pj.inner = pc->inner;
+	pj.buffers = buffers;
+	pj.buf_size = buf_size;
+	pj.buf_ids = buf_ids;
+	pj.recover_last = recover_last;
+	pj.rc = GIB_SUC;
+	gib_parallel_run(&pj, gib_parallel_recover_job);
+	return pj.rc;
+}
+
+static int
+_gib_recover(void *buffers, int buf_size, int *buf_ids, int recover_last,
+	    gib_context c)
+{
+	return _gib_recover_nc(buffers, buf_size, buf_size, buf_ids,
+			       recover_last, c);
+}
+
+static int
+_gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		  gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	struct gib_parallel_job pj;
+
+	gib_parallel_split(pc, 0, len, &pj);
+	pj.inner = pc->inner;
+	pj.in = data;
+	pj.out = parity;
+	pj.buf_ids = NULL;
+	pj.rc = GIB_SUC;
+	gib_parallel_run(&pj, gib_parallel_iov_job);
+	return pj.rc;
+}
+
+static int
+_gib_recover_iov(unsigned char **survivors, int *buf_ids, unsigned char **out,
+		 int recover_last, int len, gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	struct gib_parallel_job pj;
+
+	gib_parallel_split(pc, 0, len, &pj);
+	pj.inner = pc->inner;
+	pj.in = survivors;
+	pj.out = out;
+	pj.buf_ids = buf_ids;
+	pj.recover_last = recover_last;
+	pj.rc = GIB_SUC;
+	gib_parallel_run(&pj, gib_parallel_iov_job);
+	return pj.rc;
+}
+
+/* Small writes are not worth waking the pool for. */
+static int
+_gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		 unsigned char **new_data, unsigned char **parity, int len,
+		 gib_context c)
+{
+	struct gib_parallel_context *pc = c->acc_context;
+	return gib_update_cols(ncols, data_ids, old_data, new_data, parity,
+			       len, pc->inner);
+}
+
+static int
+_gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		    gib_context c)
+{
+	return gib_cpu_recover_sparse(buffers, buf_size, failed_bufs, c);
+}
+
+static int
+_gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+		       char *failed_bufs, gib_context c)
+{
+	return gib_cpu_recover_sparse_nc(buffers, buf_size, work_size,
+					 failed_bufs, c);
+}
+
+struct dynamic_fp parallel = {
+		.gib_alloc = &_gib_alloc,
+		.gib_destroy = &_gib_destroy,
+		.gib_free = &_gib_free,
+		.gib_generate = &_gib_generate,
+		.gib_generate_nc = &_gib_generate_nc,
+		.gib_recover = &_gib_recover,
+		.gib_recover_nc = &_gib_recover_nc,
+		.gib_recover_sparse = &_gib_recover_sparse,
+		.gib_recover_sparse_nc = &_gib_recover_sparse_nc,
+		.gib_generate_iov = &_gib_generate_iov,
+		.gib_recover_iov = &_gib_recover_iov,
+		.gib_update_cols = &_gib_update_cols,
+};
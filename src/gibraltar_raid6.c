@@ -0,0 +1,526 @@
+/* gibraltar_raid6.c: RAID-6 (P+Q) specialization of the SIMD backend.
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version.
+ * Keeps expanded rows of F for the table-driven update.
+ *
+ */
+
+/* A RAID-6 context codes n data buffers into the two parities
+ *   P = D_0 + D_1 + ... + D_{n-1}
+ *   Q = g^0 D_0 + g^1 D_1 + ... + g^{n-1} D_{n-1},  g = 2
+ * in Gibraltar's field (polynomial 0435, the usual RAID-6 field).  Q is
+ * evaluated by Horner's rule, Q = ((D_{n-1} * g + D_{n-2}) * g + ...),
+ * so generation needs only XOR and multiplication by 2, which is a
+ * shift and a conditional XOR in every byte lane.  c->F holds the
+ * equivalent 2 x n matrix for the paths that want one.
+ *
+ * Recovery computes the syndromes of the surviving data (P and Q with
+ * the lost data taken as zero) with the same kernel, then solves for
+ * the lost buffers with the standard formulas.  For lost data x < y,
+ * with Pxy = P + P' and Qxy = Q + Q',
+ *   D_x = (g^{y-x} Pxy + g^{-x} Qxy) / (g^{y-x} + 1),  D_y = Pxy + D_x.
+ * The final constant multiplies run through the SIMD dot kernels.
+ *
+ * This is not the code gib_init_cpu and gib_init_simd generate, so
+ * buffers must be recovered by the kind of context that coded them.
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_galois.h"
+#include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_simd_funcs.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GIB_RAID6_X86 1
+#include <immintrin.h>
+#else
+#define GIB_RAID6_X86 0
+#endif
+
+/* Bytes of each buffer recovered per pass, so that the syndromes stay
+ * in L1 between the passes that produce and consume them.
+ */
+#define GIB_RAID6_CHUNK 4096
+
+/* Writes P and Q of the n buffers in[] to p and q, either of which may
+ * be NULL.  A NULL in[i] is taken as a buffer of zeros.
+ */
+typedef void (*gib_raid6_pq_fn)(unsigned char **in, int n, unsigned char *p,
+				unsigned char *q, int len);
+
+struct gib_raid6_context {
+	int isa;
+	gib_raid6_pq_fn pq;
+	gib_simd_dot_fn dot;
+};
+
+static void
+pq_scalar_range(unsigned char **in, int n, unsigned char *p,
+		unsigned char *q, int start, int len)
+{
+	int i, b;
+
+	for (b = start; b < len; b++) {
+		unsigned char pv = 0, qv = 0;
+		for (i = n - 1; i >= 0; i--) {
+			qv = gib_gf_table[2][qv];
+			if (in[i] != NULL) {
+				pv ^= in[i][b];
+				qv ^= in[i][b];
+			}
+		}
+		if (p != NULL)
+			p[b] = pv;
+		if (q != NULL)
+			q[b] = qv;
+	}
+}
+
+/* Eight lanes per 64-bit word: shift every byte left, and reduce the
+ * ones whose top bit fell off.
+ */
+static inline uint64_t
+mul2_word(uint64_t v)
+{
+	uint64_t hi = v & 0x8080808080808080ULL;
+	uint64_t lo = (v << 1) & 0xfefefefefefefefeULL;
+	return lo ^ ((hi >> 7) * 0x1d);
+}
+
+static void
+pq_word(unsigned char **in, int n, unsigned char *p, unsigned char *q,
+	int len)
+{
+	int off, i;
+
+	for (off = 0; off + 8 <= len; off += 8) {
+		uint64_t pv = 0, qv = 0, x;
+		for (i = n - 1; i >= 0; i--) {
+			qv = mul2_word(qv);
+			if (in[i] != NULL) {
+				memcpy(&x, in[i] + off, 8);
+				pv ^= x;
+				qv ^= x;
+			}
+		}
+		if (p != NULL)
+			memcpy(p + off, &pv, 8);
+		if (q != NULL)
+			memcpy(q + off, &qv, 8);
+	}
+	pq_scalar_range(in, n, p, q, off, len);
+}
+
+#if GIB_RAID6_X86
+__attribute__((target("sse2"))) static void
+pq_sse2(unsigned char **in, int n, unsigned char *p, unsigned char *q,
+	int len)
+{
+	const __m128i poly = _mm_set1_epi8(0x1d);
+	const __m128i zero = _mm_setzero_si128();
+	int off, i;
+
+	for (off = 0; off + 16 <= len; off += 16) {
+		__m128i pv = zero, qv = zero;
+		for (i = n - 1; i >= 0; i--) {
+			__m128i hi = _mm_cmpgt_epi8(zero, qv);
+			qv = _mm_xor_si128(_mm_add_epi8(qv, qv),
+					   _mm_and_si128(hi, poly));
+			if (in[i] != NULL) {
+				__m128i x = _mm_loadu_si128(
+					(const __m128i *)(in[i] + off));
+				pv = _mm_xor_si128(pv, x);
+				qv = _mm_xor_si128(qv, x);
+			}
+		}
+		if (p != NULL)
+			_mm_storeu_si128((__m128i *)(p + off), pv);
+		if (q != NULL)
+			_mm_storeu_si128((__m128i *)(q + off), qv);
+	}
+	pq_scalar_range(in, n, p, q, off, len);
+}
+
+__attribute__((target("avx2"))) static void
+pq_avx2(unsigned char **in, int n, unsigned char *p, unsigned char *q,
+	int len)
+{
+	const __m256i poly = _mm256_set1_epi8(0x1d);
+	const __m256i zero = _mm256_setzero_si256();
+	int off, i;
+
+	for (off = 0; off + 32 <= len; off += 32) {
+		__m256i pv = zero, qv = zero;
+		for (i = n - 1; i >= 0; i--) {
+			__m256i hi = _mm256_cmpgt_epi8(zero, qv);
+			qv = _mm256_xor_si256(_mm256_add_epi8(qv, qv),
+					      _mm256_and_si256(hi, poly));
+			if (in[i] != NULL) {
+				__m256i x = _mm256_loadu_si256(
+					(const __m256i *)(in[i] + off));
+				pv = _mm256_xor_si256(pv, x);
+				qv = _mm256_xor_si256(qv, x);
+			}
+		}
+		if (p != NULL)
+			_mm256_storeu_si256((__m256i *)(p + off), pv);
+		if (q != NULL)
+			_mm256_storeu_si256((__m256i *)(q + off), qv);
+	}
+	pq_scalar_range(in, n, p, q, off, len);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+pq_avx512(unsigned char **in, int n, unsigned char *p, unsigned char *q,
+	  int len)
+{
+	const __m512i poly = _mm512_set1_epi8(0x1d);
+	int off, i;
+
+	for (off = 0; off + 64 <= len; off += 64) {
+		__m512i pv = _mm512_setzero_si512();
+		__m512i qv = _mm512_setzero_si512();
+		for (i = n - 1; i >= 0; i--) {
+			__mmask64 hi = _mm512_movepi8_mask(qv);
+			qv = _mm512_xor_si512(
+				_mm512_add_epi8(qv, qv),
+				_mm512_maskz_mov_epi8(hi, poly));
+			if (in[i] != NULL) {
+				__m512i x = _mm512_loadu_si512(
+					(const void *)(in[i] + off));
+				pv = _mm512_xor_si512(pv, x);
+				qv = _mm512_xor_si512(qv, x);
+			}
+		}
+		if (p != NULL)
+			_mm512_storeu_si512((void *)(p + off), pv);
+		if (q != NULL)
+			_mm512_storeu_si512((void *)(q + off), qv);
+	}
+	pq_scalar_range(in, n, p, q, off, len);
+}
+#endif
+
+/* Only the shift-and-reduce step is vectorized here, so GFNI buys
+ * nothing over the plain vector width it comes with.
+ */
+static gib_raid6_pq_fn
+gib_raid6_get_pq(int isa)
+{
+#if GIB_RAID6_X86
+	switch (isa) {
+	case GIB_SIMD_AVX512:
+	case GIB_SIMD_GFNI_AVX512:
+		return pq_avx512;
+	case GIB_SIMD_AVX2:
+	case GIB_SIMD_GFNI_AVX2:
+		return pq_avx2;
+	case GIB_SIMD_SSSE3:
+		return pq_sse2;
+	}
+#endif
+	return pq_word;
+}
+
+static unsigned char
+gf_inv(unsigned char x)
+{
+	return gib_gf_ilog[(255 - gib_gf_log[x]) % 255];
+}
+
+/* g^e for 0 <= e < 255 */
+static unsigned char
+gf_exp2(int e)
+{
+	unsigned char v = 1;
+
+	while (e-- > 0)
+		v = gib_gf_table[2][v];
+	return v;
+}
+
+int
+gib_init_raid6(int n, gib_context *c)
+{
+	struct gib_raid6_context *rc6;
+	int i;
+
+	/* The g^i must be distinct, and n+2 buffers must fit the
+	 * 256-entry arrays used throughout.
+	 */
+	if (n < 1 || n > 254)
+		return GIB_ERR;
+	if (gib_galois_init())
+		return GIB_ERR;
+
+	*c = malloc(sizeof(struct gib_context_t));
+	if (*c == NULL)
+		return GIB_OOM;
+	(*c)->F = malloc(2 * n);
+	rc6 = malloc(sizeof(struct gib_raid6_context));
+	if ((*c)->F == NULL || rc6 == NULL) {
+		free(rc6);
+		free((*c)->F);
+		free(*c);
+		return GIB_OOM;
+	}
+	(*c)->n = n;
+	(*c)->m = 2;
+	(*c)->block = 1;
+	(*c)->plans = NULL;
+	for (i = 0; i < n; i++) {
+		(*c)->F[i] = 1;
+		(*c)->F[n + i] = gf_exp2(i);
+	}
+	if (gib_cpu_expand_rows((*c)->F, 2 * n, &(*c)->F_rows)) {
+		free(rc6);
+		free((*c)->F);
+		free(*c);
+		return GIB_OOM;
+	}
+	(*c)->table_bytes = 2 * n * 256;
+
+	rc6->isa = gib_simd_detect();
+	rc6->pq = gib_raid6_get_pq(rc6->isa);
+	rc6->dot = gib_simd_get_dot(rc6->isa);
+	(*c)->acc_context = rc6;
+	(*c)->strategy = &raid6;
+	return GIB_SUC;
+}
+
+static int
+_gib_destroy(gib_context c)
+{
+	free(c->acc_context);
+	free(c->F);
+	free(c->F_rows);
+	free(c);
+	return 0;
+}
+
+static int
+_gib_alloc(void **buffers, int buf_size, int *ld, gib_context c)
+{
+	return gib_simd_alloc(buffers, buf_size, ld, c);
+}
+
+static int
+_gib_free(void *buffers, gib_context c)
+{
+	return gib_simd_free(buffers);
+}
+
+static int
+_gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		  gib_context c)
+{
+	struct gib_raid6_context *rc6 = c->acc_context;
+
+	rc6->pq(data, c->n, parity[0], parity[1], len);
+	return 0;
+}
+
+static int
+_gib_generate_nc(void *buffers, int buf_size, int work_size, gib_context c)
+{
+	unsigned char *in[256];
+	unsigned char *c_buf = buffers;
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		in[i] = c_buf + i * buf_size;
+	((struct gib_raid6_context *)c->acc_context)->pq(
+		in, c->n, c_buf + c->n * buf_size,
+		c_buf + (c->n + 1) * buf_size, work_size);
+	return 0;
+}
+
+static int
+_gib_generate(void *buffers, int buf_size, gib_context c)
+{
+	return _gib_generate_nc(buffers, buf_size, buf_size, c);
+}
+
+/* A lost buffer as a combination of the parities, the syndromes, and
+ * the data buffer solved for first.
+ */
+enum { R6_P, R6_Q, R6_SP, R6_SQ, R6_DX };
+
+struct gib_raid6_term {
+	int cols;
+	int src[4];
+	struct gib_simd_tab tabs[4];
+};
+
+static void
+gib_raid6_term(struct gib_raid6_term *t, int src, unsigned char coef)
+{
+	t->src[t->cols] = src;
+	gib_simd_tab_init(&t->tabs[t->cols], coef);
+	t->cols++;
+}
+
+static int
+_gib_recover_iov(unsigned char **survivors, int *buf_ids, unsigned char **out,
+		 int recover_last, int len, gib_context c)
+{
+	struct gib_raid6_context *rc6 = c->acc_context;
+	unsigned char s_p[GIB_RAID6_CHUNK], s_q[GIB_RAID6_CHUNK];
+	unsigned char d_x[GIB_RAID6_CHUNK], d_y[GIB_RAID6_CHUNK];
+	unsigned char *buf[256], *in[256], *dst[256], *ptr[5];
+	struct gib_raid6_term tx, ty;
+	int n = c->n;
+	int lost[2], nlost = 0;
+	int i, t, x, y, chunk;
+
+	for (i = 0; i < n + 2; i++)
+		buf[i] = NULL;
+	for (i = 0; i < n; i++)
+		buf[buf_ids[i]] = survivors[i];
+	for (i = 0; i < n + 2; i++)
+		if (buf[i] == NULL)
+			lost[nlost++] = i;
+	if (nlost != 2)
+		return GIB_ERR;
+	for (i = 0; i < n + 2; i++)
+		dst[i] = NULL;
+	for (i = 0; i < recover_last; i++)
+		dst[buf_ids[n + i]] = out[i];
+
+	x = lost[0];
+	y = lost[1];
+	tx.cols = ty.cols = 0;
+	if (y == n + 1 && x < n) {
+		/* Data x and Q: D_x = P + P', Q = g^x D_x + Q' */
+		gib_raid6_term(&tx, R6_P, 1);
+		gib_raid6_term(&tx, R6_SP, 1);
+		gib_raid6_term(&ty, R6_DX, gf_exp2(x));
+		gib_raid6_term(&ty, R6_SQ, 1);
+	} else if (y == n) {
+		/* Data x and P: D_x = g^{-x} (Q + Q'), P = D_x + P' */
+		unsigned char gx = gf_inv(gf_exp2(x));
+		gib_raid6_term(&tx, R6_Q, gx);
+		gib_raid6_term(&tx, R6_SQ, gx);
+		gib_raid6_term(&ty, R6_DX, 1);
+		gib_raid6_term(&ty, R6_SP, 1);
+	} else if (y < n) {
+		unsigned char gyx = gf_exp2(y - x);
+		unsigned char den = gf_inv(gyx ^ 1);
+		unsigned char a = gib_gf_table[gyx][den];
+		unsigned char b = gib_gf_table[gf_inv(gf_exp2(x))][den];
+
+		gib_raid6_term(&tx, R6_P, a);
+		gib_raid6_term(&tx, R6_SP, a);
+		gib_raid6_term(&tx, R6_Q, b);
+		gib_raid6_term(&tx, R6_SQ, b);
+		gib_raid6_term(&ty, R6_P, 1);
+		gib_raid6_term(&ty, R6_SP, 1);
+		gib_raid6_term(&ty, R6_DX, 1);
+	}
+
+	for (t = 0; t < len; t += GIB_RAID6_CHUNK) {
+		unsigned char *dx, *dy;
+
+		chunk = (len - t < GIB_RAID6_CHUNK) ? len - t : GIB_RAID6_CHUNK;
+		for (i = 0; i < n; i++)
+			in[i] = (buf[i] == NULL) ? NULL : buf[i] + t;
+		dx = (dst[x] == NULL) ? d_x : dst[x] + t;
+		dy = (dst[y] == NULL) ? d_y : dst[y] + t;
+
+		if (x == n) {
+			/* Both parities: the data is whole. */
+			rc6->pq(in, n, (dst[x] == NULL) ? NULL : dx,
+				(dst[y] == NULL) ? NULL : dy, chunk);
+			continue;
+		}
+
+		/* Syndromes of the surviving data, then the solution */
+		rc6->pq(in, n, s_p, s_q, chunk);
+		ptr[R6_P] = (buf[n] == NULL) ? NULL : buf[n] + t;
+		ptr[R6_Q] = (buf[n + 1] == NULL) ? NULL : buf[n + 1] + t;
+		ptr[R6_SP] = s_p;
+		ptr[R6_SQ] = s_q;
+		ptr[R6_DX] = dx;
+		for (i = 0; i < tx.cols; i++)
+			in[i] = ptr[tx.src[i]];
+		rc6->dot(tx.tabs, 1, tx.cols, in, &dx, chunk);
+		if (dst[y] == NULL)
+			continue;
+		for (i = 0; i < ty.cols; i++)
+			in[i] = ptr[ty.src[i]];
+		rc6->dot(ty.tabs, 1, ty.cols, in, &dy, chunk);
+	}
+	return 0;
+}
+
+static int
+_gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
+		int recover_last, gib_context c)
+{
+	unsigned char *survivors[256], *out[256];
+	unsigned char *c_buf = buffers;
+	int i;
+
+	for (i = 0; i < c->n; i++)
+		survivors[i] = c_buf + i * buf_size;
+	for (i = 0; i < recover_last; i++)
+		out[i] = c_buf + (c->n + i) * buf_size;
+	return _gib_recover_iov(survivors, buf_ids, out, recover_last,
+				work_size, c);
+}
+
+static int
+_gib_recover(void *buffers, int buf_size, int *buf_ids, int recover_last,
+	     gib_context c)
+{
+	return _gib_recover_nc(buffers, buf_size, buf_size, buf_ids,
+			       recover_last, c);
+}
+
+static int
+_gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		    gib_context c)
+{
+	return gib_cpu_recover_sparse(buffers, buf_size, failed_bufs, c);
+}
+
+static int
+_gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+		       char *failed_bufs, gib_context c)
+{
+	return gib_cpu_recover_sparse_nc(buffers, buf_size, work_size,
+					 failed_bufs, c);
+}
+
+/* c->F is the P/Q matrix, so the table-driven update applies as is. */
+static int
+_gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		 unsigned char **new_data, unsigned char **parity, int len,
+		 gib_context c)
+{
+	return gib_cpu_update_cols(ncols, data_ids, old_data, new_data,
+				   parity, len, c);
+}
+
+struct dynamic_fp raid6 = {
+		.gib_alloc = &_gib_alloc,
+		.gib_destroy = &_gib_destroy,
+		.gib_free = &_gib_free,
+		.gib_generate = &_gib_generate,
+		.gib_generate_nc = &_gib_generate_nc,
+		.gib_recover = &_gib_recover,
+		.gib_recover_nc = &_gib_recover_nc,
+		.gib_recover_sparse = &_gib_recover_sparse,
+		.gib_recover_sparse_nc = &_gib_recover_sparse_nc,
+		.gib_generate_iov = &_gib_generate_iov,
+		.gib_recover_iov = &_gib_recover_iov,
+		.gib_update_cols = &_gib_update_cols,
+};
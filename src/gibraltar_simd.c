@@ -0,0 +1,143 @@
+/* gibraltar_simd.c: Vectorized CPU implementation.
+ *
+ * Copyright (C) University of Alabama at Birmingham and Sandia
+ * National Laboratories, 2010.
+ *
+ * Changes:
+ * Initial version; dynamic strategy over the split-table kernels.
+ *
+ */
+
+#include "../inc/gibraltar.h"
+#include "../inc/gib_context.h"
+#include "../inc/gib_cpu_funcs.h"
+#include "../inc/gib_simd_funcs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+
+int
+gib_init_simd(int n, int m, gib_context *c)
+{
+	int rc = gib_simd_init(n, m, c);
+	if (rc == GIB_SUC)
+		(*c)->strategy = &simd;
+	return rc;
+}
+
+static int
+_gib_destroy(gib_context c)
+{
+	return gib_simd_destroy(c);
+}
+
+static int
+_gib_alloc(void **buffers, int buf_size, int *ld, gib_context c)
+{
+	return gib_simd_alloc(buffers, buf_size, ld, c);
+}
+
+static int
+_gib_free(void *buffers, gib_context c)
+{
+	return gib_simd_free(buffers);
+}
+
+static int
+_gib_generate(void *buffers, int buf_size, gib_context c)
+{
+	return gib_simd_generate_nc(buffers, buf_size, buf_size, c);
+}
+
+static int
+_gib_generate_nc(void *buffers, int buf_size, int work_size,
+		gib_context c)
+{
+	return gib_simd_generate_nc(buffers, buf_size, work_size, c);
+}
+
+static int
+_gib_recover(void *buffers, int buf_size, int *buf_ids, int recover_last,
+	    gib_context c)
+{
+	return gib_simd_recover_nc(buffers, buf_size, buf_size, buf_ids,
+				   recover_last, c);
+}
+
+static int
+_gib_recover_nc(void *buffers, int buf_size, int work_size, int *buf_ids,
+	       int recover_last, gib_context c)
+{
+	return gib_simd_recover_nc(buffers, buf_size, work_size, buf_ids,
+				   recover_last, c);
+}
+
+static int
+_gib_generate_batch(void **buffers, int *buf_sizes, int count, gib_context c)
+{
+	return gib_simd_generate_batch(buffers, buf_sizes, count, c);
+}
+
+static int
+_gib_recover_batch(void **buffers, int *buf_sizes, int **buf_ids,
+		   int *recover_last, int count, gib_context c)
+{
+	return gib_simd_recover_batch(buffers, buf_sizes, buf_ids, recover_last,
+				      count, c);
+}
+
+static int
+_gib_generate_iov(unsigned char **data, unsigned char **parity, int len,
+		  gib_context c)
+{
+	return gib_simd_generate_iov(data, parity, len, c);
+}
+
+static int
+_gib_recover_iov(unsigned char **survivors, int *buf_ids, unsigned char **out,
+		 int recover_last, int len, gib_context c)
+{
+	return gib_simd_recover_iov(survivors, buf_ids, out, recover_last, len,
+				    c);
+}
+
+static int
+_gib_update_cols(int ncols, int *data_ids, unsigned char **old_data,
+		 unsigned char **new_data, unsigned char **parity, int len,
+		 gib_context c)
+{
+	return gib_simd_update_cols(ncols, data_ids, old_data, new_data,
+				    parity, len, c);
+}
+
+static int
+_gib_recover_sparse(void *buffers, int buf_size, char *failed_bufs,
+		    gib_context c)
+{
+	return gib_cpu_recover_sparse(buffers, buf_size, failed_bufs, c);
+}
+
+static int
+_gib_recover_sparse_nc(void *buffers, int buf_size, int work_size,
+		       char *failed_bufs, gib_context c)
+{
+	return gib_cpu_recover_sparse_nc(buffers, buf_size, work_size,
+					 failed_bufs, c);
+}
+
+struct dynamic_fp simd = {
+		.gib_alloc = &_gib_alloc,
+		.gib_destroy = &_gib_destroy,
+		.gib_free = &_gib_free,
+		.gib_generate = &_gib_generate,
+		.gib_generate_nc = &_gib_generate_nc,
+		.gib_recover = &_gib_recover,
+		.gib_recover_nc = &_gib_recover_nc,
+		.gib_recover_sparse = &_gib_recover_sparse,
+		.gib_recover_sparse_nc = &_gib_recover_sparse_nc,
+		.gib_generate_batch = &_gib_generate_batch,
+		.gib_recover_batch = &_gib_recover_batch,
+		.gib_generate_iov = &_gib_generate_iov,
+		.gib_recover_iov = &_gib_recover_iov,
+		.gib_update_cols = &_gib_update_cols,
+};